@@ -10,20 +10,33 @@
 #include "header.h"
 
 typedef enum WinType { None, Hann, Hamming, Blackman } sux_Window;
+typedef enum StorageType { Float32, Int16 } sux_Storage;
 
 /* Sliding Discrete Fourier Transform */
 typedef struct _SDFT *hSDFT;
 hSDFT SDFT_init( int nwin, int nsamples);
 void SDFT( hSDFT h, sux_Window window, float* data, complex** result );
+void SDFT_states( hSDFT h, const float* data, int nstep, complex** states );
+void SDFT_segment( hSDFT h, sux_Window window, const float* data, int ifirst, int n, const complex* state, complex** result );
 void ISDFT( hSDFT h, complex** specdata, float* result );
+float ISDFT_sample( hSDFT h, complex** specdata, int isample );
 void SDFT_window( hSDFT h, sux_Window window, complex** specdata );
+float SDFT_windowGain( hSDFT h, sux_Window window );
 void SDFT_free( hSDFT h );
 
+/* Streaming Sliding Discrete Fourier Transform of a trace given in chunks */
+typedef struct _SSDFT *hSSDFT;
+hSSDFT SSDFT_init( int nwin, sux_Window window );
+int SSDFT_push( hSSDFT h, int n, const float* data, complex** result );
+int SSDFT_flush( hSSDFT h, complex** result );
+void SSDFT_free( hSSDFT h );
+
 /* Sliding Discrete Cosine Transform */
 typedef struct _SDCT *hSDCT;
 hSDCT SDCT_init( int nwin, int nsamples );
 void SDCT( hSDCT handle, sux_Window window, float* data, float** result );
 void ISDCT( hSDCT handle, float** specdata, float* result );
+float ISDCT_sample( hSDCT handle, float** specdata, int isample );
 void SDCT_window( hSDCT handle, sux_Window window, float** specdata );
 void SDCT_free( hSDCT handle );
 
@@ -36,6 +49,7 @@ void OTB_copyCurrentHdr( hOTB h, segy* const tr );
 int OTB_getSlice( hOTB h, int isample, float* const data );
 const float** const OTB_getData( hOTB h );
 void OTB_getSlab( hOTB h, int isample, int size, float** const data );
+const float* OTB_getTrace( hOTB h, int itrace );
 void OTB_free( hOTB h );
 
 /* Cyclic Trace buffer for seg Y trace data */
@@ -46,20 +60,164 @@ int CTB_push( hCTB h, const segy* const tr );
 void CTB_copyCurrentHdr( hCTB h, segy* const tr );
 int CTB_getSlice( hCTB h, int isample, float* const data );
 const float** const CTB_getData( hCTB h );
+const float* CTB_getTrace( hCTB h, int itrace );
 void CTB_free( hCTB h );
 
 /* Cyclic buffer for multi-trace sliding discrete fourier transform */
 typedef struct _CBSDFT *hCBSDFT;
-hCBSDFT CBSDFT_init( int ntraces, int nsamples, int nwin, sux_Window window );
+hCBSDFT CBSDFT_init( int ntraces, int nsamples, int nwin, sux_Window window, sux_Storage storage );
+hCBSDFT CBSDFT_initTiled( int ntraces, int nsamples, int nwin, sux_Window window, sux_Storage storage, int ntile );
+sux_Storage CBSDFT_storage( hCBSDFT h );
 int     CBSDFT_traces( hCBSDFT h );
 int     CBSDFT_samples( hCBSDFT h );
 int     CBSDFT_size( hCBSDFT h );
 int     CBSDFT_nfreq( hCBSDFT h );
+int     CBSDFT_tiles( hCBSDFT h );
+int     CBSDFT_setTile( hCBSDFT h, int itile );
+int     CBSDFT_tileSamples( hCBSDFT h );
 int     CBSDFT_push( hCBSDFT h, const segy* const tr );
 int     CBSDFT_getSlice(  hCBSDFT h, int isample, int ifreq, complex* const data );
+void    CBSDFT_setResultSets( hCBSDFT h, int nsets );
+void    CBSDFT_useResultSet( hCBSDFT h, int iset );
 void    CBSDFT_setResult( hCBSDFT h, int isample, int ifreq, complex data );
+void    CBSDFT_passResult( hCBSDFT h, int isample, int ifreq );
 void    CBSDFT_getResult( hCBSDFT h, segy* const tr );
+void    CBSDFT_getNoise( hCBSDFT h, segy* const tr );
 void    CBSDFT_free( hCBSDFT );
 
+/* Cyclic buffer for multi-trace sliding discrete cosine transform */
+typedef struct _CBSDCT *hCBSDCT;
+hCBSDCT CBSDCT_init( int ntraces, int nsamples, int nwin, sux_Window window );
+int     CBSDCT_traces( hCBSDCT h );
+int     CBSDCT_samples( hCBSDCT h );
+int     CBSDCT_size( hCBSDCT h );
+int     CBSDCT_nfreq( hCBSDCT h );
+int     CBSDCT_push( hCBSDCT h, const segy* const tr );
+int     CBSDCT_getSlice( hCBSDCT h, int isample, int ifreq, float* const data );
+void    CBSDCT_setResult( hCBSDCT h, int isample, int ifreq, float data );
+void    CBSDCT_passResult( hCBSDCT h, int isample, int ifreq );
+void    CBSDCT_getResult( hCBSDCT h, segy* const tr );
+void    CBSDCT_getNoise( hCBSDCT h, segy* const tr );
+void    CBSDCT_free( hCBSDCT );
+
+/* Rolling buffer of lines for 3D sliding discrete fourier transform */
+typedef struct _LBSDFT *hLBSDFT;
+hLBSDFT LBSDFT_init( int nlines, int ntraces, int dkey, int nsamples, int nwin, sux_Window window );
+int     LBSDFT_lines( hLBSDFT h );
+int     LBSDFT_samples( hLBSDFT h );
+int     LBSDFT_nfreq( hLBSDFT h );
+int     LBSDFT_maxPanel( hLBSDFT h );
+void    LBSDFT_push( hLBSDFT h, const segy* const tr, int key );
+int     LBSDFT_endLine( hLBSDFT h );
+int     LBSDFT_traces( hLBSDFT h );
+int     LBSDFT_setTrace( hLBSDFT h, int itrace );
+int     LBSDFT_getSlice( hLBSDFT h, int isample, int ifreq, complex* const data );
+void    LBSDFT_setResult( hLBSDFT h, int isample, int ifreq, complex data );
+void    LBSDFT_passResult( hLBSDFT h, int isample, int ifreq );
+void    LBSDFT_getResult( hLBSDFT h, segy* const tr );
+void    LBSDFT_getNoise( hLBSDFT h, segy* const tr );
+void    LBSDFT_free( hLBSDFT );
+
+/* Local polynomial approximation smoothing kernels */
+typedef struct _LPA *hLPA;
+hLPA    LPA_init( int ntraces, int nsamples, int order );
+hLPA    LPA_init3D( int nlines, int ntraces, int nsamples, int order );
+int     LPA_lines( hLPA h );
+int     LPA_traces( hLPA h );
+int     LPA_samples( hLPA h );
+int     LPA_rank( hLPA h );
+float   LPA_weight( hLPA h, int iline, int itrace, int isample );
+const float* LPA_lineFilter( hLPA h, int iterm );
+const float* LPA_traceFilter( hLPA h, int iterm );
+const float* LPA_timeFilter( hLPA h, int iterm );
+void    LPA_filterTime( hLPA h, int iterm, int ns, const float* const in, float* const out );
+void    LPA_free( hLPA );
+
+/* Rolling buffer of lines for 3D LPA smoothing */
+typedef struct _LBLPA *hLBLPA;
+hLBLPA  LBLPA_init( hLPA lpa, int dkey, int nsamples );
+int     LBLPA_lines( hLBLPA h );
+int     LBLPA_samples( hLBLPA h );
+void    LBLPA_push( hLBLPA h, const segy* const tr, int key );
+int     LBLPA_endLine( hLBLPA h );
+int     LBLPA_traces( hLBLPA h );
+void    LBLPA_getResult( hLBLPA h, int itrace, segy* const tr );
+void    LBLPA_getNoise( hLBLPA h, int itrace, segy* const tr );
+void    LBLPA_free( hLBLPA );
+
+/* Batched Levinson solver for symmetric Toeplitz systems */
+typedef struct _BLEV *hBLEV;
+hBLEV   BLEV_init( int n, int nbatch );
+int     BLEV_size( hBLEV h );
+int     BLEV_batch( hBLEV h );
+int     BLEV_solve( hBLEV h, int nsys, float** r, float** g, float** f, int* ok );
+void    BLEV_free( hBLEV h );
+
+/* Direct reading of SEG-Y format traces */
+typedef struct _SGY *hSGY;
+hSGY    SGY_init( const void* buf, size_t size );
+int     SGY_format( hSGY h );
+int     SGY_samples( hSGY h );
+size_t  SGY_start( hSGY h );
+size_t  SGY_traceBytes( hSGY h, const void* trace );
+void    SGY_convert( hSGY h, const void* trace, segy* const tr );
+void    SGY_free( hSGY h );
+
+/* Lossless compression of float trace samples */
+size_t  FPZ_bound( int n );
+size_t  FPZ_encode( int n, const float* in, unsigned char* out );
+size_t  FPZ_decode( int n, const unsigned char* in, float* out );
+
+/* Quantization of float trace samples to 16 or 8 bit integers */
+int     QNT_bits( int n, const float* in, int nbits, float maxerr, float* scale );
+void    QNT_encode( int n, const float* in, int nbits, float scale, void* out );
+void    QNT_decode( int n, const void* in, int nbits, float scale, float* out );
+
+/* Asynchronous double-buffered seg Y trace input and output */
+typedef struct _TIO *hTIO;
+hTIO    TIO_init( int nslots );
+#ifdef SUX_MPI
+hTIO    TIO_initMPI( const char* infile, const char* outfile, int halo );
+#endif
+segy*   TIO_get( hTIO h );
+segy*   TIO_slot( hTIO h );
+void    TIO_put( hTIO h );
+void    TIO_quantize( hTIO h, int nbits, float maxerr );
+int     TIO_gettr( hTIO h, segy* const tr );
+void    TIO_puttr( hTIO h, const segy* const tr );
+int     TIO_traces( hTIO h );
+const segy* TIO_trace( hTIO h, int itrace );
+void    TIO_free( hTIO h );
+
+/* Trace operators for running several processes in one program */
+typedef struct _OP *hOP;
+typedef void (*OP_pushFunc)( void* state, const segy* const tr );
+typedef segy* (*OP_pullFunc)( void* state, int flush );
+typedef void (*OP_freeFunc)( void* state );
+hOP     OP_init( const char* name, int npar, char** par );
+hOP     OP_initargs( const char* name, const char* other );
+hOP     OP_new( const char* name, void* state, OP_pushFunc push, OP_pullFunc pull, OP_freeFunc free );
+const char* OP_name( hOP h );
+void    OP_push( hOP h, const segy* const tr );
+segy*   OP_pull( hOP h );
+void    OP_flush( hOP h );
+void    OP_free( hOP h );
+int     OP_run( hOP h, hTIO tio );
+int     OP_getint( int npar, char** par, const char* name, int* val );
+int     OP_getfloat( int npar, char** par, const char* name, float* val );
+int     OP_getstring( int npar, char** par, const char* name, char** val );
+int     OP_countval( int npar, char** par, const char* name );
+int     OP_getfloats( int npar, char** par, const char* name, float* val );
+hOP     OP_sdft( int npar, char** par );
+hOP     OP_isdft( int npar, char** par );
+hOP     OP_sdct( int npar, char** par );
+hOP     OP_isdct( int npar, char** par );
+hOP     OP_trcmedian( int npar, char** par );
+hOP     OP_ctrcmedian( int npar, char** par );
+hOP     OP_lpasmooth( int npar, char** par );
+hOP     OP_sdftdenoise( int npar, char** par );
+hOP     OP_sdctdenoise( int npar, char** par );
+hOP     OP_vpef( int npar, char** par );
+
 #endif /* end of SUX_H */
 
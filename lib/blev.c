@@ -0,0 +1,210 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+BLEV - batched Levinson solver for symmetric Toeplitz systems
+
+BLEV_init       initialise a batched Levinson solver handle
+BLEV_size       return the order of the systems solved
+BLEV_batch      return the maximum number of systems solved together
+BLEV_solve      solve a batch of symmetric Toeplitz systems
+BLEV_free       release a batched Levinson solver handle
+
+**************************************************************************
+Function Prototypes:
+hBLEV BLEV_init(int n, int nbatch);
+void BLEV_free(hBLEV h);
+int BLEV_size(hBLEV h);
+int BLEV_batch(hBLEV h);
+int BLEV_solve(hBLEV h, int nsys, float** r, float** g, float** f, int* ok);
+
+**************************************************************************
+BLEV_init:
+Input:
+n           order of the Toeplitz systems
+nbatch      maximum number of systems solved together
+
+Returned: batched Levinson solver handle
+
+**************************************************************************
+BLEV_solve:
+Input:
+h           batched Levinson solver handle created by BLEV_init
+nsys        number of systems to solve, at most nbatch
+r           array of nsys pointers to the top rows of the Toeplitz matrices
+g           array of nsys pointers to the right-hand-side column vectors
+
+Output:
+f           array of nsys pointers to the solution vectors
+ok          1 if a system was solved, 0 if it is singular or degenerate and
+            was left for the caller
+
+Returned:   number of systems solved
+
+**************************************************************************
+Notes:
+Solves the same equations as stoepf, with the same sequence of floating
+point operations, for up to nbatch systems at once. The systems are
+transposed into a sample-major layout so each step of the recursion runs
+in lockstep across the batch in a single inner loop that the compiler can
+vectorise, one system per SIMD lane.
+
+A system with r[0] zero, or whose prediction error power becomes zero,
+negative or non-finite during the recursion, is marked with ok=0 and its
+solution vector is not written. The caller should handle it separately,
+typically with stoepf.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+struct _BLEV {
+    int n;
+    int nbatch;
+    float** r;
+    float** g;
+    float** f;
+    float** a;
+    float* v;
+    float* e;
+    float* c;
+    int* good;
+};
+
+hBLEV BLEV_init( int n, int nbatch ) {
+
+    hBLEV h = emalloc(sizeof(struct _BLEV));
+    h->n = n;
+    h->nbatch = nbatch;
+    h->r = ealloc2float( nbatch, n );
+    h->g = ealloc2float( nbatch, n );
+    h->f = ealloc2float( nbatch, n );
+    h->a = ealloc2float( nbatch, n );
+    h->v = ealloc1float( nbatch );
+    h->e = ealloc1float( nbatch );
+    h->c = ealloc1float( nbatch );
+    h->good = ealloc1int( nbatch );
+    return h;
+}
+
+void BLEV_free( hBLEV h ) {
+    if (h) {
+        free2float( h->r );
+        free2float( h->g );
+        free2float( h->f );
+        free2float( h->a );
+        free1float( h->v );
+        free1float( h->e );
+        free1float( h->c );
+        free1int( h->good );
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in BLEV_free.");
+}
+
+int BLEV_size( hBLEV h ) {
+    return h ? h->n : 0;
+}
+
+int BLEV_batch( hBLEV h ) {
+    return h ? h->nbatch : 0;
+}
+
+int BLEV_solve( hBLEV h, int nsys, float** r, float** g, float** f, int* ok ) {
+    int nsolved = 0;
+    if (h && r && g && f && ok && nsys<=h->nbatch) {
+        int n = h->n;
+        float* restrict v = h->v;
+        float* restrict e = h->e;
+        float* restrict c = h->c;
+        int* restrict good = h->good;
+
+/* Transpose the systems so each lag is contiguous across the batch */
+        for (int j=0; j<n; j++) {
+            for (int k=0; k<nsys; k++) {
+                h->r[j][k] = r[k][j];
+                h->g[j][k] = g[k][j];
+            }
+        }
+        for (int k=0; k<nsys; k++) {
+            good[k] = (h->r[0][k] != 0.0);
+            v[k] = good[k]? h->r[0][k] : 1.0;
+            h->a[0][k] = 1.0;
+            h->f[0][k] = h->g[0][k]/v[k];
+        }
+
+        for (int j=1; j<n; j++) {
+            float* restrict aj = h->a[j];
+            float* restrict fj = h->f[j];
+            for (int k=0; k<nsys; k++) {
+                aj[k] = 0.0;
+                fj[k] = 0.0;
+                e[k] = 0.0;
+            }
+/* solve Ra=v as in Claerbout, FGDP, p. 57 */
+            for (int i=0; i<j; i++) {
+                const float* restrict ai = h->a[i];
+                const float* restrict rji = h->r[j-i];
+                for (int k=0; k<nsys; k++)
+                    e[k] += ai[k]*rji[k];
+            }
+            for (int k=0; k<nsys; k++) {
+                c[k] = e[k]/v[k];
+                v[k] -= c[k]*e[k];
+                if (!(v[k] > 0.0) || !isfinite(v[k])) {
+                    good[k] = 0;
+                    v[k] = 1.0;
+                }
+            }
+            for (int i=0; i<=j/2; i++) {
+                float* restrict ai = h->a[i];
+                float* restrict aji = h->a[j-i];
+                if (i == j-i) {
+                    for (int k=0; k<nsys; k++)
+                        ai[k] -= c[k]*ai[k];
+                } else {
+                    for (int k=0; k<nsys; k++) {
+                        float bot = aji[k] - c[k]*ai[k];
+                        ai[k] -= c[k]*aji[k];
+                        aji[k] = bot;
+                    }
+                }
+            }
+/* use a and v above to get f[i], i = 0,1,2,...,j */
+            for (int k=0; k<nsys; k++)
+                e[k] = 0.0;
+            for (int i=0; i<j; i++) {
+                const float* restrict fi = h->f[i];
+                const float* restrict rji = h->r[j-i];
+                for (int k=0; k<nsys; k++)
+                    e[k] += fi[k]*rji[k];
+            }
+            for (int k=0; k<nsys; k++)
+                c[k] = (e[k] - h->g[j][k])/v[k];
+            for (int i=0; i<=j; i++) {
+                float* restrict fi = h->f[i];
+                const float* restrict aji = h->a[j-i];
+                for (int k=0; k<nsys; k++)
+                    fi[k] -= c[k]*aji[k];
+            }
+        }
+
+        for (int k=0; k<nsys; k++) {
+            ok[k] = good[k];
+            if (good[k]) {
+                for (int j=0; j<n; j++)
+                    f[k][j] = h->f[j][k];
+                nsolved++;
+            }
+        }
+    } else
+        err("bad arguments in BLEV_solve.");
+    return nsolved;
+}
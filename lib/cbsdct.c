@@ -0,0 +1,214 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+CBSDCT - cyclic buffer for sliding discrete cosine transform of multi-trace panel
+
+CBSDCT_init     initialise a cyclic SDCT buffer handle
+CBSDCT_traces   return number of traces in the buffer
+CBSDCT_samples  return number of time samples per trace
+CBSDCT_size     return number of samples in SDCT window
+CBSDCT_nfreq    return number of SDCT coefficients held in the buffer
+CBSDCT_push     add a seg y trace to the buffer
+CBSDCT_getSlice get the spectral data for all traces at the specified time, coefficient index
+CBSDCT_setResult set the output spectral value at the specified time, coefficient index
+CBSDCT_passResult pass the current trace spectral value unchanged to the output
+CBSDCT_getResult get the output trace by inverse SDCT of the result spectra
+CBSDCT_getNoise get the difference between the current trace and the output trace
+CBSDCT_free     release a SDCT buffer handle
+
+************************************************************************** 
+Function Prototypes:
+hCBSDCT CBSDCT_init(int ntraces, in nsamples, int nwin, suxWindow window);
+void CBSDCT_free(hCBSDCT h);
+int CBSDCT_traces(hCBSDCT h);
+int CBSDCT_samples(hCBSDCT h);
+int CBSDCT_size(hCBSDCT h);
+int CBSDCT_nfreq(hCBSDCT h);
+int CBSDCT_push(hCBSDCT h, const segy* const tr);
+int CBSDCT_getSlice(hCBSDCT h, int isample, int ifreq, float* const data);
+void CBSDCT_setResult(hCBSDCT h, int isample, int ifreq, float val);
+void CBSDCT_passResult(hCBSDCT h, int isample, int ifreq);
+void CBSDCT_getResult(hCBSDCT h, segy* const tr);
+void CBSDCT_getNoise(hCBSDCT h, segy* const tr);
+
+************************************************************************** 
+Notes:
+This is the sliding DCT counterpart of CBSDFT. The inverse SDCT only uses the
+even SDCT coefficients so only those nwin/2+1 real coefficients are kept in 
+the buffer, ifreq=i in CBSDCT_getSlice refers to SDCT coefficient 2*i. This 
+halves the memory needed compared to the complex spectra held by CBSDFT.
+
+As in CBSDFT, time samples where every coefficient was passed through with 
+CBSDCT_passResult are copied straight from the input trace instead of being 
+inverse transformed. The windowed SDCT does not reconstruct the input exactly,
+so this shortcut is only taken when no window is applied.
+
+************************************************************************** 
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+typedef struct {
+    unsigned char hdr[HDRBYTES];
+} _HDR;
+
+struct _CBSDCT {
+    int ns;
+    int nwin;
+    int ntr;
+    sux_Window window;
+    int intr;
+    int outtr;
+    int trcount;
+    hSDCT sdctH;
+    float** workbuf;
+    float** resdata;
+    float** resbuf;
+    int* modified;
+    float** trcdata;
+    _HDR* hdrs;
+    float*** specdata;
+};
+
+hCBSDCT CBSDCT_init( int ntraces, int nsamples, int nwin, sux_Window window ) {
+    
+    hCBSDCT h = emalloc(sizeof(struct _CBSDCT));
+    h->ntr = ntraces;
+    h->ns = nsamples;
+    h->nwin = nwin;
+    h->window = window;
+    int nf = nwin/2 + 1;
+    h->sdctH = SDCT_init( nwin, nsamples );
+    h->workbuf = ealloc2float( nsamples, nwin );
+/* Only the even SDCT coefficients are used by the inverse so the result
+   rows are indexed as for ISDCT_sample but only those nf are allocated */
+    h->resdata = ealloc2float( nsamples, nf );
+    memset( (void*)h->resdata[0], 0, nf*nsamples*FSIZE );
+    h->resbuf = ealloc1( nwin, sizeof(float*) );
+    for (int i=0; i<nwin; i++)
+        h->resbuf[i] = (i%2)? 0 : h->resdata[i/2];
+    h->modified = ealloc1int( nsamples );
+    memset( (void*)h->modified, 0, nsamples*ISIZE );
+    h->trcdata = ealloc2float( nsamples, ntraces );
+    h->specdata = ealloc3float( nsamples, nf, ntraces );
+    h->hdrs = ealloc1(ntraces, sizeof(_HDR));
+    h->intr = -1;
+    h->outtr = 0;
+    h->trcount = 0;
+    return h;
+}
+
+void CBSDCT_free( hCBSDCT h ) {
+    if (h) {
+        if (h->workbuf) free2float(h->workbuf);
+        if (h->resdata) free2float(h->resdata);
+        if (h->resbuf) free1(h->resbuf);
+        if (h->modified) free1int(h->modified);
+        if (h->trcdata) free2float(h->trcdata);
+        if (h->specdata) free3float(h->specdata);
+        if (h->hdrs) free1(h->hdrs);
+        SDCT_free(h->sdctH);
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in CBSDCT_free.");
+}
+
+int CBSDCT_traces( hCBSDCT h ) {
+    return h ? h->trcount : 0;
+}
+
+int CBSDCT_samples( hCBSDCT h ) {
+    return h ? h->ns : 0;
+}
+
+int CBSDCT_size( hCBSDCT h ) {
+    return h ? h->nwin : 0;
+}
+
+int CBSDCT_nfreq(  hCBSDCT h ) {
+    return h ? h->nwin/2+1 : 0;
+}
+
+int CBSDCT_push( hCBSDCT h, const segy* const tr ) {
+    if (h) {
+        if (tr) {
+            int nf = h->nwin/2 + 1;
+            h->intr = (h->intr + 1)%h->ntr;
+            SDCT(h->sdctH, h->window, (float*) tr->data, h->workbuf);
+            for (int ifr=0; ifr<nf; ifr++)
+                memcpy( (void*)h->specdata[h->intr][ifr], (void*)h->workbuf[2*ifr], h->ns*FSIZE );
+            memcpy( (void*)h->trcdata[h->intr], (void*) tr->data, h->ns*FSIZE );
+            memcpy( (void*)&(h->hdrs[h->intr]), (void*) tr, HDRBYTES );
+            h->outtr = (h->trcount <= h->ntr/2)? h->outtr : (h->outtr + 1)%h->ntr;
+            h->trcount = (h->trcount < h->ntr)? h->trcount+1 : h->ntr;
+        } else {
+            h->trcount = (h->trcount>0)? h->trcount-1 : 0;
+            h->outtr = (h->outtr + 1)%h->ntr;
+        }
+    } else
+        err("bad pointer in CBSDCT_push.");
+    return h ? h->trcount > h->ntr/2 : 0;
+}
+
+int CBSDCT_getSlice( hCBSDCT h, int isample, int ifreq, float* const data ) {
+    if (h && data) {
+        if (h->trcount >= h->ntr/2) {
+            int spos = h->intr - h->trcount + 1;
+            spos = (spos<0)? spos+h->ntr : spos;
+            for (int itrc=0; itrc<h->trcount; itrc++ )
+                data[itrc] = h->specdata[(spos+itrc)%h->ntr][ifreq][isample];
+            spos = (spos > h->outtr)? spos-h->ntr : spos;
+            return (h->trcount < h->ntr)? h->outtr - spos : h->ntr/2;
+        } else {
+            warn("trace buffer too empty in CBSDCT_getSlice.");
+        }
+    } else
+        err("bad pointer in CBSDCT_getSlice.");
+    return 0;
+}
+
+void CBSDCT_setResult( hCBSDCT h, int isample, int ifreq, float data ) {
+    if (h) {
+        h->resbuf[2*ifreq][isample] = data;
+        h->modified[isample] = 1;
+    } else
+        err("bad pointer in CBSDCT_setResult");
+}
+
+void CBSDCT_passResult( hCBSDCT h, int isample, int ifreq ) {
+    if (h)
+        h->resbuf[2*ifreq][isample] = h->specdata[h->outtr][ifreq][isample];
+    else
+        err("bad pointer in CBSDCT_passResult");
+}
+
+void CBSDCT_getResult( hCBSDCT h, segy* const tr ) {
+    if (h && tr) {
+        float* indata = h->trcdata[h->outtr];
+        for (int is=0; is<h->ns; is++) {
+            tr->data[is] = (h->modified[is] || h->window!=None)? ISDCT_sample( h->sdctH, h->resbuf, is ) : indata[is];
+            h->modified[is] = 0;
+        }
+        memcpy( (void*)tr, (void*)&(h->hdrs[h->outtr]), HDRBYTES );
+    } else
+        err("bad pointer in CBSDCT_getResult");
+}
+
+void CBSDCT_getNoise( hCBSDCT h, segy* const tr ) {
+    if (h && tr) {
+        float* indata = h->trcdata[h->outtr];
+        for (int is=0; is<h->ns; is++) {
+            tr->data[is] = (h->modified[is] || h->window!=None)? indata[is] - ISDCT_sample( h->sdctH, h->resbuf, is ) : 0.0;
+            h->modified[is] = 0;
+        }
+        memcpy( (void*)tr, (void*)&(h->hdrs[h->outtr]), HDRBYTES );
+    } else
+        err("bad pointer in CBSDCT_getNoise");
+}
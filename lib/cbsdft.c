@@ -6,26 +6,94 @@
 CBSDFT - cyclic buffer for sliding discrete fourier transform of multi-trace panel
 
 CBSDFT_init     initialise a cyclic SDFT buffer handle
+CBSDFT_initTiled initialise a cyclic SDFT buffer handle that works in time tiles
+CBSDFT_storage  return the storage type used for the buffered spectra
 CBSDFT_traces   return number of traces in the buffer
 CBSDFT_samples  return number of time samples per trace
 CBSDFT_size     return number of samples in SDFT window
 CBSDFT_nfreq    return number of frequencies in SDFT
+CBSDFT_tiles    return number of time tiles per trace
+CBSDFT_setTile  make a time tile current and return its first sample
+CBSDFT_tileSamples return number of time samples in the current tile
 CBSDFT_push     add a seg y trace to the buffer
 CDSDFT_getslice get the spectral data for all traces at the specified time, frequency index
+CBSDFT_setResultSets allocate a number of independent result sets
+CBSDFT_useResultSet select the result set used by the result functions
+CBSDFT_setResult set the output spectral value at the specified time, frequency index
+CBSDFT_passResult pass the current trace spectral value unchanged to the output
+CBSDFT_getResult get the output trace by inverse SDFT of the result spectra
+CBSDFT_getNoise get the difference between the current trace and the output trace
 CBSDFT_free     release a SDFT transformer handle
 
 ************************************************************************** 
 Function Prototypes:
-hCBSDFT CBSDFT_init(int ntraces, in nsamples, int nwin, suxWindow window);
+hCBSDFT CBSDFT_init(int ntraces, in nsamples, int nwin, suxWindow window, sux_Storage storage);
+hCBSDFT CBSDFT_initTiled(int ntraces, in nsamples, int nwin, suxWindow window, sux_Storage storage, int ntile);
 void CBSDFT_free(hCBSDFT h);
+sux_Storage CBSDFT_storage(hCBSDFT h);
 int CBSDFT_traces(hCBSDFT h);
 int CBSDFT_samples(hCBSDFT h);
 int CBSDFT_size(hCBSDFT h);
 int CBSDFT_nfreq(hCBSDFT h);
+int CBSDFT_tiles(hCBSDFT h);
+int CBSDFT_setTile(hCBSDFT h, int itile);
+int CBSDFT_tileSamples(hCBSDFT h);
 int CBSDFT_push(hCBSDFT h, const segy* const tr);
 int CBSDFT_getSlice(hCBSDFT h, int isample, int ifreq, complex* const data);
+void CBSDFT_setResultSets(hCBSDFT h, int nsets);
+void CBSDFT_useResultSet(hCBSDFT h, int iset);
 void CBSDFT_setResult(hCBSDFT h, int isample, int ifreq, complex val);
+void CBSDFT_passResult(hCBSDFT h, int isample, int ifreq);
 void CBSDFT_getResult(hCBSDFT h, segy* const tr);
+void CBSDFT_getNoise(hCBSDFT h, segy* const tr);
+
+************************************************************************** 
+Notes:
+The buffer keeps a copy of the input trace data alongside the spectra and 
+tracks which time samples of the result had any spectral value changed by 
+CBSDFT_setResult. Time samples where every frequency was passed through with
+CBSDFT_passResult are copied straight from the input trace (scaled by the 
+window gain) instead of being inverse transformed, so a process that mostly 
+leaves the data alone only pays for the inverse SDFT where it actually changed
+something.
+
+With storage=Int16 the buffered spectra are held as block scaled 16 bit 
+integers, one float scale factor per CBSDFT_BLOCK samples of each trace and 
+frequency. This halves the memory footprint of the buffer at the cost of a 
+relative error around 1/32767 of the largest value in each block. Values 
+returned by CBSDFT_getSlice are always float complex, but they are the 
+dequantized spectra, so amplitudes computed from them for ranking carry the 
+same error. No float amplitudes are cached, as a float per sample would take 
+back the memory the 16 bit spectra save. The result is then held
+as the change from the buffered spectra and added to the input trace, so 
+frequencies passed through with CBSDFT_passResult carry no quantisation error.
+
+A buffer created by CBSDFT_initTiled only holds the spectra for one tile of 
+ntile time samples at a time, so memory use is bounded by the tile size 
+rather than the trace length. On push the SDFT recurrence is run over the 
+whole trace and only the unwindowed spectrum at the start of each tile is 
+kept, see SDFT_states. Spectra for a tile are computed from the buffered 
+traces, carrying the recurrence on from those, when the tile is made current 
+by CBSDFT_setTile, so they are exactly the spectra an untiled buffer holds. 
+With storage=Int16 the blocks of CBSDFT_BLOCK samples start at each tile, so 
+the quantised spectra are also the same only when ntile is a multiple of 
+CBSDFT_BLOCK. Results are returned one tile at a time, so CBSDFT_getResult 
+or CBSDFT_getNoise must be called for every tile. Sample indexes passed to 
+CBSDFT_getSlice, CBSDFT_setResult and CBSDFT_passResult are always relative 
+to the start of the trace. A buffer created by CBSDFT_init has a single 
+tile covering the whole trace.
+
+Every trace in the panel is transformed again for each output trace, so 
+tiling multiplies the SDFT work by about the number of traces in the panel, 
+ntraces forward transforms per output trace instead of one. It only pays 
+when the untiled panel of spectra does not fit in memory, or the inverse 
+and ranking work saved by keeping the working set in cache is larger.
+
+CBSDFT_setResultSets allows several results to be built from one pass over 
+the buffered spectra, for example when comparing processing parameters. The
+set selected with CBSDFT_useResultSet is the one updated by CBSDFT_setResult 
+and CBSDFT_passResult and returned by CBSDFT_getResult and CBSDFT_getNoise. 
+A new buffer has a single result set.
 
 ************************************************************************** 
 Author: Wayne Mogg
@@ -36,6 +104,8 @@ Author: Wayne Mogg
 #include "par.h"
 #include "sux.h"
 
+#define CBSDFT_BLOCK 64
+
 typedef struct {
     unsigned char hdr[HDRBYTES];
 } _HDR;
@@ -45,27 +115,70 @@ struct _CBSDFT {
     int nwin;
     int ntr;
     sux_Window window;
+    sux_Storage storage;
+    float gain;
     int intr;
     int outtr;
     int trcount;
+    int ntile;
+    int tiled;
+    int tfirst;
+    int tsamples;
     hSDFT sdftH;
+    int nsets;
+    complex*** ressets;
+    int** modsets;
     complex** resbuf;
+    int* modified;
+    float** trcdata;
+    complex*** tilestate;
     _HDR* hdrs;
     complex*** specdata;
+    complex** workbuf;
+    short*** packdata;
+    float*** packscale;
 };
 
-hCBSDFT CBSDFT_init( int ntraces, int nsamples, int nwin, sux_Window window ) {
+static void store( hCBSDFT h, int itrc, int n );
+static complex unpack( hCBSDFT h, int itrc, int ifreq, int isample );
+
+hCBSDFT CBSDFT_init( int ntraces, int nsamples, int nwin, sux_Window window, sux_Storage storage ) {
+    return CBSDFT_initTiled( ntraces, nsamples, nwin, window, storage, nsamples );
+}
+
+hCBSDFT CBSDFT_initTiled( int ntraces, int nsamples, int nwin, sux_Window window, sux_Storage storage, int ntile ) {
     
     hCBSDFT h = emalloc(sizeof(struct _CBSDFT));
     h->ntr = ntraces;
     h->ns = nsamples;
     h->nwin = nwin;
     h->window = window;
+    h->storage = storage;
     int hw = nwin/2;
     int nf = hw + 1;
+    h->ntile = (ntile>0 && ntile<nsamples)? ntile : nsamples;
+    h->tiled = h->ntile < nsamples;
+    h->tfirst = 0;
+    h->tsamples = h->ntile;
+    int nt = h->ntile;
     h->sdftH = SDFT_init( nwin, nsamples );
-    h->resbuf = ealloc2complex( nsamples, nf );
-    h->specdata = ealloc3complex( nsamples, nf, nwin );
+    h->gain = SDFT_windowGain( h->sdftH, window );
+    h->nsets = 0;
+    h->ressets = 0;
+    h->modsets = 0;
+    CBSDFT_setResultSets( h, 1 );
+    h->trcdata = ealloc2float( nsamples, ntraces );
+    h->tilestate = (h->tiled)? ealloc3complex( nf, CBSDFT_tiles(h), ntraces ) : 0;
+    h->specdata = 0;
+    h->workbuf = (h->tiled || storage==Int16)? ealloc2complex( nt, nf ) : 0;
+    h->packdata = 0;
+    h->packscale = 0;
+    if (storage==Int16) {
+        int nblock = (nt + CBSDFT_BLOCK - 1)/CBSDFT_BLOCK;
+        h->packdata = (short***) ealloc3( 2*nt, nf, ntraces, sizeof(short) );
+        h->packscale = ealloc3float( nblock, nf, ntraces );
+    } else
+        h->specdata = ealloc3complex( nt, nf, ntraces );
     h->hdrs = ealloc1(ntraces, sizeof(_HDR));
     h->intr = -1;
     h->outtr = 0;
@@ -75,8 +188,18 @@ hCBSDFT CBSDFT_init( int ntraces, int nsamples, int nwin, sux_Window window ) {
 
 void CBSDFT_free( hCBSDFT h ) {
     if (h) {
-        if (h->resbuf) free2complex(h->resbuf);
+        for (int iset=0; iset<h->nsets; iset++) {
+            free2complex(h->ressets[iset]);
+            free1int(h->modsets[iset]);
+        }
+        if (h->ressets) free1(h->ressets);
+        if (h->modsets) free1(h->modsets);
+        if (h->trcdata) free2float(h->trcdata);
+        if (h->tilestate) free3complex(h->tilestate);
         if (h->specdata) free3complex(h->specdata);
+        if (h->workbuf) free2complex(h->workbuf);
+        if (h->packdata) free3((void***)h->packdata);
+        if (h->packscale) free3float(h->packscale);
         if (h->hdrs) free1(h->hdrs);
         SDFT_free(h->sdftH);
         free(h);
@@ -85,6 +208,10 @@ void CBSDFT_free( hCBSDFT h ) {
         err("bad pointer in CBSDFT_free.");
 }
 
+sux_Storage CBSDFT_storage( hCBSDFT h ) {
+    return h ? h->storage : Float32;
+}
+
 int CBSDFT_traces( hCBSDFT h ) {
     return h ? h->trcount : 0;
 }
@@ -101,11 +228,46 @@ int CBSDFT_nfreq(  hCBSDFT h ) {
     return h ? h->nwin/2+1 : 0;
 }
 
+int CBSDFT_tiles( hCBSDFT h ) {
+    return h ? (h->ns + h->ntile - 1)/h->ntile : 0;
+}
+
+int CBSDFT_setTile( hCBSDFT h, int itile ) {
+    if (h) {
+        h->tfirst = itile*h->ntile;
+        h->tsamples = MIN(h->ntile, h->ns - h->tfirst);
+        if (h->tiled) {
+            int spos = h->intr - h->trcount + 1;
+            spos = (spos<0)? spos+h->ntr : spos;
+            for (int itrc=0; itrc<h->trcount; itrc++) {
+                int ipos = (spos+itrc)%h->ntr;
+                SDFT_segment( h->sdftH, h->window, h->trcdata[ipos], h->tfirst, h->tsamples, 
+                              h->tilestate[ipos][itile], h->workbuf );
+                store( h, ipos, h->tsamples );
+            }
+        }
+        return h->tfirst;
+    } else
+        err("bad pointer in CBSDFT_setTile.");
+    return 0;
+}
+
+int CBSDFT_tileSamples( hCBSDFT h ) {
+    return h ? h->tsamples : 0;
+}
+
 int CBSDFT_push( hCBSDFT h, const segy* const tr ) {
     if (h) {
         if (tr) {
             h->intr = (h->intr + 1)%h->ntr;
-            SDFT(h->sdftH, h->window, (float*) tr->data, h->specdata[h->intr]);
+            if (h->tiled)
+                SDFT_states( h->sdftH, tr->data, h->ntile, h->tilestate[h->intr] );
+            else if (h->storage==Int16) {
+                SDFT(h->sdftH, h->window, (float*) tr->data, h->workbuf);
+                store( h, h->intr, h->ns );
+            } else
+                SDFT(h->sdftH, h->window, (float*) tr->data, h->specdata[h->intr]);
+            memcpy( (void*)h->trcdata[h->intr], (void*) tr->data, h->ns*FSIZE );
             memcpy( (void*)&(h->hdrs[h->intr]), (void*) tr, HDRBYTES );
             h->outtr = (h->trcount <= h->ntr/2)? h->outtr : (h->outtr + 1)%h->ntr;
             h->trcount = (h->trcount < h->ntr)? h->trcount+1 : h->ntr;
@@ -123,8 +285,14 @@ int CBSDFT_getSlice( hCBSDFT h, int isample, int ifreq, complex* const data ) {
         if (h->trcount >= h->ntr/2) {
             int spos = h->intr - h->trcount + 1;
             spos = (spos<0)? spos+h->ntr : spos;
-            for (int itrc=0; itrc<h->trcount; itrc++ )
-                data[itrc] = h->specdata[(spos+itrc)%h->ntr][ifreq][isample];
+            int it = isample - h->tfirst;
+            if (h->storage==Int16) {
+                for (int itrc=0; itrc<h->trcount; itrc++ )
+                    data[itrc] = unpack( h, (spos+itrc)%h->ntr, ifreq, it );
+            } else {
+                for (int itrc=0; itrc<h->trcount; itrc++ )
+                    data[itrc] = h->specdata[(spos+itrc)%h->ntr][ifreq][it];
+            }
             spos = (spos > h->outtr)? spos-h->ntr : spos;
             return (h->trcount < h->ntr)? h->outtr - spos : h->ntr/2;
         } else {
@@ -135,18 +303,122 @@ int CBSDFT_getSlice( hCBSDFT h, int isample, int ifreq, complex* const data ) {
     return 0;
 }
 
+void CBSDFT_setResultSets( hCBSDFT h, int nsets ) {
+    if (h && nsets>0) {
+        int nf = h->nwin/2+1;
+        for (int iset=0; iset<h->nsets; iset++) {
+            free2complex(h->ressets[iset]);
+            free1int(h->modsets[iset]);
+        }
+        if (h->ressets) free1(h->ressets);
+        if (h->modsets) free1(h->modsets);
+        h->nsets = nsets;
+        h->ressets = ealloc1( nsets, sizeof(complex**) );
+        h->modsets = ealloc1( nsets, sizeof(int*) );
+        for (int iset=0; iset<nsets; iset++) {
+            h->ressets[iset] = ealloc2complex( h->ntile, nf );
+            h->modsets[iset] = ealloc1int( h->ntile );
+            memset( (void*)h->modsets[iset], 0, h->ntile*ISIZE );
+        }
+        CBSDFT_useResultSet( h, 0 );
+    } else
+        err("bad arguments in CBSDFT_setResultSets");
+}
+
+void CBSDFT_useResultSet( hCBSDFT h, int iset ) {
+    if (h && iset>=0 && iset<h->nsets) {
+        h->resbuf = h->ressets[iset];
+        h->modified = h->modsets[iset];
+    } else
+        err("bad arguments in CBSDFT_useResultSet");
+}
+
 void CBSDFT_setResult( hCBSDFT h, int isample, int ifreq, complex data ) {
-    if (h)
-        h->resbuf[ifreq][isample] = data;
-    else
+    if (h) {
+        int it = isample - h->tfirst;
+        h->resbuf[ifreq][it] = (h->storage==Int16)? csub( data, unpack( h, h->outtr, ifreq, it ) ) : data;
+        h->modified[it] = 1;
+    } else
         err("bad pointer in CBSDFT_setResult");
 }
 
+void CBSDFT_passResult( hCBSDFT h, int isample, int ifreq ) {
+    if (h) {
+        int it = isample - h->tfirst;
+        h->resbuf[ifreq][it] = (h->storage==Int16)? cmplx( 0.0, 0.0 ) : h->specdata[h->outtr][ifreq][it];
+    } else
+        err("bad pointer in CBSDFT_passResult");
+}
+
 void CBSDFT_getResult( hCBSDFT h, segy* const tr ) {
     if (h && tr) {
-        ISDFT( h->sdftH, h->resbuf, tr->data );
+        float* indata = h->trcdata[h->outtr] + h->tfirst;
+        float* outdata = tr->data + h->tfirst;
+        for (int it=0; it<h->tsamples; it++) {
+            if (!h->modified[it])
+                outdata[it] = h->gain*indata[it];
+            else if (h->storage==Int16)
+                outdata[it] = h->gain*indata[it] + ISDFT_sample( h->sdftH, h->resbuf, it );
+            else
+                outdata[it] = ISDFT_sample( h->sdftH, h->resbuf, it );
+            h->modified[it] = 0;
+        }
         memcpy( (void*)tr, (void*)&(h->hdrs[h->outtr]), HDRBYTES );
     } else
         err("bad pointer in CBSDFT_getResult");
     
 }
+
+void CBSDFT_getNoise( hCBSDFT h, segy* const tr ) {
+    if (h && tr) {
+        float* indata = h->trcdata[h->outtr] + h->tfirst;
+        float* outdata = tr->data + h->tfirst;
+        for (int it=0; it<h->tsamples; it++) {
+            if (!h->modified[it])
+                outdata[it] = 0.0;
+            else if (h->storage==Int16)
+                outdata[it] = -ISDFT_sample( h->sdftH, h->resbuf, it );
+            else
+                outdata[it] = h->gain*indata[it] - ISDFT_sample( h->sdftH, h->resbuf, it );
+            h->modified[it] = 0;
+        }
+        memcpy( (void*)tr, (void*)&(h->hdrs[h->outtr]), HDRBYTES );
+    } else
+        err("bad pointer in CBSDFT_getNoise");
+}
+
+/* Copy n samples of spectra from workbuf into the buffer */
+static void store( hCBSDFT h, int itrc, int n ) {
+    int nf = h->nwin/2+1;
+    int nt = n;
+    for (int ifr=0; ifr<nf; ifr++) {
+        complex* spec = h->workbuf[ifr];
+        if (h->storage!=Int16) {
+            memcpy( (void*)h->specdata[itrc][ifr], (void*)spec, nt*CSIZE );
+            continue;
+        }
+        short* pdata = h->packdata[itrc][ifr];
+        float* pscale = h->packscale[itrc][ifr];
+        for (int is=0, iblk=0; is<nt; is+=CBSDFT_BLOCK, iblk++) {
+            int ie = MIN(is+CBSDFT_BLOCK, nt);
+            float vmax = 0.0;
+            for (int i=is; i<ie; i++) {
+                vmax = MAX(vmax, ABS(spec[i].r));
+                vmax = MAX(vmax, ABS(spec[i].i));
+            }
+            float scale = vmax/32767.0;
+            float inv_scale = (vmax>0.0)? 1.0/scale : 0.0;
+            for (int i=is; i<ie; i++) {
+                pdata[2*i] = (short) NINT(spec[i].r*inv_scale);
+                pdata[2*i+1] = (short) NINT(spec[i].i*inv_scale);
+            }
+            pscale[iblk] = scale;
+        }
+    }
+}
+
+static complex unpack( hCBSDFT h, int itrc, int ifreq, int isample ) {
+    short* pdata = h->packdata[itrc][ifreq];
+    float scale = h->packscale[itrc][ifreq][isample/CBSDFT_BLOCK];
+    return cmplx( scale*pdata[2*isample], scale*pdata[2*isample+1] );
+}
@@ -11,6 +11,7 @@ CTB_push             add a seg y trace to the buffer
 CTB_copyCurrentHdr    get the header of the current centre trace 
 CTB_getslice         get data at a particular sample for all traces
 CTB_getData          return a pointer to the buffer data
+CTB_getTrace         return a pointer to the data of a trace in the buffer
 CTB_free             release a trace buffer handle
 
 ************************************************************************** 
@@ -22,6 +23,7 @@ int CTB_push(hCTB h, const seg* const tr);
 void CTB_copyCurrentHdr(hCTB h, segy* const tr);
 int CTB_getSlice(hCTB h, int isample, float* const data);
 const float** const CTB_getData(hOTB h);
+const float* CTB_getTrace(hCTB h, int itrace);
 
 ************************************************************************** 
 CTB_init:
@@ -49,8 +51,10 @@ Input:
 h           trace buffer handle created by CTB_init
 tr          pointer to a seg Y trace to add to the buffer
 
-Returned:   1 if sufficient number of traces in buffer for processing (ie >ntraces/2),
-            0 otherwise
+Returned:   1 if there is a new centre trace to process, 0 otherwise
+
+Push a null trace at the end of the input, and keep pushing null traces
+until 0 is returned to process the traces left in the buffer.
 
 ************************************************************************** 
 CTB_copyCurrentHdr:
@@ -79,6 +83,15 @@ h           trace buffer handle created by CTB_init
 
 Returned:   pointer to 2D array holding the trace buffer data
 
+************************************************************************** 
+CTB_getTrace:
+Input:
+h           trace buffer handle created by CTB_init
+itrace      position of the trace in the order used by CTB_getSlice
+
+Returned:   pointer to the data of the trace, the current centre trace is at
+            the position returned by CTB_getSlice
+
 ************************************************************************** 
 Notes:
 Encapsulates the logic of a rolling window of traces over a panel of data.
@@ -89,6 +102,9 @@ the advantage that adding a new trace to the buffer does not cause any copying.
 The disadvantage is that the traces are not stored in the buffer in the order
 they were added which can make some operations more difficult.
 
+Near the ends of the input the window is cut short, so every trace pushed is
+the centre trace once however few traces there are.
+
 ************************************************************************** 
 Author: Wayne Mogg
 **************************************************************************/
@@ -107,9 +123,11 @@ typedef struct {
 
 struct _CTB {
     int ntr;
-    int intr;
-    int outtr;
+    int nin;        /* traces pushed                            */
+    int icur;       /* current centre trace, -1 before the first */
+    int first;      /* oldest trace in the current window       */
     int trcount;
+    int done;       /* set by the first push of a null trace    */
     int ns;
     _HDR* hdrs;
     float** data;
@@ -119,9 +137,11 @@ hCTB CTB_init( int ntraces, int nsamples ) {
     
     hCTB h = emalloc(sizeof(struct _CTB));
     h->ntr = ntraces;
+    h->nin = 0;
+    h->icur = -1;
+    h->first = 0;
     h->trcount = 0;
-    h->intr= -1;
-    h->outtr = 0;
+    h->done = 0;
     h->ns = nsamples;
     h->data = ealloc2float( nsamples, ntraces );
     h->hdrs = ealloc1(ntraces, sizeof(_HDR));
@@ -142,45 +162,48 @@ int CTB_traces( hCTB h ) {
      return h ? h->trcount : 0;
 }
 
+/* Trace i is kept in slot i%ntr. The next trace becomes the centre once the
+   ntr/2 traces after it are in or the input has ended, its window is then the
+   traces within ntr/2 of it */
 int CTB_push( hCTB h, const segy* const tr ) {
     if (h) {
         int ntr = h->ntr;
-        int ns = h->ns;
-        float** data = h->data;
         if (tr) {
-            h->intr = (h->intr + 1)%ntr;
-            memcpy( (void*)&(data[h->intr][0]), (void*) tr->data, ns*FSIZE );
-            memcpy( (void*)&(h->hdrs[h->intr]), (void*) tr, HDRBYTES );
-            h->outtr = (h->trcount <= ntr/2)? h->outtr : (h->outtr + 1)%ntr;
-            h->trcount = (h->trcount < ntr)? h->trcount+1 : ntr;
-        } else {
-            h->trcount = (h->trcount>0)? h->trcount-1 : 0;
-            h->outtr = (h->outtr + 1)%ntr;
+            if (h->done)
+                err("trace pushed after the end of the input in CTB_push.");
+            int islot = h->nin%ntr;
+            memcpy( (void*)&(h->data[islot][0]), (void*) tr->data, h->ns*FSIZE );
+            memcpy( (void*)&(h->hdrs[islot]), (void*) tr, HDRBYTES );
+            h->nin++;
+        } else
+            h->done = 1;
+        int inext = h->icur + 1;
+        if (inext < h->nin && (h->done || h->nin > inext + ntr/2)) {
+            h->icur = inext;
+            h->first = MAX(h->icur - ntr/2, 0);
+            h->trcount = MIN(h->icur + ntr/2, h->nin-1) - h->first + 1;
+            return 1;
         }
+        if (h->done)
+            h->trcount = 0;
     } else
         err("bad pointer in CTB_push.");
-    return h ? h->trcount > h->ntr/2 : 0;
+    return 0;
 }
 
 void CTB_copyCurrentHdr( hCTB h, segy* const tr ) {
-    if ( h && tr ) {
-        memcpy( (void*)tr, (void*)&(h->hdrs[h->outtr]), HDRBYTES );
+    if ( h && tr && h->icur>=0 ) {
+        memcpy( (void*)tr, (void*)&(h->hdrs[h->icur%h->ntr]), HDRBYTES );
     } else
         err("bad pointer in CTB_copyCurrentHdr");
 }
 
 int CTB_getSlice( hCTB h, int isample, float* const data ) {
     if (h && data) {
-        if (h->trcount >= h->ntr/2) {
-            int spos = h->intr - h->trcount + 1;
-            spos = (spos<0)? spos+h->ntr : spos;
-//            if (isample==0) {
-//                warn("CTB_getSlice - intr: %d outtr: %d trcount: %d spos: %d icur: %d", h->intr, h->outtr, h->trcount, spos, (h->trcount<h->ntr)? h->outtr : h->ntr/2);
-//            }
+        if (h->trcount > 0) {
             for (int itrc=0; itrc<h->trcount; itrc++ )
-                data[itrc] = h->data[(spos+itrc)%h->ntr][isample];
-            spos = (spos > h->outtr)? spos-h->ntr : spos;
-            return (h->trcount < h->ntr)? h->outtr - spos : h->ntr/2;
+                data[itrc] = h->data[(h->first+itrc)%h->ntr][isample];
+            return h->icur - h->first;
         } else {
             warn("trace buffer too empty in CTB_getSlice.");
 
@@ -198,3 +221,10 @@ const float** const CTB_getData( hCTB h ) {
     return 0;
 }
 
+const float* CTB_getTrace( hCTB h, int itrace ) {
+    if (h && itrace>=0 && itrace<h->trcount) {
+        return (const float*) h->data[(h->first+itrace)%h->ntr];
+    } else
+        err("bad arguments in CTB_getTrace.");
+    return 0;
+}
@@ -0,0 +1,164 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+FPZ - lossless compression of float trace samples
+
+FPZ_bound       return the largest number of bytes n samples compress to
+FPZ_encode      compress an array of floats
+FPZ_decode      decompress an array of floats
+
+**************************************************************************
+Function Prototypes:
+size_t FPZ_bound(int n);
+size_t FPZ_encode(int n, const float* in, unsigned char* out);
+size_t FPZ_decode(int n, const unsigned char* in, float* out);
+
+**************************************************************************
+FPZ_encode:
+Input:
+n           number of samples
+in          array[n] of samples
+
+Output:
+out         compressed samples, at least FPZ_bound(n) bytes
+
+Returned:   number of bytes in the compressed samples
+
+**************************************************************************
+FPZ_decode:
+Input:
+n           number of samples
+in          compressed samples from FPZ_encode
+
+Output:
+out         array[n] of samples, bit for bit the same as given to FPZ_encode
+
+Returned:   number of bytes of compressed samples read
+
+**************************************************************************
+Notes:
+The bits of each float are mapped to an unsigned integer in the same order
+as the float values, so samples close in value are close as integers. Each
+sample is predicted by the one before it and the prediction error is zig-zag
+coded so small errors of either sign have few significant bits. The errors
+are packed in blocks of 32 samples, a byte giving the number of bits needed
+by the largest error in the block followed by the 32 errors packed at that
+width. Blocks of zeros take a single byte and NaN and infinite values are
+kept exactly. The packed words are in native byte order, as for SU data.
+
+Smooth data such as spectral amplitudes and traces with muted or padded
+zones compress best. Noisy full band data typically compresses by 10 to
+20 percent, as most of the mantissa bits are noise.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include <stdint.h>
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+#define FPZ_BLOCK 32
+
+static int packBlock( const uint32_t* restrict z, unsigned char* restrict out );
+static int unpackBlock( const unsigned char* restrict in, uint32_t* restrict z );
+
+size_t FPZ_bound( int n ) {
+    return (size_t) ((n+FPZ_BLOCK-1)/FPZ_BLOCK)*(1 + 4*FPZ_BLOCK);
+}
+
+size_t FPZ_encode( int n, const float* in, unsigned char* out ) {
+    uint32_t z[FPZ_BLOCK];
+    uint32_t prev = 0;
+    size_t nbytes = 0;
+    for (int i0=0; i0<n; i0+=FPZ_BLOCK) {
+        int nb = MIN(FPZ_BLOCK, n-i0);
+        for (int i=0; i<nb; i++) {
+            uint32_t u;
+            memcpy( &u, &in[i0+i], sizeof(u) );
+            uint32_t m = u ^ ((uint32_t) ((int32_t) u>>31) | 0x80000000u);
+            int32_t d = (int32_t) (m - prev);
+            z[i] = ((uint32_t) d<<1) ^ (uint32_t) (d>>31);
+            prev = m;
+        }
+        for (int i=nb; i<FPZ_BLOCK; i++)
+            z[i] = 0;
+        nbytes += packBlock( z, out+nbytes );
+    }
+    return nbytes;
+}
+
+size_t FPZ_decode( int n, const unsigned char* in, float* out ) {
+    uint32_t z[FPZ_BLOCK];
+    uint32_t prev = 0;
+    size_t nbytes = 0;
+    for (int i0=0; i0<n; i0+=FPZ_BLOCK) {
+        int nb = MIN(FPZ_BLOCK, n-i0);
+        nbytes += unpackBlock( in+nbytes, z );
+        for (int i=0; i<nb; i++) {
+            uint32_t m = prev + ((z[i]>>1) ^ (0u - (z[i]&1)));
+            uint32_t u = m ^ ((uint32_t) ((int32_t) ~m>>31) | 0x80000000u);
+            memcpy( &out[i0+i], &u, sizeof(u) );
+            prev = m;
+        }
+    }
+    return nbytes;
+}
+
+/* Pack 32 values at the width of the largest, returns the bytes written */
+static int packBlock( const uint32_t* restrict z, unsigned char* restrict out ) {
+    uint32_t all = 0;
+    for (int i=0; i<FPZ_BLOCK; i++)
+        all |= z[i];
+    int width = (all)? 32 - __builtin_clz(all) : 0;
+    out[0] = (unsigned char) width;
+    if (width == 0)
+        return 1;
+    unsigned char* words = out+1;
+    uint64_t acc = 0;
+    int nbits = 0;
+    int iw = 0;
+    for (int i=0; i<FPZ_BLOCK; i++) {
+        acc |= (uint64_t) z[i]<<nbits;
+        nbits += width;
+        if (nbits >= 32) {
+            uint32_t w = (uint32_t) acc;
+            memcpy( words + 4*iw++, &w, sizeof(w) );
+            acc >>= 32;
+            nbits -= 32;
+        }
+    }
+    return 1 + 4*width;
+}
+
+static int unpackBlock( const unsigned char* restrict in, uint32_t* restrict z ) {
+    int width = in[0];
+    if (width == 0) {
+        for (int i=0; i<FPZ_BLOCK; i++)
+            z[i] = 0;
+        return 1;
+    }
+    if (width > 32)
+        err("corrupt compressed data in FPZ_decode");
+    const unsigned char* words = in+1;
+    uint64_t mask = ((uint64_t) 1<<width) - 1;
+    uint64_t acc = 0;
+    int nbits = 0;
+    int iw = 0;
+    for (int i=0; i<FPZ_BLOCK; i++) {
+        if (nbits < width) {
+            uint32_t w;
+            memcpy( &w, words + 4*iw++, sizeof(w) );
+            acc |= (uint64_t) w<<nbits;
+            nbits += 32;
+        }
+        z[i] = (uint32_t) (acc & mask);
+        acc >>= width;
+        nbits -= width;
+    }
+    return 1 + 4*width;
+}
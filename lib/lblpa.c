@@ -0,0 +1,319 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+LBLPA - rolling buffer of lines for 3D LPA smoothing
+
+LBLPA_init      initialise a LPA line buffer handle
+LBLPA_lines     return number of lines in the buffer
+LBLPA_samples   return number of time samples per trace
+LBLPA_push      add a seg y trace to the line being filled
+LBLPA_endLine   add the line being filled to the buffer
+LBLPA_traces    return number of traces in the current output line
+LBLPA_getResult get a smoothed trace from the current output line
+LBLPA_getNoise  get the difference between a trace and its smoothed version
+LBLPA_free      release a LPA line buffer handle
+
+**************************************************************************
+Function Prototypes:
+hLBLPA LBLPA_init(hLPA lpa, int dkey, int nsamples);
+void LBLPA_free(hLBLPA h);
+int LBLPA_lines(hLBLPA h);
+int LBLPA_samples(hLBLPA h);
+void LBLPA_push(hLBLPA h, const segy* const tr, int key);
+int LBLPA_endLine(hLBLPA h);
+int LBLPA_traces(hLBLPA h);
+void LBLPA_getResult(hLBLPA h, int itrace, segy* const tr);
+void LBLPA_getNoise(hLBLPA h, int itrace, segy* const tr);
+
+**************************************************************************
+LBLPA_init:
+Input:
+lpa         LPA kernel handle created by LPA_init3D, the buffer holds as
+            many lines as the kernel spans
+dkey        increment of the trace key between adjacent traces in a line
+nsamples    number of samples in each trace
+
+Returned: line buffer handle
+
+**************************************************************************
+LBLPA_push:
+Input:
+h           line buffer handle created by LBLPA_init
+tr          seg Y trace to add to the line being filled
+key         position of the trace along the line (eg. crossline number)
+
+**************************************************************************
+LBLPA_endLine:
+Input:
+h           line buffer handle created by LBLPA_init
+
+Returned:   1 if the next output line is ready for processing,
+            0 otherwise
+
+**************************************************************************
+LBLPA_getResult:
+Input:
+h           line buffer handle created by LBLPA_init
+itrace      index of the trace in the current output line
+
+Output:
+tr          smoothed trace with the header of the input trace
+
+**************************************************************************
+Notes:
+Line handling follows LBSDFT. Traces are pushed into the line being filled,
+LBLPA_endLine moves it into the rolling buffer, and calling LBLPA_endLine
+with no traces pushed flushes the buffer at the end of the data. Traces in
+each line should be in increasing key order.
+
+The separable terms of the kernel are applied in three passes. Each trace
+is filtered along time when it is pushed, each line is filtered across its
+traces when it is added to the buffer, and the pass across lines is done
+for each output trace. Traces and lines beyond the edges of the data, or
+missing from a line, are replaced by the nearest available trace, which for
+a single regular line matches the edge handling of sulpasmooth in 2D.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+typedef struct {
+    unsigned char hdr[HDRBYTES];
+} _HDR;
+
+typedef struct {
+    int key;
+    _HDR hdr;
+    float* data;
+    float** tpass;
+    float** xpass;
+} _LBTRC;
+
+typedef struct {
+    int ntr;
+    int maxtr;
+    _LBTRC* trcs;
+} _LBLINE;
+
+struct _LBLPA {
+    hLPA lpa;
+    int ns;
+    int nil;
+    int nterm;
+    int dkey;
+    int npushed;
+    int outl;
+    int flush;
+    _LBLINE fill;
+    _LBLINE* lines;
+};
+
+static _LBTRC* addTrace( hLBLPA h, _LBLINE* line );
+static void freeLine( _LBLINE* line );
+static int nearest( const _LBLINE* line, int key );
+static void tracePass( hLBLPA h, _LBLINE* line );
+static void linePass( hLBLPA h, int itrace, float* const out );
+
+hLBLPA LBLPA_init( hLPA lpa, int dkey, int nsamples ) {
+
+    hLBLPA h = emalloc(sizeof(struct _LBLPA));
+    h->lpa = lpa;
+    h->ns = nsamples;
+    h->nil = LPA_lines(lpa);
+    h->nterm = LPA_rank(lpa);
+    h->dkey = (dkey!=0)? ABS(dkey) : 1;
+    h->fill.ntr = 0;
+    h->fill.maxtr = 0;
+    h->fill.trcs = 0;
+    h->lines = ealloc1( h->nil, sizeof(_LBLINE) );
+    for (int il=0; il<h->nil; il++) {
+        h->lines[il].ntr = 0;
+        h->lines[il].maxtr = 0;
+        h->lines[il].trcs = 0;
+    }
+    h->npushed = 0;
+    h->outl = -1;
+    h->flush = 0;
+    return h;
+}
+
+void LBLPA_free( hLBLPA h ) {
+    if (h) {
+        freeLine( &h->fill );
+        for (int il=0; il<h->nil; il++)
+            freeLine( &h->lines[il] );
+        free1( h->lines );
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in LBLPA_free.");
+}
+
+int LBLPA_lines( hLBLPA h ) {
+    return h ? MIN(h->npushed, h->nil) : 0;
+}
+
+int LBLPA_samples( hLBLPA h ) {
+    return h ? h->ns : 0;
+}
+
+void LBLPA_push( hLBLPA h, const segy* const tr, int key ) {
+    if (h && tr) {
+        _LBTRC* trc = addTrace( h, &h->fill );
+        trc->key = key;
+        for (int k=0; k<h->nterm; k++)
+            LPA_filterTime( h->lpa, k, h->ns, tr->data, trc->tpass[k] );
+        memcpy( (void*)trc->data, (void*) tr->data, h->ns*FSIZE );
+        memcpy( (void*)&(trc->hdr), (void*) tr, HDRBYTES );
+    } else
+        err("bad pointer in LBLPA_push.");
+}
+
+int LBLPA_endLine( hLBLPA h ) {
+    int ready = 0;
+    if (h) {
+        if (h->fill.ntr) {
+            tracePass( h, &h->fill );
+            int inl = h->npushed%h->nil;
+            _LBLINE tmp = h->lines[inl];
+            h->lines[inl] = h->fill;
+            h->fill = tmp;
+            h->fill.ntr = 0;
+            h->npushed++;
+        } else
+            h->flush = 1;
+        int next = h->outl + 1;
+        ready = (h->npushed-1-next >= h->nil/2) || (h->flush && next < h->npushed);
+        if (ready)
+            h->outl = next;
+    } else
+        err("bad pointer in LBLPA_endLine.");
+    return ready;
+}
+
+int LBLPA_traces( hLBLPA h ) {
+    return (h && h->outl>=0 && h->outl<h->npushed)? h->lines[h->outl%h->nil].ntr : 0;
+}
+
+void LBLPA_getResult( hLBLPA h, int itrace, segy* const tr ) {
+    if (h && tr && itrace>=0 && itrace<LBLPA_traces(h)) {
+        _LBTRC* cur = &(h->lines[h->outl%h->nil].trcs[itrace]);
+        linePass( h, itrace, tr->data );
+        memcpy( (void*)tr, (void*)&(cur->hdr), HDRBYTES );
+    } else
+        err("bad arguments in LBLPA_getResult");
+}
+
+void LBLPA_getNoise( hLBLPA h, int itrace, segy* const tr ) {
+    if (h && tr && itrace>=0 && itrace<LBLPA_traces(h)) {
+        _LBTRC* cur = &(h->lines[h->outl%h->nil].trcs[itrace]);
+        linePass( h, itrace, tr->data );
+        for (int is=0; is<h->ns; is++)
+            tr->data[is] = cur->data[is] - tr->data[is];
+        memcpy( (void*)tr, (void*)&(cur->hdr), HDRBYTES );
+    } else
+        err("bad arguments in LBLPA_getNoise");
+}
+
+/* Apply the trace axis filter of each separable term across a complete line */
+static void tracePass( hLBLPA h, _LBLINE* line ) {
+    int nx = LPA_traces(h->lpa);
+    int hx = nx/2;
+    for (int itrc=0; itrc<line->ntr; itrc++) {
+        _LBTRC* trc = &(line->trcs[itrc]);
+        for (int k=0; k<h->nterm; k++) {
+            const float* xfilt = LPA_traceFilter( h->lpa, k );
+            float* restrict out = trc->xpass[k];
+            for (int is=0; is<h->ns; is++)
+                out[is] = 0.0;
+            for (int ix=0; ix<nx; ix++) {
+                float w = xfilt[ix];
+                if (w==0.0)
+                    continue;
+                int jtrc = nearest( line, trc->key + (ix-hx)*h->dkey );
+                const float* restrict data = line->trcs[jtrc].tpass[k];
+                for (int is=0; is<h->ns; is++)
+                    out[is] += w*data[is];
+            }
+        }
+    }
+}
+
+/* Apply the line axis filter of each separable term for a trace in the
+   current output line and sum the terms */
+static void linePass( hLBLPA h, int itrace, float* const out ) {
+    int hy = h->nil/2;
+    int first = MAX(h->outl - hy, 0);
+    int last = MIN(h->outl + hy, h->npushed-1);
+    int key = h->lines[h->outl%h->nil].trcs[itrace].key;
+    float* restrict res = out;
+    for (int is=0; is<h->ns; is++)
+        res[is] = 0.0;
+    for (int k=0; k<h->nterm; k++) {
+        const float* yfilt = LPA_lineFilter( h->lpa, k );
+        for (int iy=0; iy<h->nil; iy++) {
+            float w = yfilt[iy];
+            if (w==0.0)
+                continue;
+            int il = h->outl + iy - hy;
+            il = (il<first)? first : (il>last)? last : il;
+            const _LBLINE* line = &(h->lines[il%h->nil]);
+            const float* restrict data = line->trcs[nearest( line, key )].xpass[k];
+            for (int is=0; is<h->ns; is++)
+                res[is] += w*data[is];
+        }
+    }
+}
+
+/* Index of the trace in a line with key closest to the given key, traces
+   are expected to be in increasing key order */
+static int nearest( const _LBLINE* line, int key ) {
+    int lo = 0;
+    int hi = line->ntr-1;
+    if (key <= line->trcs[lo].key)
+        return lo;
+    if (key >= line->trcs[hi].key)
+        return hi;
+    while (hi-lo > 1) {
+        int mid = (lo+hi)/2;
+        if (line->trcs[mid].key <= key)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (key - line->trcs[lo].key <= line->trcs[hi].key - key)? lo : hi;
+}
+
+/* Return the next free trace record in a line, allocating storage as needed */
+static _LBTRC* addTrace( hLBLPA h, _LBLINE* line ) {
+    if (line->ntr == line->maxtr) {
+        int maxtr = (line->maxtr)? 2*line->maxtr : LPA_traces(h->lpa);
+        line->trcs = erealloc1( line->trcs, maxtr, sizeof(_LBTRC) );
+        for (int itrc=line->maxtr; itrc<maxtr; itrc++) {
+            line->trcs[itrc].data = ealloc1float( h->ns );
+            line->trcs[itrc].tpass = ealloc2float( h->ns, h->nterm );
+            line->trcs[itrc].xpass = ealloc2float( h->ns, h->nterm );
+        }
+        line->maxtr = maxtr;
+    }
+    return &(line->trcs[line->ntr++]);
+}
+
+static void freeLine( _LBLINE* line ) {
+    for (int itrc=0; itrc<line->maxtr; itrc++) {
+        free1float( line->trcs[itrc].data );
+        free2float( line->trcs[itrc].tpass );
+        free2float( line->trcs[itrc].xpass );
+    }
+    if (line->trcs) free1( line->trcs );
+    line->ntr = 0;
+    line->maxtr = 0;
+    line->trcs = 0;
+}
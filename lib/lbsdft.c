@@ -0,0 +1,356 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+LBSDFT - rolling buffer of lines for sliding discrete fourier transform of 3D data
+
+LBSDFT_init     initialise a SDFT line buffer handle
+LBSDFT_lines    return number of lines in the buffer
+LBSDFT_samples  return number of time samples per trace
+LBSDFT_nfreq    return number of frequencies in SDFT
+LBSDFT_maxPanel return the maximum number of traces in a neighbourhood
+LBSDFT_push     add a seg y trace to the line being filled
+LBSDFT_endLine  add the line being filled to the buffer
+LBSDFT_traces   return number of traces in the current output line
+LBSDFT_setTrace select the output trace and find its neighbourhood
+LBSDFT_getSlice get the spectral data for the neighbourhood at the specified time, frequency index
+LBSDFT_setResult set the output spectral value at the specified time, frequency index
+LBSDFT_passResult pass the output trace spectral value unchanged to the output
+LBSDFT_getResult get the output trace by inverse SDFT of the result spectra
+LBSDFT_getNoise get the difference between the output trace and the result
+LBSDFT_free     release a SDFT line buffer handle
+
+**************************************************************************
+Function Prototypes:
+hLBSDFT LBSDFT_init(int nlines, int ntraces, int dkey, int nsamples, int nwin, sux_Window window);
+void LBSDFT_free(hLBSDFT h);
+int LBSDFT_lines(hLBSDFT h);
+int LBSDFT_samples(hLBSDFT h);
+int LBSDFT_nfreq(hLBSDFT h);
+int LBSDFT_maxPanel(hLBSDFT h);
+void LBSDFT_push(hLBSDFT h, const segy* const tr, int key);
+int LBSDFT_endLine(hLBSDFT h);
+int LBSDFT_traces(hLBSDFT h);
+int LBSDFT_setTrace(hLBSDFT h, int itrace);
+int LBSDFT_getSlice(hLBSDFT h, int isample, int ifreq, complex* const data);
+void LBSDFT_setResult(hLBSDFT h, int isample, int ifreq, complex val);
+void LBSDFT_passResult(hLBSDFT h, int isample, int ifreq);
+void LBSDFT_getResult(hLBSDFT h, segy* const tr);
+void LBSDFT_getNoise(hLBSDFT h, segy* const tr);
+
+**************************************************************************
+LBSDFT_init:
+Input:
+nlines      number of lines in buffer - should be odd
+ntraces     number of traces along each line in a neighbourhood - should be odd
+dkey        increment of the trace key between adjacent traces in a line
+nsamples    number of samples in each trace
+nwin        number of samples in SDFT window
+window      window applied in SDFT
+
+Returned: line buffer handle
+
+**************************************************************************
+LBSDFT_push:
+Input:
+h           line buffer handle created by LBSDFT_init
+tr          seg Y trace to add to the line being filled
+key         position of the trace along the line (eg. crossline number)
+
+**************************************************************************
+LBSDFT_endLine:
+Input:
+h           line buffer handle created by LBSDFT_init
+
+Returned:   1 if the next output line is ready for processing,
+            0 otherwise
+
+**************************************************************************
+LBSDFT_setTrace:
+Input:
+h           line buffer handle created by LBSDFT_init
+itrace      index of the output trace in the current output line
+
+Returned:   number of traces in the neighbourhood of the output trace
+
+**************************************************************************
+Notes:
+This is the 3D counterpart of CBSDFT for data sorted by line. Traces are
+pushed one at a time into the line being filled and LBSDFT_endLine moves that
+line into a rolling buffer of nlines lines, dropping the oldest. Calling
+LBSDFT_endLine with no traces pushed since the last call flushes the buffer
+at the end of the data, much as CBSDFT_push does with a null trace. When it
+returns 1 the next output line is ready, and flushing continues to return 1
+until every line has been output, however few lines there are.
+
+The neighbourhood of each output trace is made up of the traces in the lines
+within nlines/2 of the output line whose key is within ntraces/2*dkey of the
+output trace key, so lines do not need to have the same number of traces or
+start at the same key. Only the lines in the window are held in memory. A
+neighbourhood holds at most nlines*ntraces traces, always including the
+output trace, so with duplicate keys or keys closer than dkey some of the
+traces in range are left out.
+
+As in CBSDFT, time samples where every frequency was passed through with
+LBSDFT_passResult are copied from the input trace, scaled by the window gain,
+instead of being inverse transformed.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+typedef struct {
+    unsigned char hdr[HDRBYTES];
+} _HDR;
+
+typedef struct {
+    int key;
+    _HDR hdr;
+    float* data;
+    complex** spec;
+} _LBTRC;
+
+typedef struct {
+    int ntr;
+    int maxtr;
+    _LBTRC* trcs;
+} _LBLINE;
+
+struct _LBSDFT {
+    int ns;
+    int nwin;
+    int nil;
+    int nxl;
+    int dkey;
+    sux_Window window;
+    float gain;
+    int npushed;
+    int outl;
+    int flush;
+    hSDFT sdftH;
+    _LBLINE fill;
+    _LBLINE* lines;
+    _LBTRC* cur;
+    int npanel;
+    int icur;
+    complex*** panel;
+    complex** resbuf;
+    int* modified;
+};
+
+static _LBTRC* addTrace( hLBSDFT h, _LBLINE* line );
+static void freeLine( _LBLINE* line );
+
+hLBSDFT LBSDFT_init( int nlines, int ntraces, int dkey, int nsamples, int nwin, sux_Window window ) {
+
+    hLBSDFT h = emalloc(sizeof(struct _LBSDFT));
+    h->nil = nlines;
+    h->nxl = ntraces;
+    h->dkey = (dkey!=0)? ABS(dkey) : 1;
+    h->ns = nsamples;
+    h->nwin = nwin;
+    h->window = window;
+    int nf = nwin/2 + 1;
+    h->sdftH = SDFT_init( nwin, nsamples );
+    h->gain = SDFT_windowGain( h->sdftH, window );
+    h->fill.ntr = 0;
+    h->fill.maxtr = 0;
+    h->fill.trcs = 0;
+    h->lines = ealloc1( nlines, sizeof(_LBLINE) );
+    for (int il=0; il<nlines; il++) {
+        h->lines[il].ntr = 0;
+        h->lines[il].maxtr = 0;
+        h->lines[il].trcs = 0;
+    }
+    h->cur = 0;
+    h->npanel = 0;
+    h->icur = 0;
+    h->panel = ealloc1( nlines*ntraces, sizeof(complex**) );
+    h->resbuf = ealloc2complex( nsamples, nf );
+    h->modified = ealloc1int( nsamples );
+    memset( (void*)h->modified, 0, nsamples*ISIZE );
+    h->npushed = 0;
+    h->outl = -1;
+    h->flush = 0;
+    return h;
+}
+
+void LBSDFT_free( hLBSDFT h ) {
+    if (h) {
+        freeLine( &h->fill );
+        for (int il=0; il<h->nil; il++)
+            freeLine( &h->lines[il] );
+        free1( h->lines );
+        free1( h->panel );
+        free2complex( h->resbuf );
+        free1int( h->modified );
+        SDFT_free( h->sdftH );
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in LBSDFT_free.");
+}
+
+int LBSDFT_lines( hLBSDFT h ) {
+    return h ? MIN(h->npushed, h->nil) : 0;
+}
+
+int LBSDFT_samples( hLBSDFT h ) {
+    return h ? h->ns : 0;
+}
+
+int LBSDFT_nfreq( hLBSDFT h ) {
+    return h ? h->nwin/2+1 : 0;
+}
+
+int LBSDFT_maxPanel( hLBSDFT h ) {
+    return h ? h->nil*h->nxl : 0;
+}
+
+void LBSDFT_push( hLBSDFT h, const segy* const tr, int key ) {
+    if (h && tr) {
+        _LBTRC* trc = addTrace( h, &h->fill );
+        trc->key = key;
+        SDFT( h->sdftH, h->window, (float*) tr->data, trc->spec );
+        memcpy( (void*)trc->data, (void*) tr->data, h->ns*FSIZE );
+        memcpy( (void*)&(trc->hdr), (void*) tr, HDRBYTES );
+    } else
+        err("bad pointer in LBSDFT_push.");
+}
+
+int LBSDFT_endLine( hLBSDFT h ) {
+    int ready = 0;
+    if (h) {
+        if (h->fill.ntr) {
+            int inl = h->npushed%h->nil;
+            _LBLINE tmp = h->lines[inl];
+            h->lines[inl] = h->fill;
+            h->fill = tmp;
+            h->fill.ntr = 0;
+            h->npushed++;
+        } else
+            h->flush = 1;
+        int next = h->outl + 1;
+        ready = (h->npushed-1-next >= h->nil/2) || (h->flush && next < h->npushed);
+        if (ready)
+            h->outl = next;
+    } else
+        err("bad pointer in LBSDFT_endLine.");
+    return ready;
+}
+
+int LBSDFT_traces( hLBSDFT h ) {
+    return (h && h->outl>=0 && h->outl<h->npushed)? h->lines[h->outl%h->nil].ntr : 0;
+}
+
+int LBSDFT_setTrace( hLBSDFT h, int itrace ) {
+    if (h && itrace>=0 && itrace<LBSDFT_traces(h)) {
+        int maxpanel = h->nil*h->nxl;
+        int range = (h->nxl/2)*h->dkey;
+        int first = MAX(h->outl - h->nil/2, 0);
+        int last = MIN(h->outl + h->nil/2, h->npushed-1);
+        h->cur = &(h->lines[h->outl%h->nil].trcs[itrace]);
+        h->npanel = 0;
+        h->icur = -1;
+/* A slot is kept for the output trace so lines with duplicate or closely
+   spaced keys can't fill the panel before it is reached */
+        for (int il=first; il<=last; il++) {
+            _LBLINE* line = &(h->lines[il%h->nil]);
+            for (int itrc=0; itrc<line->ntr; itrc++) {
+                _LBTRC* trc = &(line->trcs[itrc]);
+                if (ABS(trc->key - h->cur->key) > range)
+                    continue;
+                if (trc == h->cur)
+                    h->icur = h->npanel;
+                else if (h->npanel >= maxpanel - (h->icur<0))
+                    continue;
+                h->panel[h->npanel++] = trc->spec;
+            }
+        }
+        if (h->icur < 0)
+            err("output trace missing from its neighbourhood in LBSDFT_setTrace.");
+        return h->npanel;
+    } else
+        err("bad arguments in LBSDFT_setTrace.");
+    return 0;
+}
+
+int LBSDFT_getSlice( hLBSDFT h, int isample, int ifreq, complex* const data ) {
+    if (h && data) {
+        for (int itrc=0; itrc<h->npanel; itrc++)
+            data[itrc] = h->panel[itrc][ifreq][isample];
+        return h->icur;
+    } else
+        err("bad pointer in LBSDFT_getSlice.");
+    return 0;
+}
+
+void LBSDFT_setResult( hLBSDFT h, int isample, int ifreq, complex data ) {
+    if (h) {
+        h->resbuf[ifreq][isample] = data;
+        h->modified[isample] = 1;
+    } else
+        err("bad pointer in LBSDFT_setResult");
+}
+
+void LBSDFT_passResult( hLBSDFT h, int isample, int ifreq ) {
+    if (h && h->cur)
+        h->resbuf[ifreq][isample] = h->cur->spec[ifreq][isample];
+    else
+        err("bad pointer in LBSDFT_passResult");
+}
+
+void LBSDFT_getResult( hLBSDFT h, segy* const tr ) {
+    if (h && h->cur && tr) {
+        float* indata = h->cur->data;
+        for (int is=0; is<h->ns; is++) {
+            tr->data[is] = (h->modified[is])? ISDFT_sample( h->sdftH, h->resbuf, is ) : h->gain*indata[is];
+            h->modified[is] = 0;
+        }
+        memcpy( (void*)tr, (void*)&(h->cur->hdr), HDRBYTES );
+    } else
+        err("bad pointer in LBSDFT_getResult");
+}
+
+void LBSDFT_getNoise( hLBSDFT h, segy* const tr ) {
+    if (h && h->cur && tr) {
+        float* indata = h->cur->data;
+        for (int is=0; is<h->ns; is++) {
+            tr->data[is] = (h->modified[is])? h->gain*indata[is] - ISDFT_sample( h->sdftH, h->resbuf, is ) : 0.0;
+            h->modified[is] = 0;
+        }
+        memcpy( (void*)tr, (void*)&(h->cur->hdr), HDRBYTES );
+    } else
+        err("bad pointer in LBSDFT_getNoise");
+}
+
+/* Return the next free trace record in a line, allocating storage as needed */
+static _LBTRC* addTrace( hLBSDFT h, _LBLINE* line ) {
+    if (line->ntr == line->maxtr) {
+        int maxtr = (line->maxtr)? 2*line->maxtr : h->nxl;
+        line->trcs = erealloc1( line->trcs, maxtr, sizeof(_LBTRC) );
+        for (int itrc=line->maxtr; itrc<maxtr; itrc++) {
+            line->trcs[itrc].data = ealloc1float( h->ns );
+            line->trcs[itrc].spec = ealloc2complex( h->ns, h->nwin/2+1 );
+        }
+        line->maxtr = maxtr;
+    }
+    return &(line->trcs[line->ntr++]);
+}
+
+static void freeLine( _LBLINE* line ) {
+    for (int itrc=0; itrc<line->maxtr; itrc++) {
+        free1float( line->trcs[itrc].data );
+        free2complex( line->trcs[itrc].spec );
+    }
+    if (line->trcs) free1( line->trcs );
+    line->ntr = 0;
+    line->maxtr = 0;
+    line->trcs = 0;
+}
@@ -0,0 +1,352 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+LPA - local polynomial approximation smoothing kernels
+
+LPA_init        generate a 2D LPA kernel and its separable factors
+LPA_init3D      generate a 3D LPA kernel and its separable factors
+LPA_lines       return number of lines spanned by the kernel
+LPA_traces      return number of traces spanned by the kernel
+LPA_samples     return number of time samples spanned by the kernel
+LPA_rank        return number of separable terms in the kernel
+LPA_weight      return the kernel weight at a line, trace and time offset
+LPA_lineFilter  return the line axis filter of a separable term
+LPA_traceFilter return the trace axis filter of a separable term
+LPA_timeFilter  return the time axis filter of a separable term
+LPA_filterTime  apply the time axis filter of a separable term to a trace
+LPA_free        release a LPA kernel handle
+
+**************************************************************************
+Function Prototypes:
+hLPA LPA_init(int ntraces, int nsamples, int order);
+hLPA LPA_init3D(int nlines, int ntraces, int nsamples, int order);
+void LPA_free(hLPA h);
+int LPA_lines(hLPA h);
+int LPA_traces(hLPA h);
+int LPA_samples(hLPA h);
+int LPA_rank(hLPA h);
+float LPA_weight(hLPA h, int iline, int itrace, int isample);
+const float* LPA_lineFilter(hLPA h, int iterm);
+const float* LPA_traceFilter(hLPA h, int iterm);
+const float* LPA_timeFilter(hLPA h, int iterm);
+void LPA_filterTime(hLPA h, int iterm, int ns, const float* const in, float* const out);
+
+**************************************************************************
+LPA_init:
+Input:
+ntraces     number of traces spanned by the kernel - should be odd
+nsamples    number of time samples spanned by the kernel - should be odd
+order       total degree of the fitted polynomial
+
+Returned: LPA kernel handle
+
+**************************************************************************
+LPA_init3D:
+Input:
+nlines      number of lines spanned by the kernel - should be odd
+ntraces     number of traces along each line spanned by the kernel - should be odd
+nsamples    number of time samples spanned by the kernel - should be odd
+order       total degree of the fitted polynomial
+
+Returned: LPA kernel handle
+
+**************************************************************************
+LPA_weight:
+Input:
+h           LPA kernel handle created by LPA_init or LPA_init3D
+iline       line index in the kernel, 0 to nlines-1
+itrace      trace index in the kernel, 0 to ntraces-1
+isample     sample index in the kernel, 0 to nsamples-1
+
+Returned:   kernel weight
+
+**************************************************************************
+LPA_filterTime:
+Input:
+h           LPA kernel handle created by LPA_init
+iterm       separable term, 0 to LPA_rank(h)-1
+ns          number of samples in the trace
+in          input trace
+
+Output:
+out         input trace convolved with the time axis filter of the term,
+            samples beyond the ends of the trace take the end values
+
+**************************************************************************
+Notes:
+The kernel gives the value at the centre of the window of the least squares
+fit of a polynomial in line offset y, trace offset x and time offset t with
+terms y^i*x^j*t^l, i+j+l<=order. A 2D kernel is the special case of a single
+line. Terms that the window is too small to resolve along an axis are
+dropped. The kernel is itself a polynomial in y, x and t so grouping its
+terms by the powers of y and x gives an exact separable factorisation
+    w(y,x,t) = sum_ij y^i * x^j * b_ij(t)
+and, because odd powers vanish over a symmetric window, there are only a
+few separable terms, 2 for a 2D and 3 for a 3D quadratic kernel. Convolving
+with the kernel as a time pass with each b_ij followed by passes across
+traces and lines costs rank*(nlines+ntraces+nsamples) per output sample
+instead of nlines*ntraces*nsamples.
+
+LPA_filterTime applies the filter one tap at a time along whole rows of 
+interior samples, handling the nsamples/2 samples at each end of the trace 
+separately, so the inner loops vectorise. The order of the sums for each 
+sample is the same as a direct evaluation of the convolution.
+
+For a symmetric window the centre value of an odd order fit is the same as
+that of the even order below it, so order=3 gives the same kernel as order=2.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+#define LPA_EPS 1.0e-10
+
+struct _LPA {
+    int ny;
+    int nx;
+    int nt;
+    int rank;
+    float** yfilt;
+    float** xfilt;
+    float** tfilt;
+};
+
+static void solve( int n, double** a, double* b );
+static float edgeSample( int nt, const float* filt, int ns, const float* in, int is );
+
+hLPA LPA_init( int ntraces, int nsamples, int order ) {
+    return LPA_init3D( 1, ntraces, nsamples, order );
+}
+
+hLPA LPA_init3D( int nlines, int ntraces, int nsamples, int order ) {
+
+    hLPA h = emalloc(sizeof(struct _LPA));
+    int ny = nlines;
+    int nx = ntraces;
+    int nt = nsamples;
+    int hy = ny/2;
+    int hx = nx/2;
+    int ht = nt/2;
+    int nord = order+1;
+    h->ny = ny;
+    h->nx = nx;
+    h->nt = nt;
+
+/* Polynomial terms resolvable by the window */
+    int np = 0;
+    int* py = ealloc1int( nord*nord*nord );
+    int* px = ealloc1int( nord*nord*nord );
+    int* pt = ealloc1int( nord*nord*nord );
+    for (int i=0; i<=order && i<ny; i++) {
+        for (int j=0; i+j<=order && j<nx; j++) {
+            for (int l=0; i+j+l<=order && l<nt; l++) {
+                py[np] = i;
+                px[np] = j;
+                pt[np] = l;
+                np++;
+            }
+        }
+    }
+
+/* Normal equations for the centre value of the fit */
+    double** g = (double**) ealloc2( np, np, sizeof(double) );
+    double* c = ealloc1double( np );
+    for (int k=0; k<np; k++) {
+        c[k] = (py[k]==0 && px[k]==0 && pt[k]==0)? 1.0 : 0.0;
+        for (int l=0; l<np; l++) {
+            g[k][l] = 0.0;
+            for (int iy=-hy; iy<=hy; iy++)
+                for (int ix=-hx; ix<=hx; ix++)
+                    for (int it=-ht; it<=ht; it++)
+                        g[k][l] += pow(iy, py[k]+py[l])*pow(ix, px[k]+px[l])*pow(it, pt[k]+pt[l]);
+        }
+    }
+    solve( np, g, c );
+
+/* Separable terms grouped by power of line and trace offset */
+    double** b = (double**) ealloc2( nt, nord*nord, sizeof(double) );
+    int* used = ealloc1int( nord*nord );
+    for (int i=0; i<nord*nord; i++) {
+        used[i] = 0;
+        for (int it=0; it<nt; it++)
+            b[i][it] = 0.0;
+    }
+    for (int k=0; k<np; k++) {
+        if (fabs(c[k]) < LPA_EPS*fabs(c[0]))
+            continue;
+        int ig = py[k]*nord + px[k];
+        used[ig] = 1;
+        for (int it=-ht; it<=ht; it++)
+            b[ig][it+ht] += c[k]*pow(it, pt[k]);
+    }
+    h->rank = 0;
+    for (int i=0; i<nord*nord; i++)
+        h->rank += used[i];
+    h->yfilt = ealloc2float( ny, h->rank );
+    h->xfilt = ealloc2float( nx, h->rank );
+    h->tfilt = ealloc2float( nt, h->rank );
+    for (int ig=0, iterm=0; ig<nord*nord; ig++) {
+        if (!used[ig])
+            continue;
+        for (int iy=-hy; iy<=hy; iy++)
+            h->yfilt[iterm][iy+hy] = pow(iy, ig/nord);
+        for (int ix=-hx; ix<=hx; ix++)
+            h->xfilt[iterm][ix+hx] = pow(ix, ig%nord);
+        for (int it=0; it<nt; it++)
+            h->tfilt[iterm][it] = b[ig][it];
+        iterm++;
+    }
+
+    free1int( py );
+    free1int( px );
+    free1int( pt );
+    free1int( used );
+    free2( (void**) g );
+    free2( (void**) b );
+    free1double( c );
+    return h;
+}
+
+void LPA_free( hLPA h ) {
+    if (h) {
+        free2float( h->yfilt );
+        free2float( h->xfilt );
+        free2float( h->tfilt );
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in LPA_free.");
+}
+
+int LPA_lines( hLPA h ) {
+    return h ? h->ny : 0;
+}
+
+int LPA_traces( hLPA h ) {
+    return h ? h->nx : 0;
+}
+
+int LPA_samples( hLPA h ) {
+    return h ? h->nt : 0;
+}
+
+int LPA_rank( hLPA h ) {
+    return h ? h->rank : 0;
+}
+
+float LPA_weight( hLPA h, int iline, int itrace, int isample ) {
+    if (h && iline>=0 && iline<h->ny && itrace>=0 && itrace<h->nx && isample>=0 && isample<h->nt) {
+        double w = 0.0;
+        for (int iterm=0; iterm<h->rank; iterm++)
+            w += (double) h->yfilt[iterm][iline]*h->xfilt[iterm][itrace]*h->tfilt[iterm][isample];
+        return w;
+    } else
+        err("bad arguments in LPA_weight.");
+    return 0.0;
+}
+
+const float* LPA_lineFilter( hLPA h, int iterm ) {
+    if (h && iterm>=0 && iterm<h->rank)
+        return h->yfilt[iterm];
+    else
+        err("bad arguments in LPA_lineFilter.");
+    return 0;
+}
+
+const float* LPA_traceFilter( hLPA h, int iterm ) {
+    if (h && iterm>=0 && iterm<h->rank)
+        return h->xfilt[iterm];
+    else
+        err("bad arguments in LPA_traceFilter.");
+    return 0;
+}
+
+const float* LPA_timeFilter( hLPA h, int iterm ) {
+    if (h && iterm>=0 && iterm<h->rank)
+        return h->tfilt[iterm];
+    else
+        err("bad arguments in LPA_timeFilter.");
+    return 0;
+}
+
+void LPA_filterTime( hLPA h, int iterm, int ns, const float* const in, float* const out ) {
+    if (h && in && out && iterm>=0 && iterm<h->rank) {
+        const float* restrict filt = h->tfilt[iterm];
+        const float* restrict src = in;
+        float* restrict dst = out;
+        int nt = h->nt;
+        int ht = nt/2;
+        int ifirst = MIN(ht, ns);
+        int ilast = MAX(ns-ht, ifirst);
+/* Edge samples where the filter runs off the trace */
+        for (int is=0; is<ifirst; is++)
+            dst[is] = edgeSample( nt, filt, ns, src, is );
+        for (int is=ilast; is<ns; is++)
+            dst[is] = edgeSample( nt, filt, ns, src, is );
+/* Interior samples one filter tap at a time along the whole row so the 
+   inner loop is a unit stride multiply-add that the compiler can vectorise */
+        for (int is=ifirst; is<ilast; is++)
+            dst[is] = 0.0;
+        for (int it=0; it<nt; it++) {
+            float f = filt[it];
+            const float* restrict row = src + it - ht;
+            for (int is=ifirst; is<ilast; is++)
+                dst[is] += f*row[is];
+        }
+    } else
+        err("bad arguments in LPA_filterTime.");
+}
+
+/* Filter output at sample is with samples beyond the ends of the trace 
+   taking the end values */
+static float edgeSample( int nt, const float* filt, int ns, const float* in, int is ) {
+    int ht = nt/2;
+    float sum = 0.0;
+    for (int it=0; it<nt; it++) {
+        int idx = is+it-ht;
+        idx = (idx<0)? 0 : (idx>=ns)? ns-1 : idx;
+        sum += filt[it]*in[idx];
+    }
+    return sum;
+}
+
+/* Solve the n x n system a x = b by Gaussian elimination with partial
+   pivoting, leaving the solution in b. a is overwritten. */
+static void solve( int n, double** a, double* b ) {
+    for (int k=0; k<n; k++) {
+        int ip = k;
+        for (int i=k+1; i<n; i++)
+            if (fabs(a[i][k]) > fabs(a[ip][k]))
+                ip = i;
+        if (a[ip][k] == 0.0)
+            err("singular system in LPA_init.");
+        if (ip != k) {
+            for (int j=0; j<n; j++) {
+                double ta = a[k][j];
+                a[k][j] = a[ip][j];
+                a[ip][j] = ta;
+            }
+            double tb = b[k];
+            b[k] = b[ip];
+            b[ip] = tb;
+        }
+        for (int i=k+1; i<n; i++) {
+            double f = a[i][k]/a[k][k];
+            for (int j=k; j<n; j++)
+                a[i][j] -= f*a[k][j];
+            b[i] -= f*b[k];
+        }
+    }
+    for (int k=n-1; k>=0; k--) {
+        for (int j=k+1; j<n; j++)
+            b[k] -= a[k][j]*b[j];
+        b[k] /= a[k][k];
+    }
+}
@@ -0,0 +1,380 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+OP - trace operators for running several processes in one program
+
+OP_init         initialise an operator by name from its parameters
+OP_initargs     initialise an operator by name from the program parameters
+OP_new          wrap the state and functions of an operator in a handle
+OP_name         return the name of an operator
+OP_push         pass an input trace to an operator
+OP_pull         return the next output trace from an operator
+OP_flush        tell an operator there is no more input
+OP_free         release an operator handle
+OP_run          pass every trace of a trace stream through an operator
+OP_getint       get an integer parameter of an operator
+OP_getfloat     get a float parameter of an operator
+OP_getstring    get a string parameter of an operator
+OP_countval     count the values of an array parameter of an operator
+OP_getfloats    get the values of a float array parameter of an operator
+
+**************************************************************************
+Function Prototypes:
+hOP OP_init(const char* name, int npar, char** par);
+hOP OP_initargs(const char* name, const char* other);
+hOP OP_new(const char* name, void* state, OP_pushFunc push, OP_pullFunc pull,
+           OP_freeFunc free);
+const char* OP_name(hOP h);
+void OP_push(hOP h, const segy* const tr);
+segy* OP_pull(hOP h);
+void OP_flush(hOP h);
+void OP_free(hOP h);
+int OP_run(hOP h, hTIO tio);
+int OP_getint(int npar, char** par, const char* name, int* val);
+int OP_getfloat(int npar, char** par, const char* name, float* val);
+int OP_getstring(int npar, char** par, const char* name, char** val);
+int OP_countval(int npar, char** par, const char* name);
+int OP_getfloats(int npar, char** par, const char* name, float* val);
+
+**************************************************************************
+OP_init:
+Input:
+name        name of the operator, the same as the program it replaces
+npar        number of parameters
+par         array of parameters as name=value strings
+
+Returned: operator handle or NULL if the name is not known
+
+**************************************************************************
+OP_initargs:
+Input:
+name        name of the operator, the same as the program it replaces
+other       comma separated list of the other parameters the program reads
+            itself, or NULL
+
+Returned: operator handle or NULL if the name is not known
+
+**************************************************************************
+OP_run:
+Input:
+h           operator handle
+tio         trace stream handle created by TIO_init
+
+Returned:   number of traces read from the stream
+
+**************************************************************************
+OP_push:
+Input:
+h           operator handle
+tr          input trace, the operator copies what it needs so the trace
+            can be reused as soon as OP_push returns
+
+**************************************************************************
+OP_pull:
+Input:
+h           operator handle
+
+Returned:   pointer to the next output trace or NULL if no more output is
+            available until more input is pushed. The trace belongs to the
+            operator and is valid until the next call to OP_pull, OP_push
+            or OP_flush.
+
+**************************************************************************
+OP_getint, OP_getfloat, OP_getstring:
+Input:
+npar        number of parameters
+par         array of parameters as name=value strings
+name        name of the parameter
+
+Output:
+val         value of the last occurrence of the parameter
+
+Returned:   1 if the parameter was found, 0 otherwise
+
+**************************************************************************
+OP_countval, OP_getfloats:
+Input:
+npar        number of parameters
+par         array of parameters as name=value strings
+name        name of the parameter
+
+Output:
+val         comma separated values of the last occurrence of the parameter,
+            val must have room for OP_countval values
+
+Returned:   number of values, 0 if the parameter was not found
+
+**************************************************************************
+Notes:
+An operator is the core of one of the programs with the trace input and
+output taken out. Traces are pushed in one at a time, and after each push,
+and after OP_flush at the end of the data, OP_pull is called until it
+returns NULL to collect the output. Trace buffers are passed by pointer so
+a chain of operators, like suctrcmedian | susdft, runs in one
+process without formatting traces for a pipe between the stages.
+
+The operators available are:
+
+susdft          sliding DFT, parameters nwin, mode, window, dt, maxns, verbose
+suisdft         inverse sliding DFT, parameters nwin, dt, verbose
+susdct          sliding DCT, parameters nwin, window, dt, verbose
+suisdct         inverse sliding DCT, parameters nwin, dt, verbose
+sutrcmedian     rolling median with an ordered trace buffer, ntr, mode, verbose
+suctrcmedian    rolling median with a cyclic trace buffer, ntr, mode, verbose
+susdft_denoise  sliding DFT denoise, ntr, nwin, window, dt, reject, freqs, type,
+                mode, storage, ntile, key1, key2, nil, dkey2, verbose
+susdct_denoise  sliding DCT denoise, ntr, nwin, window, reject, type, mode,
+                verbose
+sulpasmooth     rolling LPA filter, ntr, nsize, order, key1, key2, nil, dkey2,
+                mode, verbose
+suvpef          predictive error filter, dt, key, xlag, lag, len, pnoise,
+                mincorr, maxcorr, gates, fft, gkey, ntr, threads, verbose
+
+with the same meaning and defaults as for the programs, which are built on
+the operators with OP_run. OP_init stops with an error for a parameter the
+operator doesn't take. OP_initargs is used by the programs, after initargs,
+to read the parameters of the operator with getparstring, so they can also
+be given in a par= file, and it stops with an error for a parameter on the
+command line that is neither one of the operator's, one in other, par= or
+compress= of the trace stream. The parameter strings are only valid while
+the operator is being created, an operator copies any string it keeps. The format= and maxerr= parameters of susdft and
+susdct set how the trace stream writes the output, see TIO_quantize, so
+they are accepted by OP_init but left to the caller. New operators are
+added by writing push, pull and free functions for their state, wrapping
+them with OP_new and adding the constructor and its parameters to the
+table in OP_init.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+struct _OP {
+    const char* name;
+    void* state;
+    int flushed;
+    OP_pushFunc push;
+    OP_pullFunc pull;
+    OP_freeFunc free;
+};
+
+typedef hOP (*OP_initFunc)( int npar, char** par );
+
+static const struct {
+    const char* name;
+    OP_initFunc init;
+    const char* pars;
+} optable[] = {
+    { "susdft", OP_sdft, "nwin,mode,window,dt,maxns,format,maxerr,verbose" },
+    { "suisdft", OP_isdft, "nwin,dt,verbose" },
+    { "susdct", OP_sdct, "nwin,window,dt,format,maxerr,verbose" },
+    { "suisdct", OP_isdct, "nwin,dt,verbose" },
+    { "sutrcmedian", OP_trcmedian, "ntr,mode,verbose" },
+    { "suctrcmedian", OP_ctrcmedian, "ntr,mode,verbose" },
+    { "susdft_denoise", OP_sdftdenoise, "ntr,nwin,window,dt,reject,freqs,type,mode,storage,ntile,key1,key2,nil,dkey2,verbose" },
+    { "susdct_denoise", OP_sdctdenoise, "ntr,nwin,window,reject,type,mode,verbose" },
+    { "sulpasmooth", OP_lpasmooth, "ntr,nsize,order,key1,key2,nil,dkey2,mode,verbose" },
+    { "suvpef", OP_vpef, "dt,key,xlag,lag,len,pnoise,mincorr,maxcorr,gates,fft,gkey,ntr,threads,verbose" },
+    { 0, 0, 0 }
+};
+
+static const char* getpar( int npar, char** par, const char* name );
+static void checkParams( const char* name, const char* pars, int npar, char** par );
+static int inList( const char* list, const char* name, size_t len );
+
+hOP OP_init( const char* name, int npar, char** par ) {
+    for (int i=0; optable[i].name; i++)
+        if (STREQ(name, optable[i].name)) {
+            checkParams( name, optable[i].pars, npar, par );
+            return optable[i].init( npar, par );
+        }
+    return 0;
+}
+
+hOP OP_initargs( const char* name, const char* other ) {
+    for (int i=0; optable[i].name; i++)
+        if (STREQ(name, optable[i].name)) {
+            const char* pars = optable[i].pars;
+            int npar = 0;
+            int maxpar = 1;
+            char** par;
+            char* val;
+            hOP h;
+
+/* Command line parameters must be known to the operator or the program */
+            for (int iarg=1; iarg<xargc; iarg++) {
+                size_t len = strcspn( xargv[iarg], "=" );
+                if (!xargv[iarg][len])
+                    continue;
+                if (!inList( pars, xargv[iarg], len ) && !(other && inList( other, xargv[iarg], len ))
+                    && !inList( "par,compress", xargv[iarg], len ))
+                    err("%s: unknown parameter \"%s\"", name, xargv[iarg]);
+            }
+
+/* Operator parameters by getpar, which reads par= files too */
+            for (const char* p=pars; *p; p++)
+                maxpar += (*p==',');
+            par = ealloc1( maxpar, sizeof(char*) );
+            for (const char* p=pars; *p; ) {
+                size_t plen = strcspn( p, "," );
+                char pname[64];
+                snprintf( pname, sizeof(pname), "%.*s", (int) plen, p );
+                if (getparstring( pname, &val )) {
+                    par[npar] = ealloc1( plen+strlen(val)+2, 1 );
+                    sprintf( par[npar], "%s=%s", pname, val );
+                    npar++;
+                }
+                p += plen + (p[plen]==',');
+            }
+            h = optable[i].init( npar, par );
+            for (int ipar=0; ipar<npar; ipar++)
+                free1( par[ipar] );
+            free1( par );
+            return h;
+        }
+    return 0;
+}
+
+hOP OP_new( const char* name, void* state, OP_pushFunc push, OP_pullFunc pull, OP_freeFunc free ) {
+
+    hOP h = emalloc(sizeof(struct _OP));
+    h->name = name;
+    h->state = state;
+    h->flushed = 0;
+    h->push = push;
+    h->pull = pull;
+    h->free = free;
+    return h;
+}
+
+void OP_free( hOP h ) {
+    if (h) {
+        h->free( h->state );
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in OP_free.");
+}
+
+const char* OP_name( hOP h ) {
+    return h ? h->name : 0;
+}
+
+void OP_push( hOP h, const segy* const tr ) {
+    if (h && tr) {
+        if (h->flushed)
+            err("%s: trace pushed after flush", h->name);
+        h->push( h->state, tr );
+    } else
+        err("bad pointer in OP_push.");
+}
+
+segy* OP_pull( hOP h ) {
+    if (h)
+        return h->pull( h->state, h->flushed );
+    else
+        err("bad pointer in OP_pull.");
+    return 0;
+}
+
+void OP_flush( hOP h ) {
+    if (h)
+        h->flushed = 1;
+    else
+        err("bad pointer in OP_flush.");
+}
+
+int OP_run( hOP h, hTIO tio ) {
+    segy* tr;
+    segy* out;
+    int ntr = 0;
+    if (!h || !tio)
+        err("bad pointer in OP_run.");
+    while ((tr = TIO_get(tio))) {
+        OP_push( h, tr );
+        ntr++;
+        while ((out = OP_pull( h )))
+            TIO_puttr( tio, out );
+    }
+    OP_flush( h );
+    while ((out = OP_pull( h )))
+        TIO_puttr( tio, out );
+    return ntr;
+}
+
+int OP_getint( int npar, char** par, const char* name, int* val ) {
+    const char* s = getpar( npar, par, name );
+    if (s)
+        *val = eatoi( (char*) s );
+    return s!=0;
+}
+
+int OP_getfloat( int npar, char** par, const char* name, float* val ) {
+    const char* s = getpar( npar, par, name );
+    if (s)
+        *val = eatof( (char*) s );
+    return s!=0;
+}
+
+int OP_getstring( int npar, char** par, const char* name, char** val ) {
+    const char* s = getpar( npar, par, name );
+    if (s)
+        *val = (char*) s;
+    return s!=0;
+}
+
+int OP_countval( int npar, char** par, const char* name ) {
+    const char* s = getpar( npar, par, name );
+    int n = 0;
+    if (s)
+        for (n=1; *s; s++)
+            n += (*s==',');
+    return n;
+}
+
+int OP_getfloats( int npar, char** par, const char* name, float* val ) {
+    const char* s = getpar( npar, par, name );
+    int n = 0;
+    while (s) {
+        char* end;
+        val[n++] = (float) strtod( s, &end );
+        if (end==s || (*end && *end!=','))
+            err("bad value in %s=%s", name, getpar( npar, par, name ));
+        s = (*end)? end+1 : 0;
+    }
+    return n;
+}
+
+/* Value of the last name=value parameter with the given name */
+static const char* getpar( int npar, char** par, const char* name ) {
+    const char* val = 0;
+    size_t len = strlen(name);
+    for (int i=0; i<npar; i++)
+        if (!strncmp(par[i], name, len) && par[i][len]=='=')
+            val = par[i] + len + 1;
+    return val;
+}
+
+/* Stop with an error for a parameter not in the comma separated list pars */
+static void checkParams( const char* name, const char* pars, int npar, char** par ) {
+    for (int i=0; i<npar; i++)
+        if (!inList( pars, par[i], strcspn( par[i], "=" ) ))
+            err("%s: unknown parameter \"%s\"", name, par[i]);
+}
+
+/* Whether the first len characters of name are in the comma separated list */
+static int inList( const char* list, const char* name, size_t len ) {
+    for (const char* p=list; *p; ) {
+        size_t plen = strcspn( p, "," );
+        if (plen==len && !strncmp( p, name, len ))
+            return 1;
+        p += plen + (p[plen]==',');
+    }
+    return 0;
+}
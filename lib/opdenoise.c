@@ -0,0 +1,722 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+OPDENOISE - time-frequency panel denoise operators
+
+OP_sdftdenoise  create a sliding DFT denoise operator, as susdft_denoise
+OP_sdctdenoise  create a sliding DCT denoise operator, as susdct_denoise
+
+**************************************************************************
+Function Prototypes:
+hOP OP_sdftdenoise(int npar, char** par);
+hOP OP_sdctdenoise(int npar, char** par);
+
+**************************************************************************
+Input:
+npar        number of parameters
+par         array of parameters as name=value strings
+
+Returned: operator handle
+
+**************************************************************************
+Notes:
+These are the cores of the programs of the same name. The panel buffer is
+created when the first seismic trace is pushed and the traces left in it
+are output after OP_flush. Non-seismic traces are skipped. See OP for how
+operators are used.
+
+With key1= OP_sdftdenoise buffers whole lines with LBSDFT. A trace that
+starts a new line completes the line before it, and the new trace is only
+added to the buffer once the traces of the completed line have all been
+pulled.
+
+With more than one type= or, without freqs=, more than one reject= value
+OP_sdftdenoise runs a parameter sweep and outputs the result of every
+combination for each trace, one after the other, with the reject values in
+the outer loop and the types in the inner. susdft_denoise writes each
+result to its own file.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "su.h"
+#include "segy.h"
+#include "header.h"
+#include "sux.h"
+
+typedef enum ProcType { SwMean, SwMedian, Median, Mean } proc_Type;
+
+typedef struct {
+    int ntr;
+    int nwin;
+    sux_Window iwind;
+    float dt;
+    int nfrq;
+    int nrej;
+    int nset;
+    float* freqs;
+    float* reject;
+    float** freject;
+    int ntype;
+    proc_Type* itypes;
+    int ncomb;
+    sux_Storage istore;
+    int ntile;
+    cwp_String key1Type;
+    cwp_String key2Type;
+    int key1Index;
+    int key2Index;
+    int nil;
+    int dkey2;
+    int mode;
+    int verbose;
+    int nsamples;
+    int ready;
+    int iout;       /* next result in outtrs to be pulled    */
+    int nout;       /* results in outtrs                     */
+    int line;       /* key1 of the line being pushed         */
+    int first;
+    int pending;    /* pend starts a line and is not pushed  */
+    int pkey2;
+    int itrc;       /* next trace of the completed line      */
+    int ntrc;       /* traces in the completed line          */
+    int done;
+    complex* specbuf;
+    float* rspecbuf;
+    float* ampbuf;
+    int* idxbuf;
+    int* keepbuf;
+    hCBSDFT cbsdft;
+    hLBSDFT lbsdft;
+    hCBSDCT cbsdct;
+    segy* outtrs;
+    segy pend;
+} _OPDENOISE;
+
+static _OPDENOISE* initState( const char* name, int npar, char** par );
+static void freeState( void* state );
+static void sdftPush( void* state, const segy* const tr );
+static segy* sdftPull( void* state, int flush );
+static segy* sdftLinePull( _OPDENOISE* s, int flush );
+static void sdctPush( void* state, const segy* const tr );
+static segy* sdctPull( void* state, int flush );
+static void denoise( hCBSDFT h, float* freject, proc_Type itype, int mode, complex* specbuf, float* ampbuf,
+                     int* idxbuf, int* keepbuf, segy* out );
+static void denoise3d( hLBSDFT h, int itrc, float* freject, proc_Type itype, int mode, complex* specbuf,
+                       float* ampbuf, int* idxbuf, int* keepbuf, segy* out );
+static cwp_Bool filter_slice( int tcount, int nkeep, int icur, proc_Type itype, complex* specbuf,
+                              float* ampbuf, int* idxbuf, int* keepbuf, complex* outval );
+static void rank( int n, int nkeep, int sortkeep, float* amp, int* idx );
+static void denoise_sweep( hCBSDFT h, int nset, float** freject, int ntype, proc_Type* itypes, int mode,
+                           complex* specbuf, float* ampbuf, int* idxbuf, int* rankbuf, segy* outtrs );
+static void denoise_sdct( hCBSDCT h, float reject, proc_Type itype, int mode, float* specbuf, float* ampbuf,
+                          int* idxbuf, segy* out );
+
+hOP OP_sdftdenoise( int npar, char** par ) {
+    _OPDENOISE* s = initState( "susdft_denoise", npar, par );
+    char* storage;
+    char* key1;
+    char* key2;
+
+    if (!OP_getfloat( npar, par, "dt", &s->dt )) s->dt = 0.0;
+    s->nfrq = OP_countval( npar, par, "freqs" );
+    if (s->nfrq>0 && s->nrej!=s->nfrq)
+        err("susdft_denoise: a reject value must be given for each frequency in freqs=");
+    s->freqs = ealloc1float( s->nrej );
+    if (!OP_getfloats( npar, par, "freqs", s->freqs )) s->freqs[0] = 0.0;
+    for (int i=1; i<s->nfrq; i++)
+        if (s->freqs[i] <= s->freqs[i-1])
+            err("susdft_denoise: freqs= must be strictly increasing");
+    s->nset = (s->nfrq>0)? 1 : s->nrej;
+    s->ncomb = s->nset*s->ntype;
+
+    if (!OP_getstring( npar, par, "storage", &storage )) storage = "float";
+    if      (STREQ(storage, "int16")) s->istore = Int16;
+    else if (STREQ(storage, "float")) s->istore = Float32;
+    else
+        err("susdft_denoise: unknown storage=\"%s\"", storage);
+    if (!OP_getint( npar, par, "ntile", &s->ntile )) s->ntile = 0;
+    if (s->ntile<0)
+        err("susdft_denoise: ntile=%d must not be negative", s->ntile);
+
+    if (!OP_getstring( npar, par, "key1", &key1 )) key1 = NULL;
+    if (!OP_getstring( npar, par, "key2", &key2 )) key2 = "tracf";
+    if (!OP_getint( npar, par, "nil", &s->nil )) s->nil = 3;
+    if (s->nil%2==0) {
+        s->nil++;
+        if (s->verbose)
+            warn("susdft_denoise: adjusting nil to be odd, was %d now %d", s->nil-1, s->nil);
+    }
+    if (!OP_getint( npar, par, "dkey2", &s->dkey2 )) s->dkey2 = 1;
+    if (key1) {
+        if (s->ncomb>1)
+            err("susdft_denoise: parameter sweeps are not supported with key1=");
+        if (s->istore!=Float32 || s->ntile>0)
+            warn("susdft_denoise: storage= and ntile= are ignored with key1=");
+        s->key1Type = hdtype(key1);
+        s->key1Index = getindex(key1);
+        s->key2Type = hdtype(key2);
+        s->key2Index = getindex(key2);
+        if (s->key1Index<0 || s->key2Index<0)
+            err("susdft_denoise: unknown header key in key1=%s or key2=%s", key1, key2);
+    }
+    return OP_new( "susdft_denoise", s, sdftPush, sdftPull, freeState );
+}
+
+hOP OP_sdctdenoise( int npar, char** par ) {
+    _OPDENOISE* s = initState( "susdct_denoise", npar, par );
+    return OP_new( "susdct_denoise", s, sdctPush, sdctPull, freeState );
+}
+
+/* Parameters common to both denoise operators */
+static _OPDENOISE* initState( const char* name, int npar, char** par ) {
+    _OPDENOISE* s = emalloc(sizeof(_OPDENOISE));
+    char* window;
+    char* type;
+
+    if (!OP_getint( npar, par, "verbose", &s->verbose )) s->verbose = 0;
+    if (!OP_getint( npar, par, "nwin", &s->nwin )) s->nwin = 31;
+    if (s->nwin%2==0) {
+        s->nwin++;
+        if (s->verbose)
+            warn("%s: adjusting nwin to be odd, was %d now %d", name, s->nwin-1, s->nwin);
+    }
+    if (!OP_getint( npar, par, "ntr", &s->ntr )) s->ntr = 9;
+    if (s->ntr%2==0) {
+        s->ntr++;
+        if (s->verbose)
+            warn("%s: adjusting ntr to be odd, was %d now %d", name, s->ntr-1, s->ntr);
+    }
+    s->nrej = MAX(OP_countval( npar, par, "reject" ), 1);
+    s->reject = ealloc1float( s->nrej );
+    if (!OP_getfloats( npar, par, "reject", s->reject )) s->reject[0] = 10.0;
+    for (int i=0; i<s->nrej; i++) {
+        if (s->reject[i]<0 || s->reject[i]>100) {
+            warn("%s: reject out of range 0-100, reset to 10", name);
+            s->reject[i] = 10;
+        }
+    }
+
+/* type= is a list for parameter sweeps */
+    s->ntype = MAX(OP_countval( npar, par, "type" ), 1);
+    s->itypes = ealloc1( s->ntype, sizeof(proc_Type) );
+    if (!OP_getstring( npar, par, "type", &type )) type = "swmean";
+    for (int i=0; i<s->ntype; i++) {
+        size_t len = strcspn( type, "," );
+        if      (len==8 && !strncmp(type, "swmedian", len)) s->itypes[i] = SwMedian;
+        else if (len==6 && !strncmp(type, "median", len)) s->itypes[i] = Median;
+        else if (len==4 && !strncmp(type, "mean", len)) s->itypes[i] = Mean;
+        else if (len==6 && !strncmp(type, "swmean", len)) s->itypes[i] = SwMean;
+        else
+            err("%s: unknown type=\"%.*s\"", name, (int) len, type);
+        type += len + (type[len]==',');
+    }
+    s->nset = 1;
+    s->ncomb = s->ntype;
+    if (s->ncomb>1 && STREQ(name, "susdct_denoise"))
+        err("susdct_denoise: only one type= can be given");
+
+    if (!OP_getint( npar, par, "mode", &s->mode )) s->mode = 0;
+    if (!OP_getstring( npar, par, "window", &window )) window = "none";
+    if      (STREQ(window, "hann")) s->iwind = Hann;
+    else if (STREQ(window, "hamming")) s->iwind = Hamming;
+    else if (STREQ(window, "blackman")) s->iwind = Blackman;
+    else if (STREQ(window, "none")) s->iwind = None;
+    else
+        err("%s: unknown window=\"%s\"", name, window);
+
+    s->dt = 0.0;
+    s->nfrq = 0;
+    s->freqs = 0;
+    s->freject = 0;
+    s->istore = Float32;
+    s->ntile = 0;
+    s->key1Type = 0;
+    s->key2Type = 0;
+    s->key1Index = 0;
+    s->key2Index = 0;
+    s->nil = 1;
+    s->dkey2 = 1;
+    s->nsamples = 0;
+    s->ready = 0;
+    s->iout = 0;
+    s->nout = 0;
+    s->line = 0;
+    s->first = 1;
+    s->pending = 0;
+    s->pkey2 = 0;
+    s->itrc = 0;
+    s->ntrc = 0;
+    s->done = 0;
+    s->specbuf = 0;
+    s->rspecbuf = 0;
+    s->ampbuf = 0;
+    s->idxbuf = 0;
+    s->keepbuf = 0;
+    s->cbsdft = 0;
+    s->lbsdft = 0;
+    s->cbsdct = 0;
+    s->outtrs = 0;
+    return s;
+}
+
+static void freeState( void* state ) {
+    _OPDENOISE* s = (_OPDENOISE*) state;
+    if (s->cbsdft) CBSDFT_free( s->cbsdft );
+    if (s->lbsdft) LBSDFT_free( s->lbsdft );
+    if (s->cbsdct) CBSDCT_free( s->cbsdct );
+    if (s->specbuf) free1complex( s->specbuf );
+    if (s->rspecbuf) free1float( s->rspecbuf );
+    if (s->ampbuf) free1float( s->ampbuf );
+    if (s->idxbuf) free1int( s->idxbuf );
+    if (s->keepbuf) free1int( s->keepbuf );
+    if (s->outtrs) free1( s->outtrs );
+    if (s->freject) free2float( s->freject );
+    if (s->freqs) free1float( s->freqs );
+    free1float( s->reject );
+    free1( s->itypes );
+    free( s );
+}
+
+/* Buffers and reject percentages once the first seismic trace gives the
+   trace length and sample interval */
+static void sdftInit( _OPDENOISE* s, const segy* const tr ) {
+    int npanel;
+    s->nsamples = tr->ns;
+    if (s->nsamples==0)
+        err("susdft_denoise: zero length traces not allowed.");
+    if (s->dt == 0.0)
+        s->dt = ((double) tr->dt)/1000000.0;
+    if (s->dt == 0.0)
+        err("susdft_denoise: trace dt field is zero and not given");
+    if (s->key1Type) {
+        s->lbsdft = LBSDFT_init( s->nil, s->ntr, s->dkey2, s->nsamples, s->nwin, s->iwind );
+        npanel = LBSDFT_maxPanel( s->lbsdft );
+    } else {
+        s->cbsdft = CBSDFT_initTiled( s->ntr, s->nsamples, s->nwin, s->iwind, s->istore, s->ntile );
+        if (s->ncomb>1)
+            CBSDFT_setResultSets( s->cbsdft, s->ncomb );
+        npanel = s->ntr;
+    }
+    s->specbuf = ealloc1complex( npanel );
+    s->ampbuf = ealloc1float( npanel );
+    s->idxbuf = ealloc1int( npanel );
+    s->keepbuf = ealloc1int( npanel );
+    s->outtrs = ealloc1( s->ncomb, sizeof(segy) );
+
+/* Reject percentage at each SDFT frequency for each reject set */
+    int nfreq = s->nwin/2 + 1;
+    float df = 1.0/(s->nwin*s->dt);
+    s->freject = ealloc2float( nfreq, s->nset );
+    for (int ifreq=0; ifreq<nfreq; ifreq++) {
+        float freq = ifreq*df;
+        if (s->nfrq>0)
+            intlin(s->nrej, s->freqs, s->reject, s->reject[0], s->reject[s->nrej-1], 1, &freq, &s->freject[0][ifreq]);
+        else
+            for (int iset=0; iset<s->nset; iset++)
+                s->freject[iset][ifreq] = s->reject[iset];
+    }
+}
+
+static void sdftPush( void* state, const segy* const tr ) {
+    _OPDENOISE* s = (_OPDENOISE*) state;
+    if (!ISSEISMIC(tr->trid)) {
+        if (s->verbose)
+            warn("skipping non-seismic trace with trid=%d", tr->trid);
+        return;
+    }
+    if (!s->nsamples)
+        sdftInit( s, tr );
+    if (s->lbsdft) {
+/* A change in key1 marks the start of a new line */
+        Value keyVal;
+        gethval(tr, s->key1Index, &keyVal);
+        int iline = vtoi(s->key1Type, keyVal);
+        int endline = (!s->first && iline!=s->line && LBSDFT_endLine(s->lbsdft));
+        s->line = iline;
+        s->first = 0;
+        gethval(tr, s->key2Index, &keyVal);
+        if (endline) {
+            s->itrc = 0;
+            s->ntrc = LBSDFT_traces( s->lbsdft );
+            memcpy( (void*)&s->pend, (void*)tr, HDRBYTES + s->nsamples*FSIZE );
+            s->pkey2 = vtoi(s->key2Type, keyVal);
+            s->pending = 1;
+        } else
+            LBSDFT_push( s->lbsdft, tr, vtoi(s->key2Type, keyVal) );
+    } else
+        s->ready = CBSDFT_push( s->cbsdft, tr );
+}
+
+/* Each trace ready in the panel is denoised as it is pulled, for a sweep
+   into one output trace per combination */
+static segy* sdftPull( void* state, int flush ) {
+    _OPDENOISE* s = (_OPDENOISE*) state;
+    if (s->lbsdft)
+        return sdftLinePull( s, flush );
+    if (s->iout < s->nout)
+        return &s->outtrs[s->iout++];
+    if (!s->ready && flush && s->cbsdft)
+        s->ready = CBSDFT_push( s->cbsdft, 0 );
+    if (!s->ready)
+        return 0;
+    s->ready = 0;
+    if (s->ncomb>1)
+        denoise_sweep( s->cbsdft, s->nset, s->freject, s->ntype, s->itypes, s->mode,
+                       s->specbuf, s->ampbuf, s->idxbuf, s->keepbuf, s->outtrs );
+    else
+        denoise( s->cbsdft, s->freject[0], s->itypes[0], s->mode,
+                 s->specbuf, s->ampbuf, s->idxbuf, s->keepbuf, &s->outtrs[0] );
+    s->iout = 1;
+    s->nout = s->ncomb;
+    return &s->outtrs[0];
+}
+
+/* The traces of a completed line are denoised one at a time as they are
+   pulled, after the last of them the held back trace that started the
+   next line goes in the buffer */
+static segy* sdftLinePull( _OPDENOISE* s, int flush ) {
+    for (;;) {
+        if (s->itrc < s->ntrc) {
+            denoise3d( s->lbsdft, s->itrc, s->freject[0], s->itypes[0], s->mode,
+                       s->specbuf, s->ampbuf, s->idxbuf, s->keepbuf, &s->outtrs[0] );
+            s->itrc++;
+            return &s->outtrs[0];
+        }
+        if (s->pending) {
+            LBSDFT_push( s->lbsdft, &s->pend, s->pkey2 );
+            s->pending = 0;
+        }
+        if (!flush || s->done)
+            return 0;
+        if (!LBSDFT_endLine( s->lbsdft )) {
+            s->done = 1;
+            return 0;
+        }
+        s->itrc = 0;
+        s->ntrc = LBSDFT_traces( s->lbsdft );
+    }
+}
+
+static void sdctPush( void* state, const segy* const tr ) {
+    _OPDENOISE* s = (_OPDENOISE*) state;
+    if (!ISSEISMIC(tr->trid)) {
+        if (s->verbose)
+            warn("skipping non-seismic trace with trid=%d", tr->trid);
+        return;
+    }
+    if (!s->nsamples) {
+        s->nsamples = tr->ns;
+        if (s->nsamples==0)
+            err("susdct_denoise: zero length traces not allowed.");
+        s->rspecbuf = ealloc1float( s->ntr );
+        s->ampbuf = ealloc1float( s->ntr );
+        s->idxbuf = ealloc1int( s->ntr );
+        s->outtrs = ealloc1( 1, sizeof(segy) );
+        s->cbsdct = CBSDCT_init( s->ntr, s->nsamples, s->nwin, s->iwind );
+    }
+    s->ready = CBSDCT_push( s->cbsdct, tr );
+}
+
+static segy* sdctPull( void* state, int flush ) {
+    _OPDENOISE* s = (_OPDENOISE*) state;
+    if (!s->ready && flush && s->cbsdct)
+        s->ready = CBSDCT_push( s->cbsdct, 0 );
+    if (!s->ready)
+        return 0;
+    s->ready = 0;
+    denoise_sdct( s->cbsdct, s->reject[0], s->itypes[0], s->mode, s->rspecbuf, s->ampbuf, s->idxbuf, &s->outtrs[0] );
+    return &s->outtrs[0];
+}
+
+/* Denoise the current trace in the panel and leave the result in out */
+static void denoise( hCBSDFT h, float* freject, proc_Type itype, int mode, complex* specbuf, float* ampbuf,
+                     int* idxbuf, int* keepbuf, segy* out )
+{
+    int ntiles = CBSDFT_tiles(h);
+    int nfreq = CBSDFT_nfreq(h);
+    int tcount = CBSDFT_traces(h);
+    complex outval = cmplx(0.0,0.0);
+    for (int itile=0; itile<ntiles; itile++) {
+        int ifirst = CBSDFT_setTile( h, itile );
+        int ilast = ifirst + CBSDFT_tileSamples(h);
+        for (int ifreq=0; ifreq<nfreq; ifreq++) {
+            int nkeep = NINT((float) tcount * (100-freject[ifreq])/100);
+            if (nkeep > tcount)
+                nkeep = tcount;
+            if (nkeep < 1)
+                nkeep = 1;
+            cwp_Bool skip = (freject[ifreq]==0.0 || (nkeep==tcount && (itype==SwMean || itype==SwMedian)));
+            cwp_Bool ranked = cwp_false;
+            for (int is=ifirst; is<ilast; is++) {
+                if (skip) {
+                    CBSDFT_passResult( h, is, ifreq );
+                    continue;
+                }
+                int icur = CBSDFT_getSlice( h, is, ifreq, specbuf );
+/* Ranks at this frequency change slowly with time so start from the order found at the previous sample */
+                if (!ranked) {
+                    for (int i=0; i<tcount; i++)
+                        idxbuf[i] = i;
+                    ranked = cwp_true;
+                }
+                if (filter_slice( tcount, nkeep, icur, itype, specbuf, ampbuf, idxbuf, keepbuf, &outval ))
+                    CBSDFT_passResult( h, is, ifreq );
+                else
+                    CBSDFT_setResult( h, is, ifreq, outval );
+            }
+        }
+        if (mode==1)
+            CBSDFT_getNoise( h, out );
+        else
+            CBSDFT_getResult( h, out );
+    }
+}
+
+/* Denoise trace itrc of the current output line of the 3D buffer and leave
+   the result in out */
+static void denoise3d( hLBSDFT h, int itrc, float* freject, proc_Type itype, int mode, complex* specbuf,
+                       float* ampbuf, int* idxbuf, int* keepbuf, segy* out )
+{
+    int nsamples = LBSDFT_samples(h);
+    int nfreq = LBSDFT_nfreq(h);
+    complex outval = cmplx(0.0,0.0);
+    int tcount = LBSDFT_setTrace( h, itrc );
+    for (int ifreq=0; ifreq<nfreq; ifreq++) {
+        int nkeep = NINT((float) tcount * (100-freject[ifreq])/100);
+        if (nkeep > tcount)
+            nkeep = tcount;
+        if (nkeep < 1)
+            nkeep = 1;
+        cwp_Bool skip = (freject[ifreq]==0.0 || (nkeep==tcount && (itype==SwMean || itype==SwMedian)));
+        cwp_Bool ranked = cwp_false;
+        for (int is=0; is<nsamples; is++) {
+            if (skip) {
+                LBSDFT_passResult( h, is, ifreq );
+                continue;
+            }
+            int icur = LBSDFT_getSlice( h, is, ifreq, specbuf );
+            if (!ranked) {
+                for (int i=0; i<tcount; i++)
+                    idxbuf[i] = i;
+                ranked = cwp_true;
+            }
+            if (filter_slice( tcount, nkeep, icur, itype, specbuf, ampbuf, idxbuf, keepbuf, &outval ))
+                LBSDFT_passResult( h, is, ifreq );
+            else
+                LBSDFT_setResult( h, is, ifreq, outval );
+        }
+    }
+    if (mode==1)
+        LBSDFT_getNoise( h, out );
+    else
+        LBSDFT_getResult( h, out );
+}
+
+/* Rank the amplitudes of the tcount values in specbuf, starting from the order
+   already in idxbuf, and compute the output value for the trace at icur.
+   Returns cwp_true if the current trace value is kept and should be passed
+   through unchanged, otherwise the replacement is left in outval. */
+static cwp_Bool filter_slice( int tcount, int nkeep, int icur, proc_Type itype, complex* specbuf,
+                              float* ampbuf, int* idxbuf, int* keepbuf, complex* outval )
+{
+    for (int i=0; i<tcount; i++)
+        ampbuf[i] = rcabs(specbuf[i]);
+    rank( tcount, nkeep, (itype==Median || itype==SwMedian), ampbuf, idxbuf );
+    for (int i=0; i<tcount; i++)
+        keepbuf[i] = 0;
+    for (int i=0; i<nkeep; i++)
+        keepbuf[idxbuf[i]] = 1;
+    if (keepbuf[icur] && (itype==SwMean || itype==SwMedian))
+        return cwp_true;
+    if (itype==Mean || itype==SwMean) {
+        complex sum = cmplx(0.0,0.0);
+        for (int i=0; i<tcount; i++)
+            if (keepbuf[i])
+                sum = cadd(sum, specbuf[i]);
+        *outval = crmul( sum, 1.0/(float)nkeep );
+    } else
+        *outval = specbuf[idxbuf[nkeep/2]];
+    return cwp_false;
+}
+
+/* Repair the amplitude order in idx so that the first nkeep entries are the
+   nkeep smallest amplitudes, and when sortkeep is set they are also in
+   ascending order. idx is expected to hold the order from a nearby sample so
+   an insertion sort is used, which is close to linear when few ranks change.
+   If the keep/reject partition is still valid the rejected entries are left
+   alone. */
+static void rank( int n, int nkeep, int sortkeep, float* amp, int* idx )
+{
+    int nsort = n;
+    if (nkeep < n) {
+        float kmax = amp[idx[0]];
+        float rmin = amp[idx[nkeep]];
+        for (int i=1; i<nkeep; i++)
+            kmax = MAX(kmax, amp[idx[i]]);
+        for (int i=nkeep+1; i<n; i++)
+            rmin = MIN(rmin, amp[idx[i]]);
+        if (kmax <= rmin) {
+            if (!sortkeep)
+                return;
+            nsort = nkeep;
+        }
+    } else if (!sortkeep)
+        return;
+
+    for (int i=1; i<nsort; i++) {
+        int itmp = idx[i];
+        float atmp = amp[itmp];
+        int j = i;
+        while (j>0 && amp[idx[j-1]] > atmp) {
+            idx[j] = idx[j-1];
+            j--;
+        }
+        idx[j] = itmp;
+    }
+}
+
+/* Denoise the current trace in the panel for every combination of reject set
+   and type, leaving the results in outtrs. One full sort of the amplitudes at
+   each time and frequency sample is shared by all the combinations. */
+static void denoise_sweep( hCBSDFT h, int nset, float** freject, int ntype, proc_Type* itypes, int mode,
+                           complex* specbuf, float* ampbuf, int* idxbuf, int* rankbuf, segy* outtrs )
+{
+    int ntiles = CBSDFT_tiles(h);
+    int nfreq = CBSDFT_nfreq(h);
+    int tcount = CBSDFT_traces(h);
+    int ncomb = nset*ntype;
+    complex outval = cmplx(0.0,0.0);
+    for (int itile=0; itile<ntiles; itile++) {
+        int ifirst = CBSDFT_setTile( h, itile );
+        int ilast = ifirst + CBSDFT_tileSamples(h);
+        for (int ifreq=0; ifreq<nfreq; ifreq++) {
+            cwp_Bool skip = cwp_true;
+            for (int iset=0; iset<nset; iset++)
+                skip = skip && freject[iset][ifreq]==0.0;
+            for (int is=ifirst; is<ilast; is++) {
+                if (skip) {
+                    for (int k=0; k<ncomb; k++) {
+                        CBSDFT_useResultSet( h, k );
+                        CBSDFT_passResult( h, is, ifreq );
+                    }
+                    continue;
+                }
+                int icur = CBSDFT_getSlice( h, is, ifreq, specbuf );
+                for (int i=0; i<tcount; i++) {
+                    idxbuf[i] = i;
+                    ampbuf[i] = rcabs(specbuf[i]);
+                }
+                qkisort( tcount, ampbuf, idxbuf );
+                for (int i=0; i<tcount; i++)
+                    rankbuf[idxbuf[i]] = i;
+                int irank = rankbuf[icur];
+                for (int iset=0; iset<nset; iset++) {
+                    int nkeep = NINT((float) tcount * (100-freject[iset][ifreq])/100);
+                    if (nkeep > tcount)
+                        nkeep = tcount;
+                    if (nkeep < 1)
+                        nkeep = 1;
+                    int imed = nkeep/2;
+                    cwp_Bool summed = cwp_false;
+                    complex mean = cmplx(0.0,0.0);
+                    for (int it=0; it<ntype; it++) {
+                        proc_Type itype = itypes[it];
+                        CBSDFT_useResultSet( h, iset*ntype+it );
+                        if (freject[iset][ifreq]==0.0 || ((itype==SwMean || itype==SwMedian) && irank<nkeep)) {
+                            CBSDFT_passResult( h, is, ifreq );
+                            continue;
+                        }
+/* Sum in trace order, as a single run does, so the results are the same */
+                        if (itype==Mean || itype==SwMean) {
+                            if (!summed) {
+                                complex sum = cmplx(0.0,0.0);
+                                for (int i=0; i<tcount; i++)
+                                    if (rankbuf[i] < nkeep)
+                                        sum = cadd(sum, specbuf[i]);
+                                mean = crmul( sum, 1.0/(float)nkeep );
+                                summed = cwp_true;
+                            }
+                            outval = mean;
+                        } else
+                            outval = specbuf[idxbuf[imed]];
+                        CBSDFT_setResult( h, is, ifreq, outval );
+                    }
+                }
+            }
+        }
+        for (int k=0; k<ncomb; k++) {
+            CBSDFT_useResultSet( h, k );
+            if (mode==1)
+                CBSDFT_getNoise( h, &outtrs[k] );
+            else
+                CBSDFT_getResult( h, &outtrs[k] );
+        }
+    }
+}
+
+/* Denoise the current trace in the SDCT panel and leave the result in out */
+static void denoise_sdct( hCBSDCT h, float reject, proc_Type itype, int mode, float* specbuf, float* ampbuf,
+                          int* idxbuf, segy* out )
+{
+    int nsamples = CBSDCT_samples(h);
+    int nfreq = CBSDCT_nfreq(h);
+    int tcount = CBSDCT_traces(h);
+    int nkeep = NINT((float) tcount * (100-reject)/100);
+    if (nkeep > tcount)
+        nkeep = tcount;
+    if (nkeep < 1)
+        nkeep = 1;
+    int imed = nkeep/2;
+    float inv_nkeep = 1.0/(float)nkeep;
+    cwp_Bool skip = (reject==0.0 || (nkeep==tcount && (itype==SwMean || itype==SwMedian)));
+    float outval = 0.0;
+    for (int ifreq=0; ifreq<nfreq; ifreq++) {
+        for (int is=0; is<nsamples; is++) {
+            if (skip) {
+                CBSDCT_passResult( h, is, ifreq );
+                continue;
+            }
+            int icur = CBSDCT_getSlice( h, is, ifreq, specbuf );
+            for (int i=0; i<tcount; i++) {
+                idxbuf[i] = i;
+                ampbuf[i] = ABS(specbuf[i]);
+            }
+            if (nkeep < tcount)
+                qkifind( nkeep, tcount, ampbuf, idxbuf );
+            cwp_Bool keep = cwp_false;
+            if (itype==SwMean || itype==SwMedian) {
+                for (int i=0; i<nkeep; i++) {
+                    if (idxbuf[i] == icur) {
+                        keep = cwp_true;
+                        break;
+                    }
+                }
+            }
+            if (keep) {
+                CBSDCT_passResult( h, is, ifreq );
+                continue;
+            }
+            if (itype==Mean || itype==SwMean) {
+                outval = 0.0;
+                for (int i=0; i<nkeep; i++)
+                    outval += specbuf[idxbuf[i]];
+                outval *= inv_nkeep;
+            } else {
+                qkifind( imed, nkeep, ampbuf, idxbuf );
+                outval = specbuf[idxbuf[imed]];
+            }
+            CBSDCT_setResult( h, is, ifreq, outval );
+        }
+    }
+    if (mode==1)
+        CBSDCT_getNoise( h, out );
+    else
+        CBSDCT_getResult( h, out );
+}
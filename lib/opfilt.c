@@ -0,0 +1,436 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+OPFILT - rolling trace filter operators
+
+OP_trcmedian    create a rolling median operator, as sutrcmedian
+OP_ctrcmedian   create a rolling median operator, as suctrcmedian
+OP_lpasmooth    create a rolling LPA smoothing operator, as sulpasmooth
+
+**************************************************************************
+Function Prototypes:
+hOP OP_trcmedian(int npar, char** par);
+hOP OP_ctrcmedian(int npar, char** par);
+hOP OP_lpasmooth(int npar, char** par);
+
+**************************************************************************
+Input:
+npar        number of parameters
+par         array of parameters as name=value strings
+
+Returned: operator handle
+
+**************************************************************************
+Notes:
+OP_trcmedian uses an ordered trace buffer, OTB, and OP_ctrcmedian a cyclic
+trace buffer, CTB, so they differ in the same way as the programs at the
+ends of the data. The buffer is created when the first trace is pushed and
+the traces left in it are output after OP_flush. See OP for how operators
+are used.
+
+The medians filter seismic traces or the spectra output by susdft and
+susdct, so they also run between the transforms in a chain. The first
+trace of either kind fixes the kind filtered and traces of any other kind
+are skipped. The window runs over consecutive traces of the stream, for
+spectra that is across the traces for the frequencies of an input trace.
+
+OP_lpasmooth is the core of sulpasmooth. Each trace is filtered along time
+by every separable term of the kernel as it is pushed. With key1= whole
+lines are buffered with LBLPA, a trace that starts a new line completes the
+line before it and is only added to the buffer once the traces of the
+completed line have all been pulled. Non-seismic traces are skipped. With
+verbose=1 the filter throughput is reported when the operator is freed.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "su.h"
+#include "segy.h"
+#include "header.h"
+#include "sux.h"
+
+typedef struct {
+    int ntr;
+    int mode;
+    int verbose;
+    int cyclic;
+    int nsamples;
+    int kind;
+    int ready;
+    hOTB otb;
+    hCTB ctb;
+    float* databuf;
+    segy out;
+} _OPFILT;
+
+static _OPFILT* initState( const char* name, int npar, char** par, int cyclic );
+static void freeState( void* state );
+static void medianPush( void* state, const segy* const tr );
+static segy* medianPull( void* state, int flush );
+static void median( _OPFILT* s );
+static int traceKind( int trid );
+static void lpaFree( void* state );
+static void lpaPush( void* state, const segy* const tr );
+static segy* lpaPull( void* state, int flush );
+static void smooth( hLPA h, hOTB otbH, hOTB* fbufs, int mode, int nsamples, segy* out );
+
+hOP OP_trcmedian( int npar, char** par ) {
+    _OPFILT* s = initState( "sutrcmedian", npar, par, 0 );
+    return OP_new( "sutrcmedian", s, medianPush, medianPull, freeState );
+}
+
+hOP OP_ctrcmedian( int npar, char** par ) {
+    _OPFILT* s = initState( "suctrcmedian", npar, par, 1 );
+    return OP_new( "suctrcmedian", s, medianPush, medianPull, freeState );
+}
+
+static _OPFILT* initState( const char* name, int npar, char** par, int cyclic ) {
+    _OPFILT* s = emalloc(sizeof(_OPFILT));
+    if (!OP_getint( npar, par, "verbose", &s->verbose )) s->verbose = 0;
+    if (!OP_getint( npar, par, "ntr", &s->ntr )) s->ntr = 5;
+    if (s->ntr%2==0) {
+        s->ntr++;
+        if (s->verbose)
+            warn("%s: adjusting ntr to be odd, was %d now %d", name, s->ntr-1, s->ntr);
+    }
+    if (!OP_getint( npar, par, "mode", &s->mode )) s->mode = 0;
+    s->cyclic = cyclic;
+    s->nsamples = 0;
+    s->kind = 0;
+    s->ready = 0;
+    s->otb = 0;
+    s->ctb = 0;
+    s->databuf = 0;
+    return s;
+}
+
+static void freeState( void* state ) {
+    _OPFILT* s = (_OPFILT*) state;
+    if (s->otb) OTB_free( s->otb );
+    if (s->ctb) CTB_free( s->ctb );
+    if (s->databuf) free1float( s->databuf );
+    free( s );
+}
+
+static void medianPush( void* state, const segy* const tr ) {
+    _OPFILT* s = (_OPFILT*) state;
+    int kind = traceKind( tr->trid );
+    if (!kind || (s->kind && kind!=s->kind)) {
+        if (s->verbose)
+            warn("skipping trace with trid=%d", tr->trid);
+        return;
+    }
+    if (!s->databuf) {
+        s->kind = kind;
+        s->nsamples = tr->ns;
+        if (s->nsamples==0)
+            err("zero length traces not allowed.");
+        s->databuf = ealloc1float( s->ntr );
+        if (s->cyclic)
+            s->ctb = CTB_init( s->ntr, s->nsamples );
+        else
+            s->otb = OTB_init( s->ntr, s->nsamples );
+    }
+    s->ready = s->cyclic? CTB_push( s->ctb, tr ) : OTB_push( s->otb, tr );
+    if (s->ready)
+        median( s );
+}
+
+/* After a flush each pull pushes an empty trace to output the traces left
+   in the buffer */
+static segy* medianPull( void* state, int flush ) {
+    _OPFILT* s = (_OPFILT*) state;
+    if (!s->ready && flush && s->databuf) {
+        s->ready = s->cyclic? CTB_push( s->ctb, 0 ) : OTB_push( s->otb, 0 );
+        if (s->ready)
+            median( s );
+    }
+    if (!s->ready)
+        return 0;
+    s->ready = 0;
+    return &s->out;
+}
+
+/* Kind of trace the medians filter, all seismic traces are one kind and each
+   type of spectrum from the transforms another, 0 for any other trace */
+static int traceKind( int trid ) {
+    if (ISSEISMIC(trid))
+        return TREAL;
+    if (trid==FUNPACKNYQ || trid==REALPART || trid==IMAGPART || trid==AMPLITUDE || trid==PHASE)
+        return trid;
+    return 0;
+}
+
+/* Median, or the noise when mode=1, of the current trace buffer */
+static void median( _OPFILT* s ) {
+    int tcount = s->cyclic? CTB_traces( s->ctb ) : OTB_traces( s->otb );
+    int imed = tcount/2;
+    for (int is=0; is<s->nsamples; is++) {
+        int icur = s->cyclic? CTB_getSlice( s->ctb, is, s->databuf ) : OTB_getSlice( s->otb, is, s->databuf );
+        float curval = s->databuf[icur];
+        qkfind( imed, tcount, s->databuf );
+        s->out.data[is] = (s->mode==1)? curval - s->databuf[imed]: s->databuf[imed];
+    }
+    if (s->cyclic)
+        CTB_copyCurrentHdr( s->ctb, &s->out );
+    else
+        OTB_copyCurrentHdr( s->otb, &s->out );
+}
+
+typedef struct {
+    int ntr;
+    int nsize;
+    int order;
+    cwp_String key1Type;
+    cwp_String key2Type;
+    int key1Index;
+    int key2Index;
+    int nil;
+    int dkey2;
+    int mode;
+    int verbose;
+    int nsamples;
+    int nterm;
+    int ready;
+    int line;       /* key1 of the line being pushed         */
+    int first;
+    int pending;    /* pend starts a line and is not pushed  */
+    int pkey2;
+    int itrc;       /* next trace of the completed line      */
+    int ntrc;       /* traces in the completed line          */
+    int done;
+    int ntrout;
+    float tfilt;
+    hLPA lpa;
+    hOTB otb;
+    hOTB* fbufs;
+    hLBLPA lblpa;
+    segy ftr;
+    segy pend;
+    segy out;
+} _OPLPA;
+
+hOP OP_lpasmooth( int npar, char** par ) {
+    _OPLPA* s = emalloc(sizeof(_OPLPA));
+    char* key1;
+    char* key2;
+
+    if (!OP_getint( npar, par, "mode", &s->mode )) s->mode = 0;
+    if (!OP_getint( npar, par, "verbose", &s->verbose )) s->verbose = 0;
+    if (!OP_getint( npar, par, "ntr", &s->ntr )) s->ntr = 5;
+    if (s->ntr%2==0) {
+        s->ntr++;
+        if (s->verbose)
+            warn("sulpasmooth: adjusting ntr to be odd, was %d now %d", s->ntr-1, s->ntr);
+    }
+    if (!OP_getint( npar, par, "nsize", &s->nsize )) s->nsize = 5;
+    if (s->nsize%2==0) {
+        s->nsize++;
+        if (s->verbose)
+            warn("sulpasmooth: adjusting nsize to be odd, was %d now %d", s->nsize-1, s->nsize);
+    }
+    if (!OP_getint( npar, par, "order", &s->order )) s->order = 2;
+    if (s->order<1 || s->order>3)
+        err("sulpasmooth: order=%d out of range 1-3", s->order);
+    if (!OP_getstring( npar, par, "key1", &key1 )) key1 = NULL;
+    if (!OP_getstring( npar, par, "key2", &key2 )) key2 = "tracf";
+    if (!OP_getint( npar, par, "nil", &s->nil )) s->nil = 5;
+    if (s->nil%2==0) {
+        s->nil++;
+        if (s->verbose)
+            warn("sulpasmooth: adjusting nil to be odd, was %d now %d", s->nil-1, s->nil);
+    }
+    if (!OP_getint( npar, par, "dkey2", &s->dkey2 )) s->dkey2 = 1;
+    s->key1Type = 0;
+    s->key2Type = 0;
+    s->key1Index = 0;
+    s->key2Index = 0;
+    if (key1) {
+        s->key1Type = hdtype(key1);
+        s->key1Index = getindex(key1);
+        s->key2Type = hdtype(key2);
+        s->key2Index = getindex(key2);
+        if (s->key1Index<0 || s->key2Index<0)
+            err("sulpasmooth: unknown header key in key1=%s or key2=%s", key1, key2);
+    }
+
+/* The kernel doesn't depend on the traces so it is set up now */
+    if (key1)
+        s->lpa = LPA_init3D( s->nil, s->ntr, s->nsize, s->order );
+    else
+        s->lpa = LPA_init( s->ntr, s->nsize, s->order );
+    s->nterm = LPA_rank( s->lpa );
+    if (s->verbose) {
+        if (key1)
+            warn("%dx%dx%d order %d LPA kernel applied as %d separable terms", s->nil, s->ntr, s->nsize, s->order, s->nterm);
+        else
+            warn("%dx%d order %d LPA kernel applied as %d separable terms", s->ntr, s->nsize, s->order, s->nterm);
+    }
+    s->nsamples = 0;
+    s->ready = 0;
+    s->line = 0;
+    s->first = 1;
+    s->pending = 0;
+    s->pkey2 = 0;
+    s->itrc = 0;
+    s->ntrc = 0;
+    s->done = 0;
+    s->ntrout = 0;
+    s->tfilt = 0.0;
+    s->otb = 0;
+    s->fbufs = 0;
+    s->lblpa = 0;
+    return OP_new( "sulpasmooth", s, lpaPush, lpaPull, lpaFree );
+}
+
+static void lpaFree( void* state ) {
+    _OPLPA* s = (_OPLPA*) state;
+    if (s->verbose && s->nsamples) {
+        float msamples = (float) s->ntrout*s->nsamples/1.0e6;
+        warn("filtered %d traces of %d samples in %.3f cpu sec", s->ntrout, s->nsamples, s->tfilt);
+        if (s->tfilt>0.0)
+            warn("throughput %.2f Msamples/sec", msamples/s->tfilt);
+    }
+    if (s->fbufs) {
+        for (int k=0; k<s->nterm; k++)
+            OTB_free( s->fbufs[k] );
+        free1( s->fbufs );
+    }
+    if (s->otb) OTB_free( s->otb );
+    if (s->lblpa) LBLPA_free( s->lblpa );
+    LPA_free( s->lpa );
+    free( s );
+}
+
+static void lpaPush( void* state, const segy* const tr ) {
+    _OPLPA* s = (_OPLPA*) state;
+    if (!ISSEISMIC(tr->trid)) {
+        if (s->verbose)
+            warn("skipping non-seismic trace with trid=%d", tr->trid);
+        return;
+    }
+    if (!s->nsamples) {
+        s->nsamples = tr->ns;
+        if (s->nsamples==0)
+            err("sulpasmooth: zero length traces not allowed.");
+        if (s->key1Type)
+            s->lblpa = LBLPA_init( s->lpa, s->dkey2, s->nsamples );
+        else {
+            s->otb = OTB_init( s->ntr, s->nsamples );
+            s->fbufs = ealloc1( s->nterm, sizeof(hOTB) );
+            for (int k=0; k<s->nterm; k++)
+                s->fbufs[k] = OTB_init( s->ntr, s->nsamples );
+        }
+    }
+    float t0 = (s->verbose)? cpusec() : 0.0;
+    if (s->lblpa) {
+/* A change in key1 marks the start of a new line */
+        Value keyVal;
+        gethval(tr, s->key1Index, &keyVal);
+        int iline = vtoi(s->key1Type, keyVal);
+        int endline = (!s->first && iline!=s->line && LBLPA_endLine(s->lblpa));
+        s->line = iline;
+        s->first = 0;
+        gethval(tr, s->key2Index, &keyVal);
+        if (endline) {
+            s->itrc = 0;
+            s->ntrc = LBLPA_traces( s->lblpa );
+            memcpy( (void*)&s->pend, (void*)tr, HDRBYTES + s->nsamples*FSIZE );
+            s->pkey2 = vtoi(s->key2Type, keyVal);
+            s->pending = 1;
+        } else
+            LBLPA_push( s->lblpa, tr, vtoi(s->key2Type, keyVal) );
+    } else {
+        s->ready = OTB_push( s->otb, tr );
+        for (int k=0; k<s->nterm; k++) {
+            LPA_filterTime( s->lpa, k, s->nsamples, tr->data, s->ftr.data );
+            OTB_push( s->fbufs[k], &s->ftr );
+        }
+    }
+    if (s->verbose) s->tfilt += cpusec() - t0;
+}
+
+/* Traces are smoothed as they are pulled. The traces of a completed line
+   are output one at a time, after the last of them the held back trace that
+   started the next line goes in the buffer. */
+static segy* lpaPull( void* state, int flush ) {
+    _OPLPA* s = (_OPLPA*) state;
+    float t0 = (s->verbose)? cpusec() : 0.0;
+    segy* out = 0;
+    if (s->lblpa) {
+        for (;;) {
+            if (s->itrc < s->ntrc) {
+                if (s->mode==1)
+                    LBLPA_getNoise( s->lblpa, s->itrc, &s->out );
+                else
+                    LBLPA_getResult( s->lblpa, s->itrc, &s->out );
+                s->itrc++;
+                out = &s->out;
+                break;
+            }
+            if (s->pending) {
+                LBLPA_push( s->lblpa, &s->pend, s->pkey2 );
+                s->pending = 0;
+            }
+            if (!flush || s->done)
+                break;
+            if (!LBLPA_endLine( s->lblpa )) {
+                s->done = 1;
+                break;
+            }
+            s->itrc = 0;
+            s->ntrc = LBLPA_traces( s->lblpa );
+        }
+    } else {
+        if (!s->ready && flush && s->otb) {
+            s->ready = OTB_push( s->otb, 0 );
+            if (s->ready)
+                for (int k=0; k<s->nterm; k++)
+                    OTB_push( s->fbufs[k], 0 );
+        }
+        if (s->ready) {
+            smooth( s->lpa, s->otb, s->fbufs, s->mode, s->nsamples, &s->out );
+            s->ready = 0;
+            out = &s->out;
+        }
+    }
+    if (s->verbose) s->tfilt += cpusec() - t0;
+    if (out)
+        s->ntrout++;
+    return out;
+}
+
+/* Filter the current trace in the buffer and leave the result in out. Each
+   buffer in fbufs holds the traces already filtered along time by one
+   separable term of the kernel, so only the pass across traces remains. */
+static void smooth( hLPA h, hOTB otbH, hOTB* fbufs, int mode, int nsamples, segy* out )
+{
+    int nterm = LPA_rank(h);
+    int ntr = LPA_traces(h);
+    float* restrict outdata = out->data;
+    for (int is=0; is<nsamples; is++)
+        outdata[is] = 0.0;
+    for (int k=0; k<nterm; k++) {
+        const float* xfilt = LPA_traceFilter( h, k );
+        for (int itrc=0; itrc<ntr; itrc++) {
+            float w = xfilt[itrc];
+            if (w==0.0)
+                continue;
+            const float* restrict data = OTB_getTrace( fbufs[k], itrc );
+            for (int is=0; is<nsamples; is++)
+                outdata[is] += w*data[is];
+        }
+    }
+    if (mode==1) {
+        const float* restrict data = OTB_getTrace( otbH, ntr/2 );
+        for (int is=0; is<nsamples; is++)
+            outdata[is] = data[is] - outdata[is];
+    }
+    OTB_copyCurrentHdr( otbH, out );
+}
@@ -0,0 +1,501 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+OPTRANS - sliding transform trace operators
+
+OP_sdft         create a sliding DFT operator, as susdft
+OP_isdft        create an inverse sliding DFT operator, as suisdft
+OP_sdct         create a sliding DCT operator, as susdct
+OP_isdct        create an inverse sliding DCT operator, as suisdct
+
+**************************************************************************
+Function Prototypes:
+hOP OP_sdft(int npar, char** par);
+hOP OP_isdft(int npar, char** par);
+hOP OP_sdct(int npar, char** par);
+hOP OP_isdct(int npar, char** par);
+
+**************************************************************************
+Input:
+npar        number of parameters
+par         array of parameters as name=value strings
+
+Returned: operator handle
+
+**************************************************************************
+Notes:
+The forward transforms output one trace per frequency for each input trace
+and the inverse transforms collect the traces for all frequencies of an
+input trace before outputting it. These are the cores of the programs of
+the same name. See OP for how operators are used.
+
+OP_sdft transforms each trace in chunks with SSDFT and, with maxns=, outputs
+it in time segments of maxns samples, each segment as one trace per
+frequency with delrt set to the segment start. A segment is transformed as
+its traces are pulled so the operator holds a copy of the input trace and
+the spectra of one segment, not of the whole trace. Complex output is split
+into segments of SU_NFLTS/2 samples when it would not fit in a trace. The
+input traces can differ in length.
+
+OP_isdft takes the segments in that order, inverts each one and joins them
+back into the whole trace. A segment is appended when its delrt is where the
+trace being joined ends and tracl, fldr, tracf, cdp and offset match, so a
+trace is output when the first segment of the next trace arrives or the
+input ends. The segments of a trace can differ in length only in the last.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+#define CPLX    1
+#define REAL    2
+#define IMAG    3
+#define AMP     4
+#define ARG     5
+
+#define NCHUNK  1000    /* samples transformed at a time, not a power of 2 so
+                           the rows of the chunk spectra don't share cache sets */
+
+typedef struct {
+    int nwin;
+    int imode;
+    sux_Window iwind;
+    float dt;
+    int verbose;
+    int nt;
+    int nf;
+    float df;
+    int ifreq;
+    int tracr;
+    int maxns;
+    int nseg;       /* samples per output segment          */
+    int nalloc;     /* samples per trace allocated in rspec or cspec */
+    int iin;        /* next input sample to transform      */
+    int iout;       /* first sample of the next segment    */
+    int nout;       /* samples in the current segment      */
+    int ispec;      /* first spectrum in cspec not output  */
+    int nspec;      /* spectra in cspec not output         */
+    int flushed;
+    int ready;      /* out holds a joined trace not yet pulled */
+    short delrt;
+    float* data;
+    hSDFT sdft;
+    hSSDFT ssdft;
+    hSDCT sdct;
+    complex** cspec;
+    float** rspec;
+    segy out;
+    segy acc;       /* trace being joined from segments    */
+} _OPTRANS;
+
+static _OPTRANS* initState( const char* name, int npar, char** par, int forward );
+static void freeState( void* state );
+static void sdftPush( void* state, const segy* const tr );
+static segy* sdftPull( void* state, int flush );
+static int nextSegment( _OPTRANS* s );
+static void spectraToTraces( int imode, int nf, int n, complex** spec, int j0, int i0, float** out );
+static void isdftPush( void* state, const segy* const tr );
+static segy* isdftPull( void* state, int flush );
+static int continues( const _OPTRANS* s, const segy* const tr );
+static void joined( _OPTRANS* s );
+static void sdctPush( void* state, const segy* const tr );
+static segy* sdctPull( void* state, int flush );
+static void isdctPush( void* state, const segy* const tr );
+static segy* inversePull( void* state, int flush );
+
+hOP OP_sdft( int npar, char** par ) {
+    _OPTRANS* s = initState( "susdft", npar, par, 1 );
+    char* mode;
+    if (!OP_getstring( npar, par, "mode", &mode )) mode = "complex";
+    if      (STREQ(mode, "phase")) s->imode = ARG;
+    else if (STREQ(mode, "real"))  s->imode = REAL;
+    else if (STREQ(mode, "imag"))  s->imode = IMAG;
+    else if (STREQ(mode, "amp"))   s->imode = AMP;
+    else if (!STREQ(mode, "complex"))
+        err("susdft: unknown mode=\"%s\"", mode);
+    if (!OP_getint( npar, par, "maxns", &s->maxns )) s->maxns = 0;
+    if (s->maxns < 0)
+        err("susdft: maxns=%d must not be negative", s->maxns);
+    return OP_new( "susdft", s, sdftPush, sdftPull, freeState );
+}
+
+hOP OP_isdft( int npar, char** par ) {
+    _OPTRANS* s = initState( "suisdft", npar, par, 0 );
+    return OP_new( "suisdft", s, isdftPush, isdftPull, freeState );
+}
+
+hOP OP_sdct( int npar, char** par ) {
+    _OPTRANS* s = initState( "susdct", npar, par, 1 );
+    return OP_new( "susdct", s, sdctPush, sdctPull, freeState );
+}
+
+hOP OP_isdct( int npar, char** par ) {
+    _OPTRANS* s = initState( "suisdct", npar, par, 0 );
+    return OP_new( "suisdct", s, isdctPush, inversePull, freeState );
+}
+
+/* Parameters common to all the transforms */
+static _OPTRANS* initState( const char* name, int npar, char** par, int forward ) {
+    _OPTRANS* s = emalloc(sizeof(_OPTRANS));
+    char* window;
+    if (!OP_getint( npar, par, "verbose", &s->verbose )) s->verbose = 0;
+    if (!OP_getint( npar, par, "nwin", &s->nwin )) {
+        if (forward)
+            s->nwin = 31;
+        else
+            err("%s: nwin must be specified", name);
+    }
+    if (s->nwin%2==0) {
+        s->nwin++;
+        if (s->verbose)
+            warn("%s: adjusting nwin to be odd, was %d now %d", name, s->nwin-1, s->nwin);
+    }
+    if (!OP_getfloat( npar, par, "dt", &s->dt )) s->dt = 0.0;
+    if (!OP_getstring( npar, par, "window", &window )) window = "none";
+    if      (STREQ(window, "hann")) s->iwind = Hann;
+    else if (STREQ(window, "hamming")) s->iwind = Hamming;
+    else if (STREQ(window, "blackman")) s->iwind = Blackman;
+    else if (STREQ(window, "none")) s->iwind = None;
+    else
+        err("%s: unknown window=\"%s\"", name, window);
+    s->imode = CPLX;
+    s->nt = 0;
+    s->nf = 0;
+    s->ifreq = 0;
+    s->tracr = 0;
+    s->nalloc = 0;
+    s->ready = 0;
+    s->acc.ns = 0;
+    s->sdft = 0;
+    s->ssdft = 0;
+    s->sdct = 0;
+    s->cspec = 0;
+    s->rspec = 0;
+    s->data = 0;
+    return s;
+}
+
+static void freeState( void* state ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (s->sdft) SDFT_free( s->sdft );
+    if (s->ssdft) SSDFT_free( s->ssdft );
+    if (s->sdct) SDCT_free( s->sdct );
+    if (s->cspec) free2complex( s->cspec );
+    if (s->rspec) free2float( s->rspec );
+    if (s->data) free1float( s->data );
+    free( s );
+}
+
+/* Sample interval from the parameters or the first trace */
+static void getDt( _OPTRANS* s, const segy* const tr, const char* name ) {
+    if (s->dt == 0.0)
+        s->dt = ((double) tr->dt)/1000000.0;
+    if (s->dt == 0.0)
+        err("%s: dt field is zero and not given", name);
+}
+
+static void sdftPush( void* state, const segy* const tr ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (!ISSEISMIC(tr->trid)) {
+        if (s->verbose)
+            warn("susdft: ignoring input trace=%d with non-seismic trcid=%d", tr->tracl, tr->trid);
+        return;
+    }
+    if (!s->ssdft) {
+        getDt( s, tr, "susdft" );
+        s->nf = s->nwin/2+1;
+        s->df = 1.0/(s->nwin*s->dt);
+        s->ssdft = SSDFT_init( s->nwin, s->iwind );
+        s->cspec = ealloc2complex( MAX(NCHUNK, s->nf), s->nf );
+        s->data = ealloc1float( SU_NFLTS );
+    }
+/* Traces can differ in length so the segments are sized for each one */
+    s->nt = tr->ns;
+    s->nseg = (s->maxns>0)? MIN(s->maxns, s->nt) : s->nt;
+    if (s->imode==CPLX && 2*s->nseg > SU_NFLTS) {
+        s->nseg = SU_NFLTS/2;
+        if (s->verbose && !s->rspec)
+            warn("susdft: complex output split into segments of %d samples", s->nseg);
+    }
+    if (s->nseg > s->nalloc) {
+        if (s->rspec) free2float( s->rspec );
+        s->nalloc = s->nseg;
+        s->rspec = ealloc2float( (s->imode==CPLX)? 2*s->nalloc : s->nalloc, s->nf );
+    }
+    memcpy( (void*)s->data, (void*)tr->data, s->nt*FSIZE );
+    memcpy( (void*)&s->out, (void*)tr, HDRBYTES );
+    s->iin = 0;
+    s->iout = 0;
+    s->ispec = 0;
+    s->nspec = 0;
+    s->flushed = 0;
+    s->ifreq = s->nf;
+}
+
+/* Output traces for a segment of the spectra are only computed once the
+   traces of the previous segment have all been pulled */
+static segy* sdftPull( void* state, int flush ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (s->ifreq >= s->nf) {
+        if (!nextSegment( s ))
+            return 0;
+        s->ifreq = 0;
+    }
+    segy* tr = &s->out;
+    tr->ns = (s->imode==CPLX)? 2*s->nout : s->nout;
+    memcpy( (void*)tr->data, (void*)s->rspec[s->ifreq], tr->ns*FSIZE );
+    switch (s->imode) {
+        case CPLX: tr->trid = FUNPACKNYQ; break;
+        case REAL: tr->trid = REALPART; break;
+        case IMAG: tr->trid = IMAGPART; break;
+        case AMP:  tr->trid = AMPLITUDE; break;
+        case ARG:  tr->trid = PHASE; break;
+    }
+    s->ifreq++;
+    tr->d1 = s->dt;
+    tr->tracr = s->ifreq;
+    tr->gx = tr->tracr;
+    tr->f2 = 0.0;
+    tr->d2 = s->df;
+    return tr;
+}
+
+/* Transform the buffered trace until the output traces hold the spectra of
+   the next nseg samples or the end of the trace. The input is pushed in
+   chunks no bigger than the space left in the segment, so only the spectra
+   from the final flush can overrun it, those are kept in cspec for the
+   next segment. Returns 0 when the whole trace has been output. */
+static int nextSegment( _OPTRANS* s ) {
+    if (!s->ssdft)
+        return 0;
+    int nout = 0;
+    while (nout < s->nseg) {
+        if (s->nspec == 0) {
+            if (s->iin < s->nt) {
+                int n = MIN(MIN(NCHUNK, s->nseg-nout), s->nt-s->iin);
+                s->nspec = SSDFT_push( s->ssdft, n, s->data+s->iin, s->cspec );
+                s->iin += n;
+            } else if (!s->flushed) {
+                s->nspec = SSDFT_flush( s->ssdft, s->cspec );
+                s->flushed = 1;
+            } else
+                break;
+            s->ispec = 0;
+            continue;
+        }
+        int n = MIN(s->nspec, s->nseg-nout);
+        spectraToTraces( s->imode, s->nf, n, s->cspec, s->ispec, nout, s->rspec );
+        s->ispec += n;
+        s->nspec -= n;
+        nout += n;
+    }
+    if (nout == 0)
+        return 0;
+/* Each segment starts at its own time */
+    if (s->iout) {
+        float delrt = s->delrt + 1000.0*s->iout*s->dt;
+        if (delrt > SHRT_MAX)
+            err("susdft: segment start of %g ms is too large for delrt", delrt);
+        s->out.delrt = NINT(delrt);
+    } else
+        s->delrt = s->out.delrt;
+    s->iout += nout;
+    s->nout = nout;
+    return 1;
+}
+
+/* Store n samples of spectra from column j0 in the output traces from sample i0 on */
+static void spectraToTraces( int imode, int nf, int n, complex** spec, int j0, int i0, float** out ) {
+    for (int i=0; i<nf; i++) {
+        const complex* sp = spec[i] + j0;
+        switch (imode) {
+            case CPLX:
+                for (int j=0; j<n; j++) {
+                    out[i][2*(i0+j)] = sp[j].r;
+                    out[i][2*(i0+j)+1] = sp[j].i;
+                }
+                break;
+            case REAL:
+                for (int j=0; j<n; j++)
+                    out[i][i0+j] = sp[j].r;
+                break;
+            case IMAG:
+                for (int j=0; j<n; j++)
+                    out[i][i0+j] = sp[j].i;
+                break;
+            case AMP:
+                for (int j=0; j<n; j++) {
+                    float re = sp[j].r;
+                    float im = sp[j].i;
+                    out[i][i0+j] = (float) sqrt( re*re + im*im );
+                }
+                break;
+            case ARG:
+                for (int j=0; j<n; j++) {
+                    float re = sp[j].r;
+                    float im = sp[j].i;
+                    out[i][i0+j] = (re*re+im*im)? atan2(im,re) : 0.0;
+                }
+                break;
+        }
+    }
+}
+
+/* Each segment of spectra from susdft is inverted when its last frequency
+   arrives and appended to the trace being joined. A segment continues that
+   trace when its delrt is where the trace ends and its header keys match.
+   The joined trace is ready once a segment does not continue it, a segment
+   shorter than the first ends it, or the input ends. */
+static void isdftPush( void* state, const segy* const tr ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (tr->trid != FUNPACKNYQ)
+        err("suisdft: expecting complex trace but got trcid=%d", tr->trid);
+    if (!s->sdft) {
+        getDt( s, tr, "suisdft" );
+        s->nf = s->nwin/2+1;
+        s->sdft = SDFT_init( s->nwin, 0 );
+    }
+    int n = tr->ns/2;
+    if (s->ifreq == 0) {
+        if (s->acc.ns && !continues( s, tr ))
+            joined( s );
+        if (!s->acc.ns)
+            s->nseg = n;
+        if (n > s->nalloc) {
+            if (s->cspec) free2complex( s->cspec );
+            s->nalloc = n;
+            s->cspec = ealloc2complex( s->nalloc, s->nf );
+        }
+        s->nout = n;
+    } else if (n != s->nout)
+        err("suisdft: frequency trace %d of a segment has %d samples, expected %d",
+            s->ifreq+1, n, s->nout);
+    for (int j=0; j<n; j++)
+        s->cspec[s->ifreq][j] = cmplx( tr->data[2*j], tr->data[2*j+1] );
+    if (++s->ifreq == s->nf) {
+        if (s->acc.ns + n > SU_NFLTS)
+            err("suisdft: joined trace has more than %d samples", SU_NFLTS);
+        if (!s->acc.ns) {
+            memcpy( (void*)&s->acc, (void*)tr, HDRBYTES );
+            s->acc.ns = 0;
+        }
+        for (int j=0; j<n; j++)
+            s->acc.data[s->acc.ns+j] = ISDFT_sample( s->sdft, s->cspec, j );
+        s->acc.ns += n;
+        s->ifreq = 0;
+        if (n < s->nseg)
+            joined( s );
+    }
+}
+
+static segy* isdftPull( void* state, int flush ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (flush && !s->ready) {
+        if (s->ifreq && s->verbose)
+            warn("suisdft: input ends after %d of %d frequencies of a segment", s->ifreq, s->nf);
+        s->ifreq = 0;
+        if (s->acc.ns)
+            joined( s );
+    }
+    if (!s->ready)
+        return 0;
+    s->ready = 0;
+    return &s->out;
+}
+
+/* A segment continues the joined trace when it starts at the next sample,
+   susdft rounds the segment start to whole ms in the same way */
+static int continues( const _OPTRANS* s, const segy* const tr ) {
+    const segy* acc = &s->acc;
+    float delrt = acc->delrt + 1000.0*acc->ns*s->dt;
+    return tr->delrt == NINT(delrt) && tr->tracl == acc->tracl &&
+           tr->fldr == acc->fldr && tr->tracf == acc->tracf &&
+           tr->cdp == acc->cdp && tr->offset == acc->offset;
+}
+
+/* Move the joined trace to the output */
+static void joined( _OPTRANS* s ) {
+    memcpy( (void*)&s->out, (void*)&s->acc, HDRBYTES+s->acc.ns*FSIZE );
+    s->out.tracr = ++s->tracr;
+    s->out.trid = TREAL;
+    s->out.f1 = 0.0f;
+    s->out.d2 = 0.0f;
+    s->acc.ns = 0;
+    s->ready = 1;
+}
+
+static void sdctPush( void* state, const segy* const tr ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (!ISSEISMIC(tr->trid)) {
+        if (s->verbose)
+            warn("susdct: ignoring input trace=%d with non-seismic trcid=%d", tr->tracl, tr->trid);
+        return;
+    }
+    if (!s->sdct) {
+        getDt( s, tr, "susdct" );
+        s->nt = tr->ns;
+        s->nf = s->nwin;
+        s->df = 1.0/(2.0*s->nwin*s->dt);
+        s->sdct = SDCT_init( s->nwin, s->nt );
+        s->rspec = ealloc2float( s->nt, s->nf );
+    }
+    SDCT( s->sdct, s->iwind, (float*) tr->data, s->rspec );
+    memcpy( (void*)&s->out, (void*)tr, HDRBYTES );
+    s->ifreq = 0;
+}
+
+static segy* sdctPull( void* state, int flush ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (s->ifreq >= s->nf)
+        return 0;
+    segy* tr = &s->out;
+    memcpy( (void*)tr->data, (void*)s->rspec[s->ifreq], s->nt*FSIZE );
+    s->ifreq++;
+    tr->trid = AMPLITUDE;
+    tr->d1 = s->dt;
+    tr->tracr = s->ifreq;
+    tr->gx = tr->tracr;
+    tr->f2 = 0.0;
+    tr->d2 = s->df;
+    return tr;
+}
+
+static void isdctPush( void* state, const segy* const tr ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (!s->sdct) {
+        getDt( s, tr, "suisdct" );
+        if (tr->trid != AMPLITUDE)
+            err("suisdct: expecting AMPLITUDE trace but got trcid=%d", tr->trid);
+        s->nt = tr->ns;
+        s->nf = s->nwin;
+        s->sdct = SDCT_init( s->nwin, s->nt );
+        s->rspec = ealloc2float( s->nt, s->nf );
+    }
+    memcpy( (void*)s->rspec[s->ifreq], (void*)tr->data, s->nt*FSIZE );
+    if (s->ifreq == s->nf-1) {
+        memcpy( (void*)&s->out, (void*)tr, HDRBYTES );
+        ISDCT( s->sdct, s->rspec, s->out.data );
+        s->out.tracr = ++s->tracr;
+        s->out.trid = TREAL;
+        s->out.f1 = 0.0f;
+        s->out.d2 = 0.0f;
+        s->ifreq = -1;
+    } else
+        s->ifreq++;
+}
+
+/* The inverse transforms have an output trace ready when ifreq is -1 */
+static segy* inversePull( void* state, int flush ) {
+    _OPTRANS* s = (_OPTRANS*) state;
+    if (s->ifreq != -1)
+        return 0;
+    s->ifreq = 0;
+    return &s->out;
+}
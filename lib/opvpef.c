@@ -0,0 +1,1042 @@
+/* Copyright (c) Colorado School of Mines, 2011.*/
+/* All rights reserved.                       */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+OPVPEF - Wiener predictive error filter operator
+
+OP_vpef         create a predictive error filter operator, as suvpef
+
+**************************************************************************
+Function Prototypes:
+hOP OP_vpef(int npar, char** par);
+
+**************************************************************************
+Input:
+npar        number of parameters
+par         array of parameters as name=value strings
+
+Returned: operator handle
+
+**************************************************************************
+Notes:
+This is the core of suvpef. The FFT size, gates and defaults that depend on
+the trace length and sample interval are set up from the first trace
+pushed. Non-seismic traces are skipped. See OP for how operators are used.
+
+By default traces are filtered in batches of NBATCH, whose Levinson
+recursions are solved together, and a batch is output once it is full or
+after OP_flush. With gkey= the traces of a gather are held until the first
+trace of the next gather is pushed, that trace is only added to the buffer
+once the traces of the completed gather have all been pulled. With ntr=
+the rolling window of traces and of their autocorrelations is kept in
+cyclic trace buffers, CTB.
+
+With threads= greater than 1 worker threads are started when the first trace
+is pushed. Pushed traces go in a ring of slots that the workers filter in
+batches, and OP_pull returns the traces in input order as they complete.
+It only waits for a worker when the ring is full or after OP_flush, so the
+caller can read and write traces while the workers filter. The workers
+are stopped when the operator is freed.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include <pthread.h>
+#include "cwp.h"
+#include "par.h"
+#include "su.h"
+#include "segy.h"
+#include "header.h"
+#include "sux.h"
+
+#define LOOKFAC 2       /* Look ahead factor for npfaro          */
+#define FFTCOST 2.0     /* Multiply-adds per n*log2(n) for a real FFT of length n */
+#define NBATCH 8        /* Number of traces whose filters are solved together */
+
+/* Parameters shared by all traces */
+typedef struct {
+    int ns;
+    float dt;
+    int nlag;
+    float* xlag;
+    float* lag;
+    int ilen;
+    float pnoise;
+    int ncorr;
+    int lmax;
+    int ngate;
+    int* igate;
+    int* gidx;
+    float* gwt;
+    float gcost;
+    int fft;
+    int nfft;
+    float fftcost;
+    cwp_String keyType;
+    int keyIndex;
+    int verbose;
+} vpef_Par;
+
+/* Work space for designing and applying the filter for one trace */
+typedef struct {
+    float* wiener;
+    float* spiker;
+    float* autocorr;
+    float* rbuf;
+    complex* cbuf;
+    complex* fbuf;
+    float** gwiener;
+    cwp_Bool* gok;
+    hBLEV blev;
+    float** bac;
+    float** bwiener;
+    float** br;
+    float** bg;
+    float** bf;
+    int* bok;
+    int* bidx;
+    int* blag;
+} vpef_Work;
+
+/* Ring of trace slots shared by the worker threads */
+typedef enum { SlotFree, SlotRead, SlotDone } slot_State;
+
+typedef struct {
+    const vpef_Par* par;
+    int nslot;
+    segy* in;
+    segy* out;
+    slot_State* state;
+    cwp_Bool* output;
+    long nread;         /* number of traces pushed   */
+    long nnext;         /* next trace to be filtered */
+    long nwrite;        /* next trace to be pulled   */
+    int held;           /* slot of the trace last pulled or -1 */
+    int eof;
+    int nthreads;
+    pthread_t* workers;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} vpef_Queue;
+
+typedef struct {
+    float dt;
+    int nxlag;
+    int nlagval;
+    float* xlag;
+    float* lag;
+    int lenGiven;
+    float len;
+    float pnoise;
+    int mincorrGiven;
+    float mincorr;
+    int maxcorrGiven;
+    float maxcorr;
+    int ngate;
+    float* gates;
+    int fft;
+    cwp_String gType;
+    int gIndex;
+    int ntr;
+    int threads;
+    int verbose;
+    int configured;
+    vpef_Par par;
+    vpef_Work work;
+/* Batches of traces */
+    int nb;
+    int iout;
+    int nout;
+    segy* inbuf;
+    segy* outbuf;
+    segy* in[NBATCH];
+    segy* out[NBATCH];
+    cwp_Bool output[NBATCH];
+/* Gathers */
+    char* gbuf;
+    int gntr;
+    int maxtr;
+    int ngather;
+    int gready;         /* traces of a completed gather  */
+    int gout;           /* next of them to be pulled     */
+    int lastlag;
+    cwp_Bool ok;
+    int pending;        /* pend starts the next gather   */
+    float* acsum;
+    Value gval;
+    segy pend;
+/* Rolling window */
+    int ready;
+    hCTB tbuf;
+    hCTB abuf;
+    float* slice;
+    segy scratch;
+/* Worker threads */
+    vpef_Queue* q;
+    segy outtrace;
+} _OPVPEF;
+
+static void freeState( void* state );
+static void vpefPush( void* state, const segy* const tr );
+static segy* vpefPull( void* state, int flush );
+static void configure( _OPVPEF* s, const segy* const tr );
+static segy* batchPull( _OPVPEF* s, int flush );
+static void gatherPush( _OPVPEF* s, const segy* const tr );
+static void gatherAdd( _OPVPEF* s, const segy* const tr, Value val );
+static segy* gatherPull( _OPVPEF* s, int flush );
+static void windowPush( _OPVPEF* s, const segy* const tr );
+static segy* windowPull( _OPVPEF* s, int flush );
+static vpef_Queue* queue_init( const vpef_Par* p, int nthreads );
+static void queue_push( vpef_Queue* q, const segy* const tr );
+static segy* queue_pull( vpef_Queue* q, int flush );
+static void queue_free( vpef_Queue* q );
+static void* vpef_worker( void* arg );
+static void work_init( vpef_Work* w, const vpef_Par* p );
+static void work_free( vpef_Work* w );
+static int trace_lag( const vpef_Par* p, const segy* tr );
+static void autocorrelate( const vpef_Par* p, vpef_Work* w, int n, float* data, int lcorr, float* autocorr );
+static cwp_Bool design( const vpef_Par* p, vpef_Work* w, int ilag );
+static void apply( const vpef_Par* p, vpef_Work* w, int ilag, const float* wiener, float* in, float* out );
+static cwp_Bool vpef( const vpef_Par* p, vpef_Work* w, segy* in, segy* out );
+static void vpef_batch( const vpef_Par* p, vpef_Work* w, int nb, segy** in, segy** out, cwp_Bool* output );
+static cwp_Bool vpef_gates( const vpef_Par* p, vpef_Work* w, segy* in, segy* out );
+static void sum_autocorr( const vpef_Par* p, vpef_Work* w, float* data, float* acsum );
+static void fft_autocorr( int n, float* x, int nfft, int lcorr, float* rbuf, complex* cbuf, float* autocorr );
+static void fft_apply( int ns, float* in, int ilag, int ilen, const float* wiener, int nfft,
+                       float* rbuf, complex* cbuf, complex* fbuf, float* out );
+
+hOP OP_vpef( int npar, char** par ) {
+    _OPVPEF* s = emalloc(sizeof(_OPVPEF));
+    char* key;
+    char* gkey;
+
+    if (!OP_getint( npar, par, "verbose", &s->verbose )) s->verbose = 0;
+    if (!OP_getfloat( npar, par, "dt", &s->dt )) s->dt = 0.0;
+    if (!OP_getstring( npar, par, "key", &key )) key = "cdp";
+    s->nxlag = OP_countval( npar, par, "xlag" );
+    s->nlagval = OP_countval( npar, par, "lag" );
+    if (s->nxlag>0 && s->nlagval!=s->nxlag)
+        err("suvpef: a lag value must be given for each %s in xlag=", key);
+    s->xlag = ealloc1float( MAX(s->nxlag, 1) );
+    s->lag = ealloc1float( MAX(s->nlagval, 1) );
+    OP_getfloats( npar, par, "xlag", s->xlag );
+    OP_getfloats( npar, par, "lag", s->lag );
+    s->mincorrGiven = OP_getfloat( npar, par, "mincorr", &s->mincorr );
+    s->maxcorrGiven = OP_getfloat( npar, par, "maxcorr", &s->maxcorr );
+    if (!OP_getfloat( npar, par, "pnoise", &s->pnoise )) s->pnoise = 0.001;
+    s->lenGiven = OP_getfloat( npar, par, "len", &s->len );
+    if (!OP_getint( npar, par, "fft", &s->fft )) s->fft = -1;
+    if (!OP_getint( npar, par, "threads", &s->threads )) s->threads = 1;
+    if (!OP_getstring( npar, par, "gkey", &gkey )) gkey = NULL;
+    if (!OP_getint( npar, par, "ntr", &s->ntr )) s->ntr = 1;
+    if (gkey && s->ntr>1)
+        err("suvpef: only one of gkey= and ntr= can be given");
+    s->ngate = OP_countval( npar, par, "gates" );
+    s->gates = 0;
+    if (s->ngate>0) {
+        if (s->ngate<2)
+            err("suvpef: gates= needs at least two times");
+        if (gkey || s->ntr>1)
+            err("suvpef: gates= can't be used with gkey= or ntr=");
+        s->gates = ealloc1float( s->ngate );
+        OP_getfloats( npar, par, "gates", s->gates );
+        s->ngate--;
+    }
+    if (s->ntr>1 && s->ntr%2==0) {
+        s->ntr++;
+        if (s->verbose)
+            warn("suvpef: adjusting ntr to be odd, was %d now %d", s->ntr-1, s->ntr);
+    }
+    if (s->threads>1 && (gkey || s->ntr>1)) {
+        warn("suvpef: threads= ignored when averaging autocorrelations");
+        s->threads = 1;
+    }
+    s->gType = (gkey)? hdtype(gkey) : 0;
+    s->gIndex = (gkey)? getindex(gkey) : 0;
+    s->par.keyType = hdtype(key);
+    s->par.keyIndex = getindex(key);
+    s->par.verbose = s->verbose;
+    s->par.igate = 0;
+    s->par.gidx = 0;
+    s->par.gwt = 0;
+    s->configured = 0;
+    s->nb = 0;
+    s->iout = 0;
+    s->nout = 0;
+    s->inbuf = 0;
+    s->outbuf = 0;
+    s->gbuf = 0;
+    s->gntr = 0;
+    s->maxtr = 0;
+    s->ngather = 0;
+    s->gready = 0;
+    s->gout = 0;
+    s->lastlag = -1;
+    s->ok = cwp_false;
+    s->pending = 0;
+    s->acsum = 0;
+    s->ready = 0;
+    s->tbuf = 0;
+    s->abuf = 0;
+    s->slice = 0;
+    s->q = 0;
+    return OP_new( "suvpef", s, vpefPush, vpefPull, freeState );
+}
+
+static void freeState( void* state ) {
+    _OPVPEF* s = (_OPVPEF*) state;
+    if (s->configured) {
+        if (s->q)
+            queue_free( s->q );
+        else
+            work_free( &s->work );
+        if (s->gType && s->verbose)
+            warn("designed filters for %d gathers", s->ngather);
+    }
+    if (s->inbuf) free1( s->inbuf );
+    if (s->outbuf) free1( s->outbuf );
+    if (s->gbuf) free1( s->gbuf );
+    if (s->acsum) free1float( s->acsum );
+    if (s->tbuf) CTB_free( s->tbuf );
+    if (s->abuf) CTB_free( s->abuf );
+    if (s->slice) free1float( s->slice );
+    if (s->par.igate) free1int( s->par.igate );
+    if (s->par.gidx) free1int( s->par.gidx );
+    if (s->par.gwt) free1float( s->par.gwt );
+    if (s->gates) free1float( s->gates );
+    free1float( s->xlag );
+    free1float( s->lag );
+    free( s );
+}
+
+/* Parameters that depend on the trace length and sample interval, from the
+   first trace */
+static void configure( _OPVPEF* s, const segy* const tr ) {
+    vpef_Par* p = &s->par;
+    int ns = tr->ns;
+    float dt = s->dt;
+    int imincorr, imaxcorr;
+    int maxlag, nfft;
+
+    if (dt == 0.0)
+        dt = ((double) tr->dt)/1000000.0;
+    if (dt == 0.0)
+        err("suvpef: dt field is zero and not given");
+    p->nlag = MAX(s->nxlag, 1);
+    if (!s->nxlag) s->xlag[0] = tr->cdp;
+    if (!s->nlagval) s->lag[0] = dt;
+
+    if (s->mincorrGiven) {
+        if (s->mincorr < 0.0) {
+            warn("mincorr=%g too small resetting to start of trace", s->mincorr);
+            imincorr = 0;
+        } else
+            imincorr = NINT(s->mincorr/dt);
+    } else
+        imincorr = 0;
+    if (s->maxcorrGiven) {
+        imaxcorr = NINT(s->maxcorr/dt);
+        if (imaxcorr > ns) {
+            warn("maxcorr=%g too big resetting to end of trace", s->maxcorr);
+            imaxcorr = ns;
+        } else if (imaxcorr<imincorr)
+            err("maxcorr: %g is less than mincorr: %g", s->maxcorr, s->mincorr);
+    } else
+        imaxcorr = ns;
+    if (!s->lenGiven) s->len = (float) ns*dt/20;
+
+/* FFT size for the longest lag, shared by all traces */
+    maxlag = 0;
+    for (int i=0; i<p->nlag; i++)
+        maxlag = MAX(maxlag, NINT(s->lag[i]/dt));
+    p->ilen = NINT(s->len/dt);
+    p->ncorr = MIN(imaxcorr - imincorr + 1, ns);
+    nfft = MAX(ns, p->ncorr) + maxlag + p->ilen + 1;
+    nfft = npfaro(nfft, LOOKFAC*nfft);
+    if (s->verbose && s->fft!=0)
+        warn("FFT length %d for autocorrelation and filtering", nfft);
+
+    p->ns = ns;
+    p->dt = dt;
+    p->xlag = s->xlag;
+    p->lag = s->lag;
+    p->pnoise = s->pnoise;
+    p->lmax = maxlag + p->ilen + 1;
+    p->ngate = s->ngate;
+    p->gcost = 0.0;
+    if (p->ngate) {
+        int ngate = p->ngate;
+/* Gate boundaries in samples and for each sample the gate whose filter is
+   blended with that of the next gate and the blending weight */
+        p->igate = ealloc1int(ngate+1);
+        for (int k=0; k<=ngate; k++) {
+            p->igate[k] = NINT(s->gates[k]/dt);
+            p->igate[k] = MAX(0, MIN(p->igate[k], ns));
+            if (k && p->igate[k]<=p->igate[k-1])
+                err("gates= must be increasing and within the trace");
+        }
+        p->gidx = ealloc1int(ns);
+        p->gwt = ealloc1float(ns);
+        for (int i=0, k=0; i<ns; i++) {
+            float ci = 0.5*(p->igate[k]+p->igate[k+1]);
+            float cn = (k+1<ngate)? 0.5*(p->igate[k+1]+p->igate[k+2]) : ci;
+            while (k+1<ngate && i>=cn) {
+                k++;
+                ci = cn;
+                cn = (k+1<ngate)? 0.5*(p->igate[k+1]+p->igate[k+2]) : ci;
+            }
+            p->gidx[i] = k;
+            p->gwt[i] = (k+1<ngate && i>ci)? (i-ci)/(cn-ci) : 0.0;
+            p->gcost += (p->gwt[i]>0.0)? 2.0 : 1.0;
+        }
+        if (s->verbose)
+            warn("designing filters in %d gates", ngate);
+    }
+    p->fft = s->fft;
+    p->nfft = nfft;
+    p->fftcost = FFTCOST*nfft*log((double) nfft)/log(2.0);
+
+    if (s->threads > 1) {
+        if (s->verbose)
+            warn("filtering with %d worker threads", s->threads);
+        s->q = queue_init( p, s->threads );
+    } else
+        work_init( &s->work, p );
+    if (s->gType) {
+        s->acsum = ealloc1float( p->lmax );
+        memset((void *) s->acsum, 0, p->lmax*FSIZE);
+    } else if (s->ntr > 1) {
+        s->tbuf = CTB_init( s->ntr, ns );
+        s->abuf = CTB_init( s->ntr, p->lmax );
+        s->slice = ealloc1float( s->ntr );
+        memset((void *) s->scratch.data, 0, p->lmax*FSIZE);
+    } else if (!s->q) {
+        s->inbuf = ealloc1( NBATCH, sizeof(segy) );
+        s->outbuf = ealloc1( NBATCH, sizeof(segy) );
+        for (int b=0; b<NBATCH; b++) {
+            s->in[b] = &s->inbuf[b];
+            s->out[b] = &s->outbuf[b];
+        }
+    }
+    s->configured = 1;
+}
+
+static void vpefPush( void* state, const segy* const tr ) {
+    _OPVPEF* s = (_OPVPEF*) state;
+    if (!s->configured)
+        configure( s, tr );
+    if (s->q)
+        queue_push( s->q, tr );
+    else if (s->gType)
+        gatherPush( s, tr );
+    else if (s->ntr > 1)
+        windowPush( s, tr );
+    else {
+        memcpy( (void *) s->in[s->nb], (const void *) tr, HDRBYTES + tr->ns*FSIZE);
+        s->nb++;
+        if (s->nb == NBATCH) {
+            vpef_batch( &s->par, &s->work, s->nb, s->in, s->out, s->output );
+            s->iout = 0;
+            s->nout = s->nb;
+            s->nb = 0;
+        }
+    }
+}
+
+static segy* vpefPull( void* state, int flush ) {
+    _OPVPEF* s = (_OPVPEF*) state;
+    if (!s->configured)
+        return 0;
+    if (s->q)
+        return queue_pull( s->q, flush );
+    else if (s->gType)
+        return gatherPull( s, flush );
+    else if (s->ntr > 1)
+        return windowPull( s, flush );
+    else
+        return batchPull( s, flush );
+}
+
+/* Output of the last full batch, or after a flush of the part batch */
+static segy* batchPull( _OPVPEF* s, int flush ) {
+    if (s->iout >= s->nout && flush && s->nb) {
+        vpef_batch( &s->par, &s->work, s->nb, s->in, s->out, s->output );
+        s->iout = 0;
+        s->nout = s->nb;
+        s->nb = 0;
+    }
+    while (s->iout < s->nout) {
+        int b = s->iout++;
+        if (s->output[b])
+            return s->out[b];
+    }
+    return 0;
+}
+
+/* Filtering with the autocorrelation averaged over all traces with the same
+   value of the gather key. The first trace of the next gather is held back
+   until the completed gather has been output. */
+static void gatherPush( _OPVPEF* s, const segy* const tr ) {
+    Value val;
+    if (!ISSEISMIC(tr->trid)) {
+        if (s->verbose)
+            warn("ignoring input trace=%d with non-seismic trcid=%d", tr->tracl, tr->trid);
+        return;
+    }
+    gethval(tr, s->gIndex, &val);
+    if (s->gntr && valcmp(s->gType, val, s->gval)) {
+        s->gready = s->gntr;
+        s->gout = 0;
+        s->lastlag = -1;
+        s->ngather++;
+        memcpy( (void *) &s->pend, (const void *) tr, HDRBYTES + s->par.ns*FSIZE);
+        s->pending = 1;
+    } else
+        gatherAdd( s, tr, val );
+}
+
+static void gatherAdd( _OPVPEF* s, const segy* const tr, Value val ) {
+    size_t trbytes = HDRBYTES + s->par.ns*FSIZE;
+    if (s->gntr == s->maxtr) {
+        s->maxtr = (s->maxtr)? 2*s->maxtr : 64;
+        s->gbuf = erealloc1( s->gbuf, s->maxtr, trbytes );
+    }
+    segy* gtr = (segy*) (s->gbuf + s->gntr*trbytes);
+    memcpy( (void *) gtr, (const void *) tr, trbytes);
+    sum_autocorr( &s->par, &s->work, gtr->data, s->acsum );
+    s->gval = val;
+    s->gntr++;
+}
+
+/* Filter the traces of a completed gather as they are pulled with a filter
+   designed from their summed autocorrelation, only redesigned when the lag
+   changes from one trace to the next */
+static segy* gatherPull( _OPVPEF* s, int flush ) {
+    const vpef_Par* p = &s->par;
+    size_t trbytes = HDRBYTES + p->ns*FSIZE;
+    for (;;) {
+        if (s->gout < s->gready) {
+            segy* tr = (segy*) (s->gbuf + s->gout*trbytes);
+            int ilag = trace_lag( p, tr );
+            if (ilag != s->lastlag) {
+                memcpy( (void *) s->work.autocorr, (const void *) s->acsum, p->lmax*FSIZE);
+                s->ok = design( p, &s->work, ilag );
+                s->lastlag = ilag;
+            }
+            s->gout++;
+            if (!s->ok)
+                return tr;
+            apply( p, &s->work, ilag, s->work.wiener, tr->data, s->outtrace.data );
+            memcpy( (void *) &s->outtrace, (const void *) tr, HDRBYTES);
+            return &s->outtrace;
+        }
+        if (s->gready) {
+            memset((void *) s->acsum, 0, p->lmax*FSIZE);
+            s->gntr = 0;
+            s->gready = 0;
+            s->gout = 0;
+            if (s->pending) {
+                Value val;
+                gethval(&s->pend, s->gIndex, &val);
+                gatherAdd( s, &s->pend, val );
+                s->pending = 0;
+            }
+        }
+        if (!flush || !s->gntr)
+            return 0;
+        s->gready = s->gntr;
+        s->gout = 0;
+        s->lastlag = -1;
+        s->ngather++;
+    }
+}
+
+/* Filtering with the autocorrelation averaged over a rolling window of ntr
+   traces centred on each output trace */
+static void windowPush( _OPVPEF* s, const segy* const tr ) {
+    const vpef_Par* p = &s->par;
+    if (!ISSEISMIC(tr->trid)) {
+        if (p->verbose)
+            warn("ignoring input trace=%d with non-seismic trcid=%d", tr->tracl, tr->trid);
+        return;
+    }
+/* Normalised autocorrelation goes in a scratch trace for the buffer */
+    autocorrelate( p, &s->work, p->ncorr, (float*) tr->data, p->lmax, s->work.autocorr );
+    float scale = (s->work.autocorr[0] != 0.0)? 1.0/s->work.autocorr[0] : 0.0;
+    for (int i=0; i<p->lmax; i++)
+        s->scratch.data[i] = scale*s->work.autocorr[i];
+    CTB_push( s->abuf, &s->scratch );
+    s->ready = CTB_push( s->tbuf, tr );
+}
+
+static segy* windowPull( _OPVPEF* s, int flush ) {
+    const vpef_Par* p = &s->par;
+    if (!s->ready && flush) {
+        CTB_push( s->abuf, 0 );
+        s->ready = CTB_push( s->tbuf, 0 );
+    }
+    if (!s->ready)
+        return 0;
+    s->ready = 0;
+    int tcount = CTB_traces( s->abuf );
+    int icur = 0;
+    for (int i=0; i<p->lmax; i++) {
+        icur = CTB_getSlice( s->abuf, i, s->slice );
+        float sum = 0.0;
+        for (int itr=0; itr<tcount; itr++)
+            sum += s->slice[itr];
+        s->work.autocorr[i] = sum/tcount;
+    }
+    CTB_copyCurrentHdr( s->tbuf, &s->outtrace );
+    float* data = (float*) CTB_getTrace( s->tbuf, icur );
+    int ilag = trace_lag( p, &s->outtrace );
+    if (design( p, &s->work, ilag ))
+        apply( p, &s->work, ilag, s->work.wiener, data, s->outtrace.data );
+    else
+        memcpy( (void *) s->outtrace.data, (const void *) data, p->ns*FSIZE);
+    return &s->outtrace;
+}
+
+/* Trace-parallel filtering. Pushed traces fill a ring of slots in input
+   order, worker threads take the next batch of unfiltered slots and the
+   slots are pulled in input order as they complete. A pulled slot is freed
+   at the next push or pull. */
+static vpef_Queue* queue_init( const vpef_Par* p, int nthreads )
+{
+    vpef_Queue* q = emalloc(sizeof(vpef_Queue));
+    q->par = p;
+    q->nslot = NBATCH*(nthreads+1);
+    q->in = ealloc1( q->nslot, sizeof(segy) );
+    q->out = ealloc1( q->nslot, sizeof(segy) );
+    q->state = ealloc1( q->nslot, sizeof(slot_State) );
+    q->output = ealloc1( q->nslot, sizeof(cwp_Bool) );
+    for (int i=0; i<q->nslot; i++)
+        q->state[i] = SlotFree;
+    q->nread = 0;
+    q->nnext = 0;
+    q->nwrite = 0;
+    q->held = -1;
+    q->eof = 0;
+    q->nthreads = nthreads;
+    q->workers = ealloc1( nthreads, sizeof(pthread_t) );
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    for (int i=0; i<nthreads; i++)
+        if (pthread_create(&q->workers[i], NULL, vpef_worker, q))
+            err("can't create worker thread %d", i);
+    return q;
+}
+
+/* Free the slot of the trace last pulled */
+static void queue_release( vpef_Queue* q )
+{
+    if (q->held < 0)
+        return;
+    pthread_mutex_lock(&q->lock);
+    q->state[q->held] = SlotFree;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    q->held = -1;
+}
+
+static void queue_push( vpef_Queue* q, const segy* const tr )
+{
+    int islot = q->nread%q->nslot;
+    queue_release( q );
+    pthread_mutex_lock(&q->lock);
+    if (q->state[islot] != SlotFree)
+        err("suvpef: trace pushed before the output was pulled");
+    pthread_mutex_unlock(&q->lock);
+    memcpy( (void *) &q->in[islot], (const void *) tr, HDRBYTES + tr->ns*FSIZE);
+    pthread_mutex_lock(&q->lock);
+    q->state[islot] = SlotRead;
+    q->nread++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Next trace in input order. Only waits for the workers when the ring is
+   full, so there is room for the next push, or after a flush. */
+static segy* queue_pull( vpef_Queue* q, int flush )
+{
+    queue_release( q );
+    while (q->nwrite < q->nread) {
+        int islot = q->nwrite%q->nslot;
+        pthread_mutex_lock(&q->lock);
+        while (q->state[islot] != SlotDone && (flush || q->nread - q->nwrite == q->nslot))
+            pthread_cond_wait(&q->changed, &q->lock);
+        int done = (q->state[islot] == SlotDone);
+        pthread_mutex_unlock(&q->lock);
+        if (!done)
+            break;
+        q->nwrite++;
+        q->held = islot;
+        if (q->output[islot])
+            return &q->out[islot];
+        queue_release( q );
+    }
+    return 0;
+}
+
+static void queue_free( vpef_Queue* q )
+{
+    pthread_mutex_lock(&q->lock);
+    q->eof = 1;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    for (int i=0; i<q->nthreads; i++)
+        pthread_join(q->workers[i], NULL);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->changed);
+    free1( q->in );
+    free1( q->out );
+    free1( q->state );
+    free1( q->output );
+    free1( q->workers );
+    free( q );
+}
+
+static void* vpef_worker( void* arg )
+{
+    vpef_Queue* q = (vpef_Queue*) arg;
+    vpef_Work work;
+    int islot[NBATCH];
+    segy* in[NBATCH];
+    segy* out[NBATCH];
+    cwp_Bool output[NBATCH];
+    work_init( &work, q->par );
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        while (q->nnext >= q->nread && !q->eof)
+            pthread_cond_wait(&q->changed, &q->lock);
+        if (q->nnext >= q->nread) {
+            pthread_mutex_unlock(&q->lock);
+            break;
+        }
+        int nb = MIN(q->nread - q->nnext, NBATCH);
+        for (int b=0; b<nb; b++) {
+            islot[b] = (q->nnext+b)%q->nslot;
+            in[b] = &q->in[islot[b]];
+            out[b] = &q->out[islot[b]];
+        }
+        q->nnext += nb;
+        pthread_mutex_unlock(&q->lock);
+        vpef_batch( q->par, &work, nb, in, out, output );
+        pthread_mutex_lock(&q->lock);
+        for (int b=0; b<nb; b++) {
+            q->output[islot[b]] = output[b];
+            q->state[islot[b]] = SlotDone;
+        }
+        pthread_cond_broadcast(&q->changed);
+        pthread_mutex_unlock(&q->lock);
+    }
+    work_free( &work );
+    return NULL;
+}
+
+/* Allocate the work space for one trace */
+static void work_init( vpef_Work* w, const vpef_Par* p )
+{
+    w->wiener   = ealloc1float(p->ilen);
+    w->spiker   = ealloc1float(p->ilen);
+    w->autocorr = ealloc1float(p->lmax);
+    w->rbuf = NULL;
+    w->cbuf = NULL;
+    w->fbuf = NULL;
+    if (p->fft!=0) {
+        w->rbuf = ealloc1float(p->nfft);
+        w->cbuf = ealloc1complex(p->nfft/2+1);
+        w->fbuf = ealloc1complex(p->nfft/2+1);
+    }
+    w->gwiener = NULL;
+    w->gok = NULL;
+    if (p->ngate) {
+        w->gwiener = ealloc2float(p->ilen, p->ngate);
+        w->gok = ealloc1(p->ngate, sizeof(cwp_Bool));
+    }
+    w->blev = BLEV_init(p->ilen, NBATCH);
+    w->bac = ealloc2float(p->lmax, NBATCH);
+    w->bwiener = ealloc2float(p->ilen, NBATCH);
+    w->br = ealloc1(NBATCH, sizeof(float*));
+    w->bg = ealloc1(NBATCH, sizeof(float*));
+    w->bf = ealloc1(NBATCH, sizeof(float*));
+    w->bok = ealloc1int(NBATCH);
+    w->bidx = ealloc1int(NBATCH);
+    w->blag = ealloc1int(NBATCH);
+}
+
+static void work_free( vpef_Work* w )
+{
+    free1float(w->wiener);
+    free1float(w->spiker);
+    free1float(w->autocorr);
+    if (w->rbuf) free1float(w->rbuf);
+    if (w->cbuf) free1complex(w->cbuf);
+    if (w->fbuf) free1complex(w->fbuf);
+    if (w->gwiener) free2float(w->gwiener);
+    if (w->gok) free1(w->gok);
+    BLEV_free(w->blev);
+    free2float(w->bac);
+    free2float(w->bwiener);
+    free1(w->br);
+    free1(w->bg);
+    free1(w->bf);
+    free1int(w->bok);
+    free1int(w->bidx);
+    free1int(w->blag);
+}
+
+/* Lag in samples of the prediction filter for a trace */
+static int trace_lag( const vpef_Par* p, const segy* tr )
+{
+    Value keyVal;
+    float val, filtlag;
+    gethval(tr, p->keyIndex, &keyVal);
+    val = vtof(p->keyType, keyVal);
+    intlin(p->nlag, p->xlag, p->lag, p->lag[0], p->lag[p->nlag-1], 1, &val, &filtlag );
+    return NINT(filtlag/p->dt);
+}
+
+/* Autocorrelation of n samples of a trace for lags 0 to lcorr-1, by FFT
+   when cheaper than the direct sum over 2 transforms */
+static void autocorrelate( const vpef_Par* p, vpef_Work* w, int n, float* data, int lcorr, float* autocorr )
+{
+    memset((void *) autocorr, 0, p->lmax*FSIZE);
+    if (p->fft==1 || (p->fft<0 && (float) n*lcorr > 2.0*p->fftcost))
+        fft_autocorr(n, data, p->nfft, lcorr, w->rbuf, w->cbuf, autocorr);
+    else
+        xcor(n, 0, data, n, 0, data, lcorr, 0, autocorr);
+}
+
+/* Wiener-Levinson prediction filter with lag ilag from the autocorrelation in
+   w->autocorr, which is whitened in place. Returns cwp_false if the zero lag
+   autocorrelation vanishes. */
+static cwp_Bool design( const vpef_Par* p, vpef_Work* w, int ilag )
+{
+    if (w->autocorr[0] == 0.0)
+        return cwp_false;
+    memset((void *) w->wiener, 0, p->ilen*FSIZE);
+    memset((void *) w->spiker, 0, p->ilen*FSIZE);
+    w->autocorr[0] *= 1.0 + p->pnoise;
+    stoepf(p->ilen, w->autocorr, w->autocorr+ilag, w->wiener, w->spiker);
+    return cwp_true;
+}
+
+/* Convolve the prediction error filter in wiener with the trace, by FFT
+   when cheaper than the direct sum over 3 transforms */
+static void apply( const vpef_Par* p, vpef_Work* w, int ilag, const float* wiener, float* in, float* out )
+{
+    int ns = p->ns;
+    int ilen = p->ilen;
+    if (p->fft==1 || (p->fft<0 && (float) ns*ilen > 3.0*p->fftcost))
+        fft_apply(ns, in, ilag, ilen, wiener, p->nfft, w->rbuf, w->cbuf, w->fbuf, out);
+    else {
+/* Don't do zero multiplies */
+        for (int i = 0; i < ns; ++i) {
+            register int j;
+            register int n = MIN(i, ilag+ilen-1);
+            register float sum = in[i];
+
+            for (j = ilag; j <= n; ++j)
+                sum -= wiener[j-ilag] * in[i-j];
+
+            out[i] = sum;
+        }
+    }
+}
+
+/* Design and apply the prediction error filter for the trace in in and put
+   the result in out. Returns cwp_false if the trace is not to be output. */
+static cwp_Bool vpef( const vpef_Par* p, vpef_Work* w, segy* in, segy* out )
+{
+    if (!ISSEISMIC(in->trid)) {
+        if (p->verbose)
+            warn("ignoring input trace=%d with non-seismic trcid=%d", in->tracl, in->trid);
+        return cwp_false;
+    }
+    if (p->ngate)
+        return vpef_gates( p, w, in, out );
+    int ilag = trace_lag( p, in );
+    autocorrelate( p, w, p->ncorr, in->data, ilag+p->ilen+1, w->autocorr );
+
+/* Leave trace alone if autocorr[0] vanishes */
+    if (!design( p, w, ilag )) {
+        memcpy( (void *) out, (const void *) in, HDRBYTES + p->ns*FSIZE);
+        return cwp_true;
+    }
+    apply( p, w, ilag, w->wiener, in->data, out->data );
+    memcpy( (void *) out, (const void *) in, HDRBYTES);
+    return cwp_true;
+}
+
+/* Design and apply prediction error filters for a batch of traces, with the
+   Levinson recursions of the batch solved together. A system the batched
+   solver rejects is solved on its own by stoepf. */
+static void vpef_batch( const vpef_Par* p, vpef_Work* w, int nb, segy** in, segy** out, cwp_Bool* output )
+{
+    int nsys = 0;
+    if (p->ngate) {
+        for (int b=0; b<nb; b++)
+            output[b] = vpef( p, w, in[b], out[b] );
+        return;
+    }
+    for (int b=0; b<nb; b++) {
+        output[b] = cwp_true;
+        if (!ISSEISMIC(in[b]->trid)) {
+            if (p->verbose)
+                warn("ignoring input trace=%d with non-seismic trcid=%d", in[b]->tracl, in[b]->trid);
+            output[b] = cwp_false;
+            continue;
+        }
+        int ilag = trace_lag( p, in[b] );
+        float* autocorr = w->bac[b];
+        autocorrelate( p, w, p->ncorr, in[b]->data, ilag+p->ilen+1, autocorr );
+
+/* Leave trace alone if autocorr[0] vanishes */
+        if (autocorr[0] == 0.0) {
+            memcpy( (void *) out[b], (const void *) in[b], HDRBYTES + p->ns*FSIZE);
+            continue;
+        }
+        autocorr[0] *= 1.0 + p->pnoise;
+        w->blag[nsys] = ilag;
+        w->bidx[nsys] = b;
+        w->br[nsys] = autocorr;
+        w->bg[nsys] = autocorr + ilag;
+        w->bf[nsys] = w->bwiener[b];
+        nsys++;
+    }
+    BLEV_solve( w->blev, nsys, w->br, w->bg, w->bf, w->bok );
+    for (int k=0; k<nsys; k++) {
+        int b = w->bidx[k];
+        if (!w->bok[k]) {
+            memset((void *) w->bf[k], 0, p->ilen*FSIZE);
+            stoepf(p->ilen, w->br[k], w->bg[k], w->bf[k], w->spiker);
+        }
+        apply( p, w, w->blag[k], w->bf[k], in[b]->data, out[b]->data );
+        memcpy( (void *) out[b], (const void *) in[b], HDRBYTES);
+    }
+}
+
+/* Multi-gate filtering. A filter is designed from the autocorrelation of
+   each gate and the filters are blended linearly between gate centres as
+   they are applied. */
+static cwp_Bool vpef_gates( const vpef_Par* p, vpef_Work* w, segy* in, segy* out )
+{
+    int ns = p->ns;
+    int ilen = p->ilen;
+    int ngate = p->ngate;
+    int ilag = trace_lag( p, in );
+    int lcorr = ilag + ilen + 1;
+    cwp_Bool any = cwp_false;
+
+    for (int k=0; k<ngate; k++) {
+        int n = p->igate[k+1] - p->igate[k];
+        autocorrelate( p, w, n, in->data + p->igate[k], lcorr, w->autocorr );
+        w->gok[k] = design( p, w, ilag );
+        if (w->gok[k])
+            memcpy( (void *) w->gwiener[k], (const void *) w->wiener, ilen*FSIZE);
+        else
+            memset( (void *) w->gwiener[k], 0, ilen*FSIZE);
+        any = any || w->gok[k];
+    }
+
+/* Leave trace alone if the autocorrelation vanishes in all gates */
+    if (!any) {
+        memcpy( (void *) out, (const void *) in, HDRBYTES + ns*FSIZE);
+        return cwp_true;
+    }
+
+/* One forward transform of the trace is shared by the filters of all gates */
+    if (p->fft==1 || (p->fft<0 && (float) p->gcost*ilen > (1+2*ngate)*p->fftcost)) {
+        int nf = p->nfft/2 + 1;
+        float scale = 1.0/p->nfft;
+        memset((void *) w->rbuf, 0, p->nfft*FSIZE);
+        memcpy((void *) w->rbuf, (const void *) in->data, ns*FSIZE);
+        pfarc(1, p->nfft, w->rbuf, w->cbuf);
+        memcpy((void *) out->data, (const void *) in->data, ns*FSIZE);
+        for (int k=0; k<ngate; k++) {
+            if (!w->gok[k])
+                continue;
+            memset((void *) w->rbuf, 0, p->nfft*FSIZE);
+            memcpy((void *) (w->rbuf+ilag), (const void *) w->gwiener[k], ilen*FSIZE);
+            pfarc(1, p->nfft, w->rbuf, w->fbuf);
+            for (int i=0; i<nf; ++i)
+                w->fbuf[i] = cmul(w->cbuf[i], w->fbuf[i]);
+            pfacr(-1, p->nfft, w->fbuf, w->rbuf);
+            for (int i=0; i<ns; ++i) {
+                float wt = (p->gidx[i]==k)? 1.0-p->gwt[i] : (p->gidx[i]+1==k)? p->gwt[i] : 0.0;
+                out->data[i] -= wt*w->rbuf[i]*scale;
+            }
+        }
+    } else {
+        for (int i = 0; i < ns; ++i) {
+            int k = p->gidx[i];
+            float a = p->gwt[i];
+            int n = MIN(i, ilag+ilen-1);
+            float sum = 0.0;
+            for (int j = ilag; j <= n; ++j)
+                sum += w->gwiener[k][j-ilag] * in->data[i-j];
+            if (a > 0.0) {
+                float sum1 = 0.0;
+                for (int j = ilag; j <= n; ++j)
+                    sum1 += w->gwiener[k+1][j-ilag] * in->data[i-j];
+                sum += a*(sum1 - sum);
+            }
+            out->data[i] = in->data[i] - sum;
+        }
+    }
+    memcpy( (void *) out, (const void *) in, HDRBYTES);
+    return cwp_true;
+}
+
+/* Add the autocorrelation of a trace, normalised by its zero lag value, to
+   the sum in acsum */
+static void sum_autocorr( const vpef_Par* p, vpef_Work* w, float* data, float* acsum )
+{
+    autocorrelate( p, w, p->ncorr, data, p->lmax, w->autocorr );
+    if (w->autocorr[0] != 0.0) {
+        float scale = 1.0/w->autocorr[0];
+        for (int i=0; i<p->lmax; i++)
+            acsum[i] += scale*w->autocorr[i];
+    }
+}
+
+/* Autocorrelation of the n samples in x for lags 0 to lcorr-1 by FFT. nfft
+   must be at least n+lcorr-1 so the circular correlation does not wrap. */
+static void fft_autocorr( int n, float* x, int nfft, int lcorr, float* rbuf, complex* cbuf, float* autocorr )
+{
+    int nf = nfft/2 + 1;
+    float scale = 1.0/nfft;
+    memset((void *) rbuf, 0, nfft*FSIZE);
+    memcpy((void *) rbuf, (const void *) x, n*FSIZE);
+    pfarc(1, nfft, rbuf, cbuf);
+    for (int i=0; i<nf; ++i)
+        cbuf[i] = cmplx(cbuf[i].r*cbuf[i].r + cbuf[i].i*cbuf[i].i, 0.0);
+    pfacr(-1, nfft, cbuf, rbuf);
+    for (int i=0; i<lcorr; ++i)
+        autocorr[i] = rbuf[i]*scale;
+}
+
+/* Apply the prediction error filter with lag ilag and ilen coefficients in
+   wiener to the ns samples in in by FFT. nfft must be at least ns+ilag+ilen-1
+   so the circular convolution does not wrap. */
+static void fft_apply( int ns, float* in, int ilag, int ilen, const float* wiener, int nfft,
+                       float* rbuf, complex* cbuf, complex* fbuf, float* out )
+{
+    int nf = nfft/2 + 1;
+    float scale = 1.0/nfft;
+    memset((void *) rbuf, 0, nfft*FSIZE);
+    memcpy((void *) rbuf, (const void *) in, ns*FSIZE);
+    pfarc(1, nfft, rbuf, cbuf);
+    memset((void *) rbuf, 0, nfft*FSIZE);
+    memcpy((void *) (rbuf+ilag), (const void *) wiener, ilen*FSIZE);
+    pfarc(1, nfft, rbuf, fbuf);
+    for (int i=0; i<nf; ++i)
+        cbuf[i] = cmul(cbuf[i], fbuf[i]);
+    pfacr(-1, nfft, cbuf, rbuf);
+    for (int i=0; i<ns; ++i)
+        out[i] = in[i] - rbuf[i]*scale;
+}
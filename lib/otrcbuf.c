@@ -11,6 +11,8 @@ OTB_push             add a seg y trace to the buffer
 OTB_copyCurrentHdr    get the header of the current centre trace 
 OTB_getslice         get data at a particular sample for all traces
 OTB_getData          return a pointer to the buffer data
+OTB_getSlab          get a block of data around a sample for all traces
+OTB_getTrace         return a pointer to the data of a trace in the buffer
 OTB_free             release a trace buffer handle
 
 ************************************************************************** 
@@ -22,6 +24,8 @@ int OTB_push(hOTB h, const seg* const tr);
 void OTB_copyCurrentHdr(hOTB h, segy* const tr);
 int OTB_getSlice(hOTB h, int isample, float* const data);
 const float** const OTB_getData(hOTB h);
+void OTB_getSlab(hOTB h, int isample, int size, float** const data);
+const float* OTB_getTrace(hOTB h, int itrace);
 
 ************************************************************************** 
 OTB_init:
@@ -52,6 +56,11 @@ tr          pointer to a seg Y trace to add to the buffer
 Returned:   1 if sufficient number of traces in buffer for processing (ie >ntraces/2),
             0 otherwise
 
+With tr NULL at the end of the data the traces are shifted on without adding
+a new one, so each call returns the next trace left in the buffer. When fewer
+than ntraces/2 traces were pushed the first call shifts the first trace
+straight to the centre, so every trace is still output.
+
 ************************************************************************** 
 OTB_copyCurrentHdr:
 Input:
@@ -79,6 +88,15 @@ h           trace buffer handle created by OTB_init
 
 Returned:   pointer to 2D array holding the trace buffer data
 
+************************************************************************** 
+OTB_getTrace:
+Input:
+h           trace buffer handle created by OTB_init
+itrace      position of the trace in the buffer, 0 to ntraces-1
+
+Returned:   pointer to the trace data, positions before the first or after
+            the last trace in the buffer return the nearest available trace
+
 ************************************************************************** 
 Notes:
 Encapsulates the logic of a rolling window of traces over a panel of data.
@@ -144,15 +162,17 @@ int OTB_push( hOTB h, const segy* const tr ) {
         int ntr = h->ntr;
         int ns = h->ns;
         float** data = h->data;
-        h->ftr = (h->ftr > 0)? h->ftr-1 : 0;
-        memcpy( (void*)&(data[0][0]), (void*)&(data[1][0]), (ntr-1)*ns*FSIZE );
-        memcpy( (void*) &(h->hdrs[0]), (void*) &(h->hdrs[1]), (ntr-1)*HDRBYTES );
+/* At the end of data with fewer traces than half the buffer the first trace
+   is shifted straight to the centre */
+        int nshift = (!tr && h->ftr > ntr/2)? h->ftr - ntr/2 : 1;
+        h->ftr = (h->ftr > nshift)? h->ftr-nshift : 0;
+        memmove( (void*)&(data[0][0]), (void*)&(data[nshift][0]), (ntr-nshift)*ns*FSIZE );
+        memmove( (void*) &(h->hdrs[0]), (void*) &(h->hdrs[nshift]), (ntr-nshift)*HDRBYTES );
         if (tr) {
             memcpy( (void*)&(data[ntr-1][0]), (void*) tr->data, ns*FSIZE );
             memcpy( (void*)&(h->hdrs[ntr-1]), (void*) tr, HDRBYTES );
         } else
-            h->ltr--;
-//            h->ltr = (h->ltr>ntr/2)? h->ltr-1 : h->ltr;
+            h->ltr -= nshift;
     } else
         err("bad pointer in OTB_push.");
     return h->ltr >= h->ntr/2 && h->ftr <= h->ntr/2;
@@ -209,3 +229,11 @@ void OTB_getSlab( hOTB h, int isample, int size, float** const data) {
         err("bad pointer in OTB_getSlab.");
 }
 
+const float* OTB_getTrace( hOTB h, int itrace ) {
+    if (h) {
+        int utrc = (itrace < h->ftr)? h->ftr : (itrace > h->ltr)? h->ltr : itrace;
+        return (const float*) h->data[utrc];
+    } else
+        err("bad pointer in OTB_getTrace.");
+    return 0;
+}
@@ -0,0 +1,120 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+QNT - quantization of float trace samples to 16 or 8 bit integers
+
+QNT_bits        choose the sample size and scale for quantizing a trace
+QNT_encode      quantize an array of floats
+QNT_decode      dequantize an array of floats
+
+**************************************************************************
+Function Prototypes:
+int QNT_bits(int n, const float* in, int nbits, float maxerr, float* scale);
+void QNT_encode(int n, const float* in, int nbits, float scale, void* out);
+void QNT_decode(int n, const void* in, int nbits, float scale, float* out);
+
+**************************************************************************
+QNT_bits:
+Input:
+n           number of samples
+in          array[n] of samples
+nbits       bits per sample wanted, 8 or 16
+maxerr      largest absolute error allowed, 0 for no limit
+
+Output:
+scale       value of one integer step
+
+Returned:   bits per sample to use, 8, 16 or 32 for samples kept as floats
+
+**************************************************************************
+QNT_encode:
+Input:
+n           number of samples
+in          array[n] of samples
+nbits       bits per sample from QNT_bits
+scale       scale from QNT_bits
+
+Output:
+out         n*nbits/8 bytes of quantized samples
+
+**************************************************************************
+QNT_decode:
+Input:
+n           number of samples
+in          quantized samples from QNT_encode
+nbits       bits per sample
+scale       scale of the samples
+
+Output:
+out         array[n] of samples
+
+**************************************************************************
+Notes:
+Samples are scaled so the largest absolute value of the trace maps to the
+largest integer, 32767 or 127, and rounded to the nearest integer, as for
+storage=int16 in CBSDFT. The absolute error is at most half the scale, the
+largest absolute value divided by 65534 for 16 bits and by 254 for 8 bits.
+When that exceeds maxerr QNT_bits moves to the next larger size and when
+16 bits isn't enough, or the trace holds NaN or infinite values, it
+returns 32 and the samples are copied unchanged. A trace of zeros has a
+scale of zero.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include <float.h>
+#include <stdint.h>
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+int QNT_bits( int n, const float* in, int nbits, float maxerr, float* scale ) {
+    float vmax = 0.0;
+    int finite = 1;
+    for (int i=0; i<n; i++) {
+        float v = ABS(in[i]);
+        finite &= (v <= FLT_MAX);
+        vmax = MAX(vmax, v);
+    }
+    *scale = 0.0;
+    if (!finite)
+        return 32;
+    for (nbits = (nbits==8)? 8 : 16; nbits <= 16; nbits += 8) {
+        *scale = vmax/((nbits==8)? 127.0 : 32767.0);
+        if (maxerr <= 0.0 || 0.5*(*scale) <= maxerr)
+            return nbits;
+    }
+    *scale = 0.0;
+    return 32;
+}
+
+void QNT_encode( int n, const float* in, int nbits, float scale, void* out ) {
+    float inv_scale = (scale>0.0)? 1.0/scale : 0.0;
+    if (nbits == 16) {
+        int16_t* q = (int16_t*) out;
+        for (int i=0; i<n; i++)
+            q[i] = (int16_t) NINT(in[i]*inv_scale);
+    } else if (nbits == 8) {
+        int8_t* q = (int8_t*) out;
+        for (int i=0; i<n; i++)
+            q[i] = (int8_t) NINT(in[i]*inv_scale);
+    } else
+        memcpy( out, (const void*)in, n*FSIZE );
+}
+
+void QNT_decode( int n, const void* in, int nbits, float scale, float* out ) {
+    if (nbits == 16) {
+        const int16_t* q = (const int16_t*) in;
+        for (int i=0; i<n; i++)
+            out[i] = scale*q[i];
+    } else if (nbits == 8) {
+        const int8_t* q = (const int8_t*) in;
+        for (int i=0; i<n; i++)
+            out[i] = scale*q[i];
+    } else
+        memcpy( (void*)out, in, n*FSIZE );
+}
@@ -8,6 +8,7 @@ SDCT - sliding discrete cosine transform (Type II)
 SDCT_init       initialise a SDCT transformer handle
 SDCT            calculate the sliding DCT
 ISDCT           calculate the inverse sliding DCT
+ISDCT_sample    calculate the inverse sliding DCT at a single time sample
 SDCT_free       release a SDCT transformer handle
 SDCT_window     apply a window to the SDCT transform output
 
@@ -141,19 +142,20 @@ void SDCT_window( hSDCT h, sux_Window window, float** data ) {
 }
 
 void ISDCT( hSDCT h, float** specdata, float* result ) {
-    int its, ifr, hw, neg1;
+    for (int its=0; its<h->ns; its++)
+        result[its] = ISDCT_sample( h, specdata, its );
+}
+
+float ISDCT_sample( hSDCT h, float** specdata, int isample ) {
+    int ifr, hw, neg1;
     float val;
     
     hw = h->nwin/2;
-    
-    for ( its=0; its<h->ns; its++ ) {
-        val = 0.0;
-        neg1 = -1;
-        for ( ifr=1; ifr<=hw; ifr++ ) {
-            val += (float)neg1 * specdata[2*ifr][its];
-            neg1 *= -1;
-        }
-        result[its] = (specdata[0][its] * sqrt(2.0) + 2.0 * val) / (float)h->nwin;
+    val = 0.0;
+    neg1 = -1;
+    for ( ifr=1; ifr<=hw; ifr++ ) {
+        val += (float)neg1 * specdata[2*ifr][isample];
+        neg1 *= -1;
     }
+    return (specdata[0][isample] * sqrt(2.0) + 2.0 * val) / (float)h->nwin;
 }
-
@@ -7,9 +7,97 @@ SDFT - sliding discrete fourier transform
 
 SDFT_init       initialise a SDFT transformer handle
 SDFT            calculate the sliding DFT
-ISDCT           calculate the inverse sliding DFT
+SDFT_states     calculate the unwindowed SDFT at regular intervals of a trace
+SDFT_segment    calculate the sliding DFT of a segment of a trace
+ISDFT           calculate the inverse sliding DFT
+ISDFT_sample    calculate the inverse sliding DFT at a single time sample
 SDFT_free       release a SDFT transformer handle
 SDFT_window     apply a window to the SDFT transform output
+SDFT_windowGain return the gain of the window at the centre of the SDFT window
+SSDFT_init      initialise a streaming SDFT handle
+SSDFT_push      calculate the sliding DFT of the next chunk of a trace
+SSDFT_flush     calculate the sliding DFT of the end of a trace
+SSDFT_free      release a streaming SDFT handle
+
+**************************************************************************
+Function Prototypes:
+void SDFT_states(hSDFT h, const float* data, int nstep, complex** states);
+void SDFT_segment(hSDFT h, sux_Window window, const float* data, int ifirst,
+                  int n, const complex* state, complex** result);
+hSSDFT SSDFT_init(int nwin, sux_Window window);
+int SSDFT_push(hSSDFT h, int n, const float* data, complex** result);
+int SSDFT_flush(hSSDFT h, complex** result);
+void SSDFT_free(hSSDFT h);
+
+**************************************************************************
+SDFT_states:
+Input:
+h           SDFT handle created by SDFT_init
+data        array[ns] of trace samples, ns as given to SDFT_init
+nstep       interval in samples between the spectra kept
+
+Output:
+states      array[(ns+nstep-1)/nstep][nwin/2+1] of the unwindowed spectra at
+            samples 0, nstep, 2*nstep ...
+
+**************************************************************************
+SDFT_segment:
+Input:
+h           SDFT handle created by SDFT_init
+window      window applied to the spectra
+data        array[ns] of trace samples, ns as given to SDFT_init
+ifirst      first sample of the segment
+n           number of samples in the segment
+state       unwindowed spectrum of sample ifirst from SDFT_states
+
+Output:
+result      array[nwin/2+1][n] of spectra of samples ifirst to ifirst+n-1
+
+**************************************************************************
+SSDFT_push:
+Input:
+h           streaming SDFT handle created by SSDFT_init
+n           number of samples in the chunk
+data        array[n] of the next samples of the trace
+
+Output:
+result      array[nwin/2+1][n] of spectra for the next samples of the trace
+
+Returned:   number of samples of spectra output
+
+**************************************************************************
+SSDFT_flush:
+Input:
+h           streaming SDFT handle created by SSDFT_init
+
+Output:
+result      array[nwin/2+1][nwin/2] of spectra for the last samples of the
+            trace
+
+Returned:   number of samples of spectra output
+
+**************************************************************************
+Notes:
+The inverse SDFT of windowed spectra returns the input trace scaled by the
+window gain at the window centre.
+
+SDFT_states and SDFT_segment split SDFT of a trace into segments. The 
+spectra kept by SDFT_states let SDFT_segment carry on the recurrence from 
+the start of any segment, so its spectra are exactly those SDFT gives for 
+the same samples, without holding the spectra of the whole trace.
+
+SSDFT gives the same spectra as SDFT for a trace of any length given in
+chunks of any size, with memory that depends only on nwin. The handle keeps
+the last nwin+1 samples and the unwindowed spectrum of the last output
+sample between calls. The spectrum of a sample needs the nwin/2 samples
+after it so output lags input by nwin/2 samples: SSDFT_push returns the
+spectra of the samples it is able to and SSDFT_flush the rest, using the
+last sample for those past the end as SDFT does. After SSDFT_flush the
+handle is ready for the next trace.
+
+The spectra are written a sample at a time across the rows of result, so
+rows whose length is a power of two, which map to the same cache sets, are
+much slower than a slightly different length.
 
 ************************************************************************** 
 Author: Wayne Mogg
@@ -27,6 +115,20 @@ struct _SDFT {
     complex* cfactinv;
 };
 
+struct _SSDFT {
+    hSDFT sdft;
+    sux_Window window;
+    int nin;                /* samples of the trace pushed  */
+    int nout;               /* samples of spectra output    */
+    float* hist;            /* last nwin+1 samples, cyclic  */
+    complex* spec;          /* unwindowed spectrum of the last output sample */
+    complex* work;
+};
+
+static void directDFT( int nwin, const float* data, int ns, complex** result, int its );
+static void slideSDFT( hSDFT h, const float* data, int its, const complex* prev, complex* next );
+static void windowSpectra( int nwin, sux_Window window, complex** data, int ns, complex* work );
+
 hSDFT SDFT_init( int nwin, int nsamples ) {
     float fact;
     
@@ -58,9 +160,9 @@ void SDFT_free( hSDFT h ) {
 }
 
 void SDFT( hSDFT h, sux_Window window, float* data, complex** result ) {
-    int i, its, ifr;
+    int its, ifr;
     complex cval;
-    float oldv, newv, fact, jfact;
+    float oldv, newv;
     
     int ns = h->ns;
     int nwin = h->nwin;
@@ -68,18 +170,7 @@ void SDFT( hSDFT h, sux_Window window, float* data, complex** result ) {
     int nf = hw + 1;
     
 /* Calculate DFT directly for the first position */    
-    for (ifr=0; ifr<nf; ifr++) {
-        fact = -2.0 * PI * (float)ifr/(float)nwin;
-        cval = cmplx(0.0,0.0);
-        for (i=-hw; i<=hw; i++) {
-            jfact = fact * (float)(i+hw);
-            if (i<0) 
-                cval = cadd(cval, crmul(cmplx(cos(jfact),sin(jfact)), data[0]));
-            else
-                cval = cadd(cval, crmul(cmplx(cos(jfact),sin(jfact)), data[i]));
-        }
-        result[ifr][0] = cval;
-    }
+    directDFT( nwin, data, ns, result, 0 );
     
 /* Calculate rest of DFT using sliding algorithm */    
     for (its=1; its<ns; its++) {
@@ -94,36 +185,101 @@ void SDFT( hSDFT h, sux_Window window, float* data, complex** result ) {
     SDFT_window( h, window, result );
 }
 
-void SDFT_window( hSDFT h, sux_Window window, complex** data ) {
-    if (window==None) return;
-    float a0, a1, a2;
-    complex cm1, cm2, cp1, cp2;
-    int its, ifr;
-    
+void SDFT_states( hSDFT h, const float* data, int nstep, complex** states ) {
+    int nf = h->nwin/2 + 1;
+    complex* cur = ealloc1complex( nf );
+    complex* next = ealloc1complex( nf );
+    complex** first = ealloc2complex( 1, nf );
+    directDFT( h->nwin, data, h->ns, first, 0 );
+    for (int ifr=0; ifr<nf; ifr++)
+        cur[ifr] = first[ifr][0];
+    for (int its=0; its<h->ns; its++) {
+        if (its > 0) {
+            slideSDFT( h, data, its, cur, next );
+            complex* tmp = cur;
+            cur = next;
+            next = tmp;
+        }
+        if (its%nstep == 0)
+            memcpy( (void*)states[its/nstep], (void*)cur, nf*CSIZE );
+    }
+    free2complex( first );
+    free1complex( cur );
+    free1complex( next );
+}
+
+void SDFT_segment( hSDFT h, sux_Window window, const float* data, int ifirst, int n, const complex* state, complex** result ) {
+    int nf = h->nwin/2 + 1;
+    complex* work = ealloc1complex( nf );
+    for (int ifr=0; ifr<nf; ifr++) {
+        work[ifr] = state[ifr];
+        result[ifr][0] = state[ifr];
+    }
+    for (int i=1; i<n; i++) {
+        slideSDFT( h, data, ifirst+i, work, work );
+        for (int ifr=0; ifr<nf; ifr++)
+            result[ifr][i] = work[ifr];
+    }
+    windowSpectra( h->nwin, window, result, n, work );
+    free1complex( work );
+}
+
+/* Slide the unwindowed spectrum prev of sample its-1 on to sample its, 
+   exactly as SDFT does */
+static void slideSDFT( hSDFT h, const float* data, int its, const complex* prev, complex* next ) {
     int ns = h->ns;
-    int nwin = h->nwin;
-    int nf = nwin/2+1;
-    complex* work = ealloc1complex(nf);
-    
+    int hw = h->nwin/2;
+    int nf = hw + 1;
+    float oldv = (its-hw-1<0)? data[0] : data[its-hw-1];
+    float newv = (its+hw>ns-1)? data[ns-1] : data[its+hw];
+    complex cval = cmplx(newv-oldv,0.0);
+    for (int ifr=0; ifr<nf; ifr++)
+        next[ifr] = cmul(cadd(prev[ifr],cval),h->cfact[ifr]);
+}
+
+static void window_coefs( sux_Window window, float* a0, float* a1, float* a2 ) {
+    *a0 = 1.0;
+    *a1 = 0.0;
+    *a2 = 0.0;
     switch(window) {
         case Hann:
-            a0 = 0.5;
-            a1 = -0.25;
-            a2 = 0.0;
+            *a0 = 0.5;
+            *a1 = -0.25;
+            *a2 = 0.0;
             break;
         case Hamming:
-            a0 = 0.54;
-            a1 = -0.23;
-            a2 = 0.0;
+            *a0 = 0.54;
+            *a1 = -0.23;
+            *a2 = 0.0;
             break;
         case Blackman:
-            a0 = 0.42;
-            a1 = -0.25;
-            a2 = 0.04;
+            *a0 = 0.42;
+            *a1 = -0.25;
+            *a2 = 0.04;
+            break;
+        case None:
             break;
         default:
             err("unrecognised window function: %d", window);
     }
+}
+
+void SDFT_window( hSDFT h, sux_Window window, complex** data ) {
+    if (window==None) return;
+    complex* work = ealloc1complex(h->nwin/2+1);
+    windowSpectra( h->nwin, window, data, h->ns, work );
+    free1complex(work);
+}
+
+/* Apply the window to ns samples of spectra */
+static void windowSpectra( int nwin, sux_Window window, complex** data, int ns, complex* work ) {
+    if (window==None) return;
+    float a0, a1, a2;
+    complex cm1, cm2, cp1, cp2;
+    int its, ifr;
+    int nf = nwin/2+1;
+    
+    window_coefs( window, &a0, &a1, &a2 );
     
     for ( its=0; its<ns; its++ ) {
         memset((void*)work, 0, nf*CSIZE);
@@ -137,23 +293,151 @@ void SDFT_window( hSDFT h, sux_Window window, complex** data ) {
         for (ifr=0; ifr<nf; ifr++)
             data[ifr][its] = work[ifr];
     }
-    free1complex(work);
+}
+
+float SDFT_windowGain( hSDFT h, sux_Window window ) {
+    if (window==None) return 1.0;
+    float a0, a1, a2;
+    float fact = 2.0 * PI * (float)(h->nwin/2) / (float)h->nwin;
+    
+    window_coefs( window, &a0, &a1, &a2 );
+    return a0 + 2.0*a1*cos(fact) + 2.0*a2*cos(2.0*fact);
 }
     
 void ISDFT( hSDFT h, complex** specdata, float* result ) {
-    int its, ifr;
+    for (int its=0; its<h->ns; its++)
+        result[its] = ISDFT_sample( h, specdata, its );
+}
+
+float ISDFT_sample( hSDFT h, complex** specdata, int isample ) {
+    int ifr;
     complex val, F;
     int nwin = h->nwin;
     int nf = nwin/2+1;
-    int ns = h->ns;
 
-    for (its=0; its<ns; its++) {
-        val=cmplx(0.0,0.0);
-        for (ifr=0; ifr<nwin; ifr++) {
-            F = (ifr>nf-1)? conjg(specdata[nwin-ifr][its]) : (specdata[ifr][its]);
-            val = cadd(val, cmul(F, h->cfactinv[ifr]));
+    val=cmplx(0.0,0.0);
+    for (ifr=0; ifr<nwin; ifr++) {
+        F = (ifr>nf-1)? conjg(specdata[nwin-ifr][isample]) : (specdata[ifr][isample]);
+        val = cadd(val, cmul(F, h->cfactinv[ifr]));
+    }
+    return val.r/(float)nwin;
+}
+
+/* DFT of the window centred on the first sample of data, samples before
+   the start and after the end of the ns samples are taken as the first
+   and last sample */
+static void directDFT( int nwin, const float* data, int ns, complex** result, int its ) {
+    int hw = nwin/2;
+    int nf = hw + 1;
+    for (int ifr=0; ifr<nf; ifr++) {
+        float fact = -2.0 * PI * (float)ifr/(float)nwin;
+        complex cval = cmplx(0.0,0.0);
+        for (int i=-hw; i<=hw; i++) {
+            float jfact = fact * (float)(i+hw);
+            float v = (i<0)? data[0] : (i>ns-1)? data[ns-1] : data[i];
+            cval = cadd(cval, crmul(cmplx(cos(jfact),sin(jfact)), v));
         }
-        result[its] = val.r/(float)nwin;
+        result[ifr][its] = cval;
     }
 }
 
+hSSDFT SSDFT_init( int nwin, sux_Window window ) {
+    hSSDFT h = emalloc(sizeof(struct _SSDFT));
+    int nf = nwin/2+1;
+    h->sdft = SDFT_init( nwin, 1 );
+    h->window = window;
+    h->nin = 0;
+    h->nout = 0;
+    h->hist = ealloc1float(nwin+1);
+    h->spec = ealloc1complex(nf);
+    h->work = ealloc1complex(nf);
+    return h;
+}
+
+void SSDFT_free( hSSDFT h ) {
+    if (h) {
+        SDFT_free( h->sdft );
+        free1float( h->hist );
+        free1complex( h->spec );
+        free1complex( h->work );
+        free( h );
+        h = 0;
+    } else
+        err("bad pointer in SSDFT_free.");
+}
+
+/* Slide the spectrum on to the next output sample and store it in column
+   iout of result, newv is the sample entering the window. The spectrum
+   slid from is the column before or, at the start of a chunk, the one kept
+   from the last chunk */
+static void slide( hSSDFT h, float newv, complex** result, int iout ) {
+    int nwin = h->sdft->nwin;
+    int nf = nwin/2+1;
+    int iold = h->nout - nwin/2 - 1;
+    float oldv = h->hist[((iold<0)? 0 : iold)%(nwin+1)];
+    complex cval = cmplx(newv-oldv,0.0);
+    const complex* cfact = h->sdft->cfact;
+    if (iout > 0)
+        for (int ifr=0; ifr<nf; ifr++)
+            result[ifr][iout] = cmul(cadd(result[ifr][iout-1],cval),cfact[ifr]);
+    else
+        for (int ifr=0; ifr<nf; ifr++)
+            result[ifr][iout] = cmul(cadd(h->spec[ifr],cval),cfact[ifr]);
+    h->nout++;
+}
+
+/* Keep the unwindowed spectrum of the last of n output samples */
+static void keep( hSSDFT h, complex** result, int n ) {
+    int nf = h->sdft->nwin/2+1;
+    if (n > 0)
+        for (int ifr=0; ifr<nf; ifr++)
+            h->spec[ifr] = result[ifr][n-1];
+}
+
+/* The spectrum of the first sample once nwin/2+1 samples, or the whole
+   trace, are in the history */
+static void firstSpectrum( hSSDFT h, complex** result, int iout ) {
+    int nwin = h->sdft->nwin;
+    int nf = nwin/2+1;
+    directDFT( nwin, h->hist, MIN(h->nin, nf), result, iout );
+    h->nout = 1;
+}
+
+int SSDFT_push( hSSDFT h, int n, const float* data, complex** result ) {
+    int nout = 0;
+    if (h && data && result) {
+        int nwin = h->sdft->nwin;
+        int hw = nwin/2;
+        for (int i=0; i<n; i++) {
+            h->hist[h->nin%(nwin+1)] = data[i];
+            h->nin++;
+            if (h->nin == hw+1)
+                firstSpectrum( h, result, nout++ );
+            else if (h->nin > hw+1)
+                slide( h, data[i], result, nout++ );
+        }
+        keep( h, result, nout );
+        windowSpectra( nwin, h->window, result, nout, h->work );
+    } else
+        err("bad pointer in SSDFT_push.");
+    return nout;
+}
+
+int SSDFT_flush( hSSDFT h, complex** result ) {
+    int nout = 0;
+    if (h && result) {
+        int nwin = h->sdft->nwin;
+        if (h->nin > 0) {
+            float last = h->hist[(h->nin-1)%(nwin+1)];
+            if (h->nout == 0)
+                firstSpectrum( h, result, nout++ );
+            while (h->nout < h->nin)
+                slide( h, last, result, nout++ );
+            windowSpectra( nwin, h->window, result, nout, h->work );
+        }
+        h->nin = 0;
+        h->nout = 0;
+    } else
+        err("bad pointer in SSDFT_flush.");
+    return nout;
+}
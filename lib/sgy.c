@@ -0,0 +1,237 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+SGY - read SEG-Y format traces directly
+
+SGY_init        recognise a SEG-Y file and initialise a SEG-Y reader handle
+SGY_format      return the sample format code of the file
+SGY_samples     return the number of samples per trace in the binary header
+SGY_start       return the byte offset of the first trace in the file
+SGY_traceBytes  return the number of bytes of a trace in the file
+SGY_convert     convert a SEG-Y trace to a native seg Y trace
+SGY_free        release a SEG-Y reader handle
+
+**************************************************************************
+Function Prototypes:
+hSGY SGY_init(const void* buf, size_t size);
+void SGY_free(hSGY h);
+int SGY_format(hSGY h);
+int SGY_samples(hSGY h);
+size_t SGY_start(hSGY h);
+size_t SGY_traceBytes(hSGY h, const void* trace);
+void SGY_convert(hSGY h, const void* trace, segy* const tr);
+
+**************************************************************************
+SGY_init:
+Input:
+buf         start of the file, eg. memory mapped
+size        number of bytes available in buf
+
+Returned: SEG-Y reader handle or NULL if buf doesn't hold a SEG-Y file
+
+**************************************************************************
+SGY_traceBytes:
+Input:
+h           SEG-Y reader handle created by SGY_init
+trace       start of a trace in the file
+
+Returned:   number of bytes in the trace header and samples
+
+**************************************************************************
+SGY_convert:
+Input:
+h           SEG-Y reader handle created by SGY_init
+trace       start of a trace in the file
+
+Output:
+tr          trace with the header in native byte order and the samples
+            converted to native float
+
+**************************************************************************
+Notes:
+A file is taken to be SEG-Y when it starts with a 3200 byte textual header
+whose first character is an EBCDIC or ASCII C, and the 400 byte binary
+header that follows gives a supported sample format and a non-zero sample
+count. Extended textual headers counted in the binary header are skipped.
+Data must be big-endian as the standard requires.
+
+Sample formats 1 (4 byte IBM float), 2 (4 byte integer), 3 (2 byte
+integer), 5 (4 byte IEEE float) and 8 (1 byte integer) are supported. The
+sample count of each trace is taken from its header, or from the binary
+header if that is zero. Trace headers are byte swapped key by key as in
+segyread and IBM floats are converted as in segyread, with overflow set to
+the largest float and underflow to zero. The conversion loops work on the
+bytes of the samples without branches so the compiler can vectorise them.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include <stdint.h>
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+#define SGY_TEXTBYTES 3200
+#define SGY_BINBYTES 400
+
+struct _SGY {
+    int format;
+    int ns;
+    int nbytes;             /* bytes per sample   */
+    int swap;               /* host is little-endian */
+    size_t start;
+};
+
+static int be16( const unsigned char* b );
+static void ibm2float( int n, const unsigned char* restrict in, float* restrict out );
+static void ieee2float( int n, const unsigned char* restrict in, float* restrict out );
+static void int32tofloat( int n, const unsigned char* restrict in, float* restrict out );
+static void int16tofloat( int n, const unsigned char* restrict in, float* restrict out );
+static void int8tofloat( int n, const unsigned char* restrict in, float* restrict out );
+
+hSGY SGY_init( const void* buf, size_t size ) {
+
+    const unsigned char* b = (const unsigned char*) buf;
+    if (size < SGY_TEXTBYTES + SGY_BINBYTES + HDRBYTES)
+        return 0;
+    if (b[0] != 0xC3 && b[0] != 'C')
+        return 0;
+    const unsigned char* bin = b + SGY_TEXTBYTES;
+    int nbytes;
+    switch (be16( bin+24 )) {
+        case 1: case 2: case 5: nbytes = 4; break;
+        case 3: nbytes = 2; break;
+        case 8: nbytes = 1; break;
+        default: return 0;
+    }
+    int next = be16( bin+104 );
+    size_t start = SGY_TEXTBYTES + SGY_BINBYTES;
+    if (next > 0 && next < 0x8000 && start + next*SGY_TEXTBYTES + HDRBYTES <= size)
+        start += next*SGY_TEXTBYTES;
+    int ns = be16( b+start+114 );
+    if (ns == 0)
+        ns = be16( bin+20 );
+    if (ns == 0 || ns > SU_NFLTS || start + HDRBYTES + ns*nbytes > size)
+        return 0;
+
+    hSGY h = emalloc(sizeof(struct _SGY));
+    int one = 1;
+    h->format = be16( bin+24 );
+    h->ns = be16( bin+20 );
+    h->nbytes = nbytes;
+    h->swap = *(char*) &one;
+    h->start = start;
+    return h;
+}
+
+void SGY_free( hSGY h ) {
+    if (h) {
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in SGY_free.");
+}
+
+int SGY_format( hSGY h ) {
+    return h ? h->format : 0;
+}
+
+int SGY_samples( hSGY h ) {
+    return h ? h->ns : 0;
+}
+
+size_t SGY_start( hSGY h ) {
+    return h ? h->start : 0;
+}
+
+size_t SGY_traceBytes( hSGY h, const void* trace ) {
+    int ns = be16( (const unsigned char*) trace + 114 );
+    return HDRBYTES + ((ns)? ns : h->ns)*h->nbytes;
+}
+
+void SGY_convert( hSGY h, const void* trace, segy* const tr ) {
+    if (h && trace && tr) {
+        const unsigned char* data = (const unsigned char*) trace + HDRBYTES;
+        memcpy( (void*)tr, trace, HDRBYTES );
+        if (h->swap)
+            for (int i=0; i<SU_NKEYS; i++)
+                swaphval( tr, i );
+        int ns = (tr->ns)? tr->ns : h->ns;
+        if (ns > SU_NFLTS)
+            err("trace with %d samples is too long in SGY_convert", ns);
+        tr->ns = ns;
+        switch (h->format) {
+            case 1: ibm2float( ns, data, tr->data ); break;
+            case 2: int32tofloat( ns, data, tr->data ); break;
+            case 3: int16tofloat( ns, data, tr->data ); break;
+            case 5: ieee2float( ns, data, tr->data ); break;
+            case 8: int8tofloat( ns, data, tr->data ); break;
+        }
+    } else
+        err("bad pointer in SGY_convert.");
+}
+
+static int be16( const unsigned char* b ) {
+    return (b[0]<<8) | b[1];
+}
+
+static inline uint32_t floatToBits( float f ) {
+    union { uint32_t u; float f; } v;
+    v.f = f;
+    return v.u;
+}
+
+static inline float bitsToFloat( uint32_t u ) {
+    union { uint32_t u; float f; } v;
+    v.u = u;
+    return v.f;
+}
+
+/* An IBM float is frac*2^(4*exp-280) with a 24 bit fraction. The fraction
+   converts exactly to a float and the power of two is added to its exponent
+   bits, all in integer arithmetic so there are no denormal slow paths.
+   Results too small for a normal float are set to zero and too large to
+   the largest float, as in segyread. */
+static void ibm2float( int n, const unsigned char* restrict in, float* restrict out ) {
+    for (int i=0; i<n; i++) {
+        const unsigned char* b = in + 4*i;
+        uint32_t sign = (uint32_t) (b[0] & 0x80)<<24;
+        int32_t shift = 4*(b[0] & 0x7f) - 280;
+        int32_t frac = (b[1]<<16) | (b[2]<<8) | b[3];
+        uint32_t u = floatToBits( (float) frac );
+        int32_t e = (int32_t) (u>>23) + shift;
+        u += (uint32_t) shift<<23;
+        u = (frac == 0 || e <= 0)? 0 : (e >= 255)? sign | 0x7f7fffff : sign | u;
+        out[i] = bitsToFloat( u );
+    }
+}
+
+static void ieee2float( int n, const unsigned char* restrict in, float* restrict out ) {
+    for (int i=0; i<n; i++) {
+        const unsigned char* b = in + 4*i;
+        out[i] = bitsToFloat( ((uint32_t) b[0]<<24) | (b[1]<<16) | (b[2]<<8) | b[3] );
+    }
+}
+
+static void int32tofloat( int n, const unsigned char* restrict in, float* restrict out ) {
+    for (int i=0; i<n; i++) {
+        const unsigned char* b = in + 4*i;
+        out[i] = (float) (int32_t) (((uint32_t) b[0]<<24) | (b[1]<<16) | (b[2]<<8) | b[3]);
+    }
+}
+
+static void int16tofloat( int n, const unsigned char* restrict in, float* restrict out ) {
+    for (int i=0; i<n; i++) {
+        const unsigned char* b = in + 2*i;
+        out[i] = (float) (int16_t) ((b[0]<<8) | b[1]);
+    }
+}
+
+static void int8tofloat( int n, const unsigned char* restrict in, float* restrict out ) {
+    for (int i=0; i<n; i++)
+        out[i] = (float) (int8_t) in[i];
+}
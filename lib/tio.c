@@ -0,0 +1,873 @@
+/* Copyright (c) Wayne Mogg, 2017. */
+/* All rights reserved.            */
+
+/*********************** self documentation **********************/
+/*************************************************************************
+TIO - asynchronous double-buffered seg Y trace input and output
+
+TIO_init        initialise a trace stream handle and start the I/O threads
+TIO_initMPI     initialise a trace stream over one MPI rank's range of a file
+TIO_get         return the next input trace slot
+TIO_slot        return the next free output trace slot
+TIO_put         queue the output trace slot for writing
+TIO_quantize    write the output samples as 16 or 8 bit integers
+TIO_gettr       copy the next input trace, a replacement for gettr
+TIO_puttr       copy a trace for output, a replacement for puttr
+TIO_traces      return number of input traces if the input is memory mapped
+TIO_trace       return a pointer to any trace of memory mapped input
+TIO_free        flush the output, stop the I/O threads and release the handle
+
+**************************************************************************
+Function Prototypes:
+hTIO TIO_init(int nslots);
+hTIO TIO_initMPI(const char* infile, const char* outfile, int halo);
+void TIO_free(hTIO h);
+segy* TIO_get(hTIO h);
+segy* TIO_slot(hTIO h);
+void TIO_put(hTIO h);
+void TIO_quantize(hTIO h, int nbits, float maxerr);
+int TIO_gettr(hTIO h, segy* const tr);
+void TIO_puttr(hTIO h, const segy* const tr);
+int TIO_traces(hTIO h);
+const segy* TIO_trace(hTIO h, int itrace);
+
+**************************************************************************
+TIO_init:
+Input:
+nslots      number of trace slots in each of the input and output rings,
+            0 for the default of 64
+
+Parameter:
+compress    =1 compress the output traces, see FPZ; default 0
+
+Returned: trace stream handle
+
+**************************************************************************
+TIO_initMPI:
+Input:
+infile      name of the input file, shared by all ranks
+outfile     name of the output file, shared by all ranks
+halo        number of traces needed either side of each output trace
+
+Returned: trace stream handle
+
+**************************************************************************
+TIO_get:
+Input:
+h           trace stream handle created by TIO_init
+
+Returned:   pointer to the next input trace or NULL at the end of the data.
+            The slot stays valid until the next call to TIO_get.
+
+**************************************************************************
+TIO_slot:
+Input:
+h           trace stream handle created by TIO_init
+
+Returned:   pointer to a free output slot. Fill it then call TIO_put to
+            write it, there is only one slot outstanding at a time.
+
+**************************************************************************
+TIO_quantize:
+Input:
+h           trace stream handle created by TIO_init
+nbits       bits per output sample, 8 or 16
+maxerr      largest absolute error allowed in a sample, 0 for no limit
+
+**************************************************************************
+TIO_gettr:
+Input:
+h           trace stream handle created by TIO_init
+
+Output:
+tr          next input trace
+
+Returned:   number of bytes in the trace or 0 at the end of the data
+
+**************************************************************************
+TIO_puttr:
+Input:
+h           trace stream handle created by TIO_init
+tr          trace to write to standard output
+
+**************************************************************************
+TIO_traces:
+Input:
+h           trace stream handle created by TIO_init
+
+Returned:   number of traces in the input if it is a memory mapped SU
+            file, -1 if the input is a pipe, SEG-Y or compressed
+
+**************************************************************************
+TIO_trace:
+Input:
+h           trace stream handle created by TIO_init
+itrace      index of the trace in the input, 0 to TIO_traces-1
+
+Returned:   pointer to the trace, NULL if the input is not a memory mapped
+            uncompressed SU file
+
+**************************************************************************
+Notes:
+A reader thread fills a ring of trace slots from standard input and a
+writer thread drains a second ring to standard output with puttr.
+Both streams are given large buffers so the data is moved in large block
+reads and writes. Each ring has a single producer and a single consumer,
+the slot counters are the only shared state and are updated with atomic
+loads and stores, no locks are taken. A thread that finds its ring empty
+or full spins briefly and then sleeps.
+
+When standard input is a regular file it is memory mapped instead and no
+reader thread is started. The trace headers are walked when the stream is
+opened, while every trace has the sample count of the first the offsets
+follow directly, otherwise an offset index is built. A truncated last trace
+is dropped, so no trace extends past the end of the mapping. TIO_get then
+returns pointers straight into the
+mapping, so buffers such as OTB_push and CTB_push read the data in place,
+and TIO_trace gives random access for lookahead. The mapping is private so
+the caller may modify a trace without changing the file. Memory mapping is
+not used for XDR format data.
+
+A memory mapped file that holds SEG-Y rather than SU data, see SGY, is
+read directly. Its textual and binary headers are skipped and TIO_get
+returns each trace converted to a native seg Y trace in a slot, so
+programs read SEG-Y files without a segyread pass. SEG-Y is not
+recognised on a pipe and TIO_trace is not available for it.
+
+With compress=1 on the command line of the program the writer thread
+compresses the samples of each trace with FPZ, losslessly, before writing
+it, so the work is done off the processing thread. A compressed stream
+starts with the 8 byte magic string SUXFPZ1 and each trace is stored as its
+240 byte header, a 4 byte count of compressed bytes and the compressed
+samples, all in native byte order. Input is checked for the magic string,
+on a pipe by the reader thread and in a memory mapped file when it is
+indexed, and compressed traces are decompressed as they are read, so
+programs read and write compressed streams without any other change. On a
+pipe the reader thread reads the traces itself rather than with gettr,
+each trace may have its own sample count. TIO_trace is not available for
+compressed input. Compression and quantization are not available for XDR
+format data or with TIO_initMPI.
+
+After TIO_quantize the writer thread quantizes the output traces with QNT
+instead, a stream that starts with the magic string SUXQNT1. Each trace is
+stored as its header, a 4 byte count of bytes, the float scale and the
+bits per sample of the trace and then its samples, so every trace has its
+own scale and may use more bits than asked for to stay within maxerr.
+Quantized input is recognised and dequantized as it is read in the same
+way as compressed input. TIO_quantize must be called before the first
+trace is output and compress=1 is ignored after it.
+
+TIO_initMPI is only available when libsux is built with SUX_MPI defined,
+by make mpi. The input file is split into a contiguous range of traces
+for each rank of MPI_COMM_WORLD. A rank reads its range in blocks, the next
+block is read while the current one is processed, and the halo traces
+either side of the range are passed to it by the neighbouring ranks rather
+than read again. TIO_get returns the halo before the range, the range and
+then the halo after it. The program must output one trace of the same
+size for each input trace, the output for the range is kept and written to
+its place in the output file with collective writes, the output for the
+halos is dropped. All traces must have the same length and no rank can
+have fewer traces than the halo. MPI is initialised if needed and then
+finalised by TIO_free.
+
+The calling thread must not use gettr or puttr itself once the stream is
+started and only one thread may call TIO_get/TIO_gettr and one thread
+TIO_slot/TIO_put/TIO_puttr. Call TIO_init after requestdoc and TIO_free
+before exiting so all queued traces are written.
+
+**************************************************************************
+Author: Wayne Mogg
+**************************************************************************/
+/**************** end self doc ********************************/
+
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef SUX_MPI
+#include <mpi.h>
+#endif
+#include "cwp.h"
+#include "par.h"
+#include "sux.h"
+
+#define TIO_NSLOTS 64           /* Default number of slots in each ring */
+#define TIO_BUFSIZE 4194304     /* Stream buffer size for block I/O     */
+#define TIO_SPIN 64             /* Waits before a waiting thread sleeps */
+#define TIO_MAGICBYTES 8        /* Magic string of a coded stream       */
+#define TIO_FPZ 1               /* Losslessly compressed stream         */
+#define TIO_QNT 2               /* Quantized stream                     */
+
+static const char magic[3][TIO_MAGICBYTES] = { "", "SUXFPZ1", "SUXQNT1" };
+
+typedef struct {
+    int nslots;
+    segy* slots;
+    unsigned long head;     /* slots filled by the producer   */
+    unsigned long tail;     /* slots emptied by the consumer  */
+    int done;               /* producer has finished          */
+} _RING;
+
+struct _TIO {
+    _RING in;
+    _RING out;
+    int holding;
+    int stop;
+    char* map;              /* memory mapped input, 0 for a pipe */
+    size_t mapsize;
+    int ntr;                /* traces in the mapped input        */
+    int itr;                /* next mapped trace for TIO_get     */
+    size_t trbytes;         /* bytes per trace if fixed, else 0  */
+    size_t* offset;         /* trace offsets if not fixed        */
+    size_t base;            /* offset of the first trace         */
+    hSGY sgy;               /* SEG-Y input, 0 for SU             */
+    int zin;                /* input coding, TIO_FPZ or TIO_QNT  */
+    int zout;               /* output coding                     */
+    int qbits;              /* bits per quantized output sample  */
+    float qerr;             /* largest quantization error        */
+    unsigned char* zinbuf;  /* coded input samples               */
+    unsigned char* zoutbuf; /* coded output samples              */
+    segy* conv;             /* converted or decompressed trace   */
+    pthread_t reader;
+    pthread_t writer;
+#ifdef SUX_MPI
+    int mpi;                /* stream over an MPI rank's range   */
+    int finalize;           /* MPI was initialised by TIO         */
+    MPI_File fin;
+    MPI_File fout;
+    MPI_Request pending;    /* read of the next input block      */
+    int lo, hi;             /* range of traces output by the rank */
+    int first, last;        /* range of traces input, with halos  */
+    int nout;               /* next output trace                  */
+    int nblock;             /* traces per read or write block    */
+    int inbase, incount;    /* traces in the current input block */
+    int nextbase, nextcount;/* traces in the block being read    */
+    int outcount;           /* traces in the output block        */
+    int nwritten;           /* traces of the range written        */
+    int nwrite;             /* collective writes done             */
+    int maxwrite;           /* collective writes done by each rank */
+    char* halo0;            /* traces before the range           */
+    char* halo1;            /* traces after the range            */
+    char* inbuf;
+    char* nextbuf;
+    char* outbuf;
+    segy slot;
+#endif
+};
+
+static void initRing( _RING* r, int nslots );
+static int mapInput( hTIO h );
+static size_t traceBytes( hTIO h, const char* trace );
+static const char* mappedTrace( hTIO h, int itrace );
+static void convertTrace( hTIO h, const char* trace, segy* const tr );
+static int streamCoding( const void* buf );
+static void decodeTrace( int coding, const unsigned char* payload, segy* const tr );
+static size_t readMagic( hTIO h, segy* const tr );
+static int readTrace( hTIO h, segy* const tr, size_t nhave );
+static void writeTrace( hTIO h, const segy* const tr, int first );
+static void backoff( int* nwait );
+static void* reader( void* arg );
+static void* writer( void* arg );
+#ifdef SUX_MPI
+static segy* mpiGet( hTIO h );
+static void mpiPut( hTIO h );
+static void mpiFree( hTIO h );
+#endif
+
+hTIO TIO_init( int nslots ) {
+
+    hTIO h = emalloc(sizeof(struct _TIO));
+#ifdef SUX_MPI
+    h->mpi = 0;
+#endif
+    nslots = (nslots>0)? nslots : TIO_NSLOTS;
+    initRing( &h->out, nslots );
+    h->holding = 0;
+    h->stop = 0;
+    h->qbits = 0;
+    h->qerr = 0.0;
+    h->zinbuf = 0;
+    h->zoutbuf = 0;
+    if (!getparint("compress", &h->zout)) h->zout = 0;
+#ifdef SUXDR
+    if (h->zout)
+        warn("compress=1 is ignored for XDR format data");
+    h->zout = 0;
+#endif
+    if (h->zout) {
+        h->zout = TIO_FPZ;
+        h->zoutbuf = ealloc1( FPZ_bound(SU_NFLTS), 1 );
+    }
+    setvbuf( stdout, NULL, _IOFBF, TIO_BUFSIZE );
+    if (!mapInput( h )) {
+        initRing( &h->in, nslots );
+        setvbuf( stdin, NULL, _IOFBF, TIO_BUFSIZE );
+        if (pthread_create( &h->reader, NULL, reader, h ))
+            err("can't create reader thread in TIO_init");
+    }
+    if (pthread_create( &h->writer, NULL, writer, h ))
+        err("can't create writer thread in TIO_init");
+    return h;
+}
+
+void TIO_free( hTIO h ) {
+#ifdef SUX_MPI
+    if (h && h->mpi) {
+        mpiFree( h );
+        return;
+    }
+#endif
+    if (h) {
+        __atomic_store_n( &h->out.done, 1, __ATOMIC_RELEASE );
+        pthread_join( h->writer, NULL );
+        if (h->map) {
+            munmap( h->map, h->mapsize );
+            if (h->offset) free( h->offset );
+            if (h->sgy) SGY_free( h->sgy );
+            if (h->conv) free1( h->conv );
+        } else {
+            __atomic_store_n( &h->stop, 1, __ATOMIC_RELEASE );
+            pthread_join( h->reader, NULL );
+            free1( h->in.slots );
+            if (h->zinbuf) free1( h->zinbuf );
+        }
+        if (h->zoutbuf) free1( h->zoutbuf );
+        free1( h->out.slots );
+        free(h);
+        h = 0;
+    } else
+        err("bad pointer in TIO_free.");
+}
+
+segy* TIO_get( hTIO h ) {
+    segy* tr = 0;
+#ifdef SUX_MPI
+    if (h && h->mpi)
+        return mpiGet( h );
+#endif
+    if (h && h->map) {
+        if (h->itr >= h->ntr)
+            return 0;
+        if (h->conv) {
+            convertTrace( h, mappedTrace( h, h->itr++ ), h->conv );
+            return h->conv;
+        }
+        return (segy*) mappedTrace( h, h->itr++ );
+    } else if (h) {
+        _RING* r = &h->in;
+        unsigned long tail = r->tail;
+        if (h->holding) {
+            tail++;
+            __atomic_store_n( &r->tail, tail, __ATOMIC_RELEASE );
+            h->holding = 0;
+        }
+        int nwait = 0;
+        while (__atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) == tail) {
+            if (__atomic_load_n( &r->done, __ATOMIC_ACQUIRE ) &&
+                __atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) == tail)
+                return 0;
+            backoff( &nwait );
+        }
+        tr = &r->slots[tail%r->nslots];
+        h->holding = 1;
+    } else
+        err("bad pointer in TIO_get.");
+    return tr;
+}
+
+segy* TIO_slot( hTIO h ) {
+    segy* tr = 0;
+#ifdef SUX_MPI
+    if (h && h->mpi)
+        return &h->slot;
+#endif
+    if (h) {
+        _RING* r = &h->out;
+        int nwait = 0;
+        while (r->head - __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE ) >= (unsigned long) r->nslots)
+            backoff( &nwait );
+        tr = &r->slots[r->head%r->nslots];
+    } else
+        err("bad pointer in TIO_slot.");
+    return tr;
+}
+
+void TIO_put( hTIO h ) {
+#ifdef SUX_MPI
+    if (h && h->mpi) {
+        mpiPut( h );
+        return;
+    }
+#endif
+    if (h)
+        __atomic_store_n( &h->out.head, h->out.head+1, __ATOMIC_RELEASE );
+    else
+        err("bad pointer in TIO_put.");
+}
+
+void TIO_quantize( hTIO h, int nbits, float maxerr ) {
+    if (!h)
+        err("bad pointer in TIO_quantize.");
+#ifdef SUX_MPI
+    if (h->mpi)
+        err("quantized output is not available for MPI processing");
+#endif
+    if (nbits != 8 && nbits != 16)
+        err("can't quantize to %d bits in TIO_quantize", nbits);
+#ifndef SUXDR
+    if (!h->zoutbuf)
+        h->zoutbuf = ealloc1( FPZ_bound(SU_NFLTS), 1 );
+    h->zout = TIO_QNT;
+    h->qbits = nbits;
+    h->qerr = maxerr;
+#else
+    warn("quantized output is not available for XDR format data");
+#endif
+}
+
+int TIO_gettr( hTIO h, segy* const tr ) {
+    segy* in = TIO_get( h );
+    if (in && tr) {
+        int nbytes = HDRBYTES + in->ns*FSIZE;
+        memcpy( (void*)tr, (void*)in, nbytes );
+        return nbytes;
+    }
+    return 0;
+}
+
+void TIO_puttr( hTIO h, const segy* const tr ) {
+    if (tr) {
+        segy* out = TIO_slot( h );
+        memcpy( (void*)out, (void*)tr, HDRBYTES + tr->ns*FSIZE );
+        TIO_put( h );
+    } else
+        err("bad pointer in TIO_puttr.");
+}
+
+int TIO_traces( hTIO h ) {
+    return (h && h->map && !h->conv)? h->ntr : -1;
+}
+
+const segy* TIO_trace( hTIO h, int itrace ) {
+    if (h && h->map && !h->conv && itrace>=0 && itrace<h->ntr)
+        return (const segy*) mappedTrace( h, itrace );
+    return 0;
+}
+
+static const char* mappedTrace( hTIO h, int itrace ) {
+    return h->map + ((h->offset)? h->offset[itrace] : h->base + itrace*h->trbytes);
+}
+
+/* Bytes in a trace of the mapped file, header included */
+static size_t traceBytes( hTIO h, const char* trace ) {
+    if (h->sgy)
+        return SGY_traceBytes( h->sgy, trace );
+    if (h->zin) {
+        uint32_t nbytes;
+        memcpy( &nbytes, trace + HDRBYTES, sizeof(nbytes) );
+        return HDRBYTES + sizeof(nbytes) + nbytes;
+    }
+    return HDRBYTES + ((const segy*) trace)->ns*FSIZE;
+}
+
+/* Convert a SEG-Y or coded trace of the mapped file */
+static void convertTrace( hTIO h, const char* trace, segy* const tr ) {
+    if (h->sgy)
+        SGY_convert( h->sgy, trace, tr );
+    else {
+        memcpy( (void*)tr, trace, HDRBYTES );
+        if (tr->ns > SU_NFLTS)
+            err("trace with %d samples is too long in TIO_get", tr->ns);
+        decodeTrace( h->zin, (const unsigned char*) trace + HDRBYTES + sizeof(uint32_t), tr );
+    }
+}
+
+/* Coding of a stream from its magic string, 0 if it has none */
+static int streamCoding( const void* buf ) {
+    if (!memcmp( buf, magic[TIO_FPZ], TIO_MAGICBYTES ))
+        return TIO_FPZ;
+    if (!memcmp( buf, magic[TIO_QNT], TIO_MAGICBYTES ))
+        return TIO_QNT;
+    return 0;
+}
+
+/* Samples of a coded trace, the header is already in tr. A quantized trace
+   starts with its scale and bits per sample */
+static void decodeTrace( int coding, const unsigned char* payload, segy* const tr ) {
+    if (coding == TIO_QNT) {
+        float scale;
+        int32_t nbits;
+        memcpy( &scale, payload, sizeof(scale) );
+        memcpy( &nbits, payload + sizeof(scale), sizeof(nbits) );
+        if (nbits != 8 && nbits != 16 && nbits != 32)
+            err("bad quantized trace with %d bits per sample", nbits);
+        QNT_decode( tr->ns, payload + sizeof(scale) + sizeof(nbits), nbits, scale, tr->data );
+    } else
+        FPZ_decode( tr->ns, payload, tr->data );
+}
+
+/* Memory map standard input if it is a regular file and index the traces,
+   returns 1 if the input was mapped */
+static int mapInput( hTIO h ) {
+    h->map = 0;
+    h->mapsize = 0;
+    h->ntr = 0;
+    h->itr = 0;
+    h->trbytes = 0;
+    h->offset = 0;
+    h->base = 0;
+    h->sgy = 0;
+    h->zin = 0;
+    h->conv = 0;
+#ifndef SUXDR
+    struct stat st;
+    if (fstat( fileno(stdin), &st ) || !S_ISREG(st.st_mode) || st.st_size < HDRBYTES)
+        return 0;
+    off_t pos = lseek( fileno(stdin), 0, SEEK_CUR );
+    if (pos != 0)
+        return 0;
+    size_t size = st.st_size;
+    char* map = mmap( 0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(stdin), 0 );
+    if (map == MAP_FAILED)
+        return 0;
+    h->zin = streamCoding( map );
+    h->sgy = (h->zin)? 0 : SGY_init( map, size );
+    h->base = (h->zin)? TIO_MAGICBYTES : SGY_start( h->sgy );
+    if (!h->sgy && !h->zin && ((segy*) map)->ns <= 0) {
+        munmap( map, size );
+        return 0;
+    }
+    if (h->sgy || h->zin)
+        h->conv = ealloc1( 1, sizeof(segy) );
+    madvise( map, size, MADV_SEQUENTIAL );
+/* Walk the headers, a truncated last trace is dropped. While the traces all
+   have the same length their offsets follow from trbytes, otherwise they are
+   indexed. Compressed traces have a byte count after the header */
+    size_t hdrbytes = HDRBYTES + ((h->zin)? sizeof(uint32_t) : 0);
+    size_t off = h->base;
+    int maxtr = 0;
+    while (off + hdrbytes <= size) {
+        const segy* hdr = (const segy*) (map + off);
+        if (!h->sgy && (hdr->ns <= 0 || hdr->ns > SU_NFLTS))
+            err("input trace with %d samples in TIO_get", hdr->ns);
+        size_t nbytes = traceBytes( h, map + off );
+        if (off + nbytes > size)
+            break;
+        if (!h->ntr && !h->zin)
+            h->trbytes = nbytes;
+        if (!h->offset && nbytes != h->trbytes) {
+            maxtr = MAX(2*h->ntr, 1024);
+            h->offset = emalloc( maxtr*sizeof(size_t) );
+            for (int i=0; i<h->ntr; i++)
+                h->offset[i] = h->base + i*h->trbytes;
+            h->trbytes = 0;
+        }
+        if (h->offset) {
+            if (h->ntr == maxtr) {
+                maxtr *= 2;
+                h->offset = erealloc( h->offset, maxtr*sizeof(size_t) );
+            }
+            h->offset[h->ntr] = off;
+        }
+        h->ntr++;
+        off += nbytes;
+    }
+    if (off != size)
+        warn("ignoring %zu bytes at the end of the input", size-off);
+    h->map = map;
+    h->mapsize = size;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static void initRing( _RING* r, int nslots ) {
+    r->nslots = nslots;
+    r->slots = ealloc1( nslots, sizeof(segy) );
+    r->head = 0;
+    r->tail = 0;
+    r->done = 0;
+}
+
+/* Yield to begin with, then sleep for a tenth of a millisecond */
+static void backoff( int* nwait ) {
+    if (*nwait < TIO_SPIN) {
+        (*nwait)++;
+        sched_yield();
+    } else {
+        struct timespec ts = { 0, 100000 };
+        nanosleep( &ts, NULL );
+    }
+}
+
+/* Read the magic string of a coded stream from standard input,
+   otherwise the bytes read are the start of the first trace header.
+   Returns the number of header bytes read into tr */
+static size_t readMagic( hTIO h, segy* const tr ) {
+#ifndef SUXDR
+    size_t nhave = efread( (void*)tr, 1, TIO_MAGICBYTES, stdin );
+    if (nhave == TIO_MAGICBYTES && streamCoding( (void*)tr )) {
+        h->zin = streamCoding( (void*)tr );
+        h->zinbuf = ealloc1( FPZ_bound(SU_NFLTS), 1 );
+        return 0;
+    }
+    return nhave;
+#else
+    return 0;
+#endif
+}
+
+/* Read the next trace from standard input, the first nhave bytes of its
+   header are already in tr. Returns 0 at the end of the data */
+static int readTrace( hTIO h, segy* const tr, size_t nhave ) {
+#ifndef SUXDR
+    nhave += efread( (char*)tr + nhave, 1, HDRBYTES - nhave, stdin );
+    if (nhave < HDRBYTES) {
+        if (nhave)
+            warn("ignoring %zu bytes at the end of the input", nhave);
+        return 0;
+    }
+    if (tr->ns <= 0 || tr->ns > SU_NFLTS)
+        err("input trace with %d samples in TIO_get", tr->ns);
+    size_t nbytes = tr->ns*FSIZE;
+    if (h->zin) {
+        uint32_t zbytes;
+        if (efread( &zbytes, sizeof(zbytes), 1, stdin ) != 1 || zbytes > FPZ_bound(SU_NFLTS) ||
+            efread( h->zinbuf, 1, zbytes, stdin ) != zbytes) {
+            warn("ignoring a partial trace at the end of the input");
+            return 0;
+        }
+        decodeTrace( h->zin, h->zinbuf, tr );
+    } else if (efread( (void*)tr->data, 1, nbytes, stdin ) != nbytes) {
+        warn("ignoring a partial trace at the end of the input");
+        return 0;
+    }
+    return 1;
+#else
+    return gettr( tr );
+#endif
+}
+
+/* Write a trace to standard output, preceded by the magic string if it
+   is the first of a coded stream */
+static void writeTrace( hTIO h, const segy* const tr, int first ) {
+    if (h->zout) {
+        uint32_t zbytes;
+        if (h->zout == TIO_QNT) {
+            float scale;
+            int32_t nbits = QNT_bits( tr->ns, tr->data, h->qbits, h->qerr, &scale );
+            memcpy( h->zoutbuf, &scale, sizeof(scale) );
+            memcpy( h->zoutbuf + sizeof(scale), &nbits, sizeof(nbits) );
+            QNT_encode( tr->ns, tr->data, nbits, scale, h->zoutbuf + sizeof(scale) + sizeof(nbits) );
+            zbytes = sizeof(scale) + sizeof(nbits) + tr->ns*nbits/8;
+        } else
+            zbytes = FPZ_encode( tr->ns, tr->data, h->zoutbuf );
+        if (first)
+            efwrite( (void*)magic[h->zout], 1, TIO_MAGICBYTES, stdout );
+        efwrite( (void*)tr, 1, HDRBYTES, stdout );
+        efwrite( &zbytes, sizeof(zbytes), 1, stdout );
+        efwrite( h->zoutbuf, 1, zbytes, stdout );
+    } else
+        puttr( (segy*) tr );
+}
+
+static void* reader( void* arg ) {
+    hTIO h = (hTIO) arg;
+    _RING* r = &h->in;
+    size_t nhave = readMagic( h, &r->slots[0] );
+    for (;;) {
+        int nwait = 0;
+        while (r->head - __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE ) >= (unsigned long) r->nslots) {
+            if (__atomic_load_n( &h->stop, __ATOMIC_ACQUIRE ))
+                return NULL;
+            backoff( &nwait );
+        }
+        if (!readTrace( h, &r->slots[r->head%r->nslots], nhave ))
+            break;
+        nhave = 0;
+        __atomic_store_n( &r->head, r->head+1, __ATOMIC_RELEASE );
+    }
+    __atomic_store_n( &r->done, 1, __ATOMIC_RELEASE );
+    return NULL;
+}
+
+static void* writer( void* arg ) {
+    hTIO h = (hTIO) arg;
+    _RING* r = &h->out;
+    int first = 1;
+    for (;;) {
+        int nwait = 0;
+        while (__atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) == r->tail) {
+            if (__atomic_load_n( &r->done, __ATOMIC_ACQUIRE ) &&
+                __atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) == r->tail) {
+                fflush( stdout );
+                return NULL;
+            }
+            backoff( &nwait );
+        }
+        writeTrace( h, &r->slots[r->tail%r->nslots], first );
+        first = 0;
+        __atomic_store_n( &r->tail, r->tail+1, __ATOMIC_RELEASE );
+    }
+    return NULL;
+}
+
+#ifdef SUX_MPI
+hTIO TIO_initMPI( const char* infile, const char* outfile, int halo ) {
+
+    int flag, rank, nrank;
+    hTIO h = emalloc(sizeof(struct _TIO));
+    MPI_Initialized( &flag );
+    if (!flag)
+        MPI_Init( NULL, NULL );
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &nrank );
+    h->mpi = 1;
+    h->finalize = !flag;
+    h->map = 0;
+    h->offset = 0;
+    h->itr = 0;
+
+    if (MPI_File_open( MPI_COMM_WORLD, (char*) infile, MPI_MODE_RDONLY, MPI_INFO_NULL, &h->fin ) != MPI_SUCCESS)
+        err("can't open input file %s in TIO_initMPI", infile);
+    MPI_Offset size;
+    MPI_File_get_size( h->fin, &size );
+    MPI_File_read_at_all( h->fin, 0, &h->slot, HDRBYTES, MPI_BYTE, MPI_STATUS_IGNORE );
+    if (size < HDRBYTES || h->slot.ns <= 0)
+        err("no traces in input file %s", infile);
+    h->trbytes = HDRBYTES + h->slot.ns*FSIZE;
+    if (size%h->trbytes)
+        err("traces in %s must all have the same length for MPI processing", infile);
+    h->ntr = size/h->trbytes;
+    if (h->ntr/nrank < MAX(halo, 1))
+        err("%d traces for %d ranks with a halo of %d, use fewer ranks", h->ntr, nrank, halo);
+
+    size_t trbytes = h->trbytes;
+    h->lo = (int) (((long) rank*h->ntr)/nrank);
+    h->hi = (int) (((long) (rank+1)*h->ntr)/nrank);
+    h->first = (rank>0)? h->lo-halo : h->lo;
+    h->last = (rank<nrank-1)? h->hi+halo : h->hi;
+    h->itr = h->first;
+    h->nout = h->first;
+    h->nblock = MAX(TIO_BUFSIZE/trbytes, 1);
+    h->inbuf = ealloc1( h->nblock, trbytes );
+    h->nextbuf = ealloc1( h->nblock, trbytes );
+    h->outbuf = ealloc1( h->nblock, trbytes );
+    h->inbase = h->lo;
+    h->incount = 0;
+    h->outcount = 0;
+    h->nwritten = 0;
+    h->nwrite = 0;
+    h->maxwrite = ((h->ntr+nrank-1)/nrank + h->nblock-1)/h->nblock;
+
+/* The first traces of the range are the halo after the range of the rank
+   before, the last traces the halo before the range of the rank after */
+    int prev = (rank>0)? rank-1 : MPI_PROC_NULL;
+    int next = (rank<nrank-1)? rank+1 : MPI_PROC_NULL;
+    size_t nbytes = halo*trbytes;
+    if (nbytes > INT_MAX)
+        err("a halo of %d traces is too large for MPI, at most %d traces of %d samples", 
+            halo, (int) (INT_MAX/trbytes), h->slot.ns);
+    char* send = ealloc1( MAX(halo, 1), trbytes );
+    h->halo0 = ealloc1( MAX(halo, 1), trbytes );
+    h->halo1 = ealloc1( MAX(halo, 1), trbytes );
+    MPI_File_read_at( h->fin, (MPI_Offset) h->lo*trbytes, send, (int) nbytes, MPI_BYTE, MPI_STATUS_IGNORE );
+    MPI_Sendrecv( send, (int) nbytes, MPI_BYTE, prev, 0, h->halo1, (int) nbytes, MPI_BYTE, next, 0,
+                  MPI_COMM_WORLD, MPI_STATUS_IGNORE );
+    MPI_File_read_at( h->fin, (MPI_Offset) (h->hi-halo)*trbytes, send, (int) nbytes, MPI_BYTE, MPI_STATUS_IGNORE );
+    MPI_Sendrecv( send, (int) nbytes, MPI_BYTE, next, 1, h->halo0, (int) nbytes, MPI_BYTE, prev, 1,
+                  MPI_COMM_WORLD, MPI_STATUS_IGNORE );
+    free1( send );
+
+/* Start reading the first block of the range */
+    h->nextbase = h->lo;
+    h->nextcount = MIN(h->nblock, h->hi-h->lo);
+    MPI_File_iread_at( h->fin, (MPI_Offset) h->nextbase*trbytes, h->nextbuf, h->nextcount*trbytes,
+                       MPI_BYTE, &h->pending );
+
+    if (MPI_File_open( MPI_COMM_WORLD, (char*) outfile, MPI_MODE_CREATE|MPI_MODE_WRONLY,
+                       MPI_INFO_NULL, &h->fout ) != MPI_SUCCESS)
+        err("can't open output file %s in TIO_initMPI", outfile);
+    MPI_File_set_size( h->fout, (MPI_Offset) h->ntr*trbytes );
+    return h;
+}
+
+static segy* mpiGet( hTIO h ) {
+    int itr = h->itr;
+    size_t trbytes = h->trbytes;
+    if (itr >= h->last)
+        return 0;
+    h->itr++;
+    if (itr < h->lo)
+        return (segy*) (h->halo0 + (itr-h->first)*trbytes);
+    if (itr >= h->hi)
+        return (segy*) (h->halo1 + (itr-h->hi)*trbytes);
+    if (itr >= h->inbase + h->incount) {
+/* Swap in the block that has been read and start reading the one after */
+        MPI_Wait( &h->pending, MPI_STATUS_IGNORE );
+        char* tmp = h->inbuf;
+        h->inbuf = h->nextbuf;
+        h->nextbuf = tmp;
+        h->inbase = h->nextbase;
+        h->incount = h->nextcount;
+        h->nextbase = h->inbase + h->incount;
+        h->nextcount = MIN(h->nblock, h->hi-h->nextbase);
+        if (h->nextcount > 0)
+            MPI_File_iread_at( h->fin, (MPI_Offset) h->nextbase*trbytes, h->nextbuf, h->nextcount*trbytes,
+                               MPI_BYTE, &h->pending );
+    }
+    segy* tr = (segy*) (h->inbuf + (itr-h->inbase)*trbytes);
+    if (HDRBYTES + tr->ns*FSIZE != trbytes)
+        err("input trace %d has %d samples, traces must all have the same length for MPI processing", 
+            itr+1, tr->ns);
+    return tr;
+}
+
+/* Collective write of the output block, every rank makes maxwrite calls */
+static void mpiWrite( hTIO h ) {
+    MPI_File_write_at_all( h->fout, (MPI_Offset) (h->lo+h->nwritten)*h->trbytes, h->outbuf,
+                           h->outcount*h->trbytes, MPI_BYTE, MPI_STATUS_IGNORE );
+    h->nwritten += h->outcount;
+    h->outcount = 0;
+    h->nwrite++;
+}
+
+static void mpiPut( hTIO h ) {
+    int itr = h->nout++;
+    if (itr >= h->last)
+        err("more output than input traces in TIO_put");
+    if (HDRBYTES + h->slot.ns*FSIZE != h->trbytes)
+        err("output traces must be the same length as the input for MPI processing");
+    if (itr >= h->lo && itr < h->hi) {
+        memcpy( (void*) (h->outbuf + h->outcount*h->trbytes), (void*) &h->slot, h->trbytes );
+        if (++h->outcount == h->nblock)
+            mpiWrite( h );
+    }
+}
+
+static void mpiFree( hTIO h ) {
+    if (h->nout != h->last)
+        err("%d output traces for %d input traces", h->nout-h->first, h->last-h->first);
+    if (h->outcount)
+        mpiWrite( h );
+    while (h->nwrite < h->maxwrite)
+        mpiWrite( h );
+    if (h->nextcount > 0)
+        MPI_Wait( &h->pending, MPI_STATUS_IGNORE );
+    MPI_File_close( &h->fin );
+    MPI_File_close( &h->fout );
+    free1( h->halo0 );
+    free1( h->halo1 );
+    free1( h->inbuf );
+    free1( h->nextbuf );
+    free1( h->outbuf );
+    if (h->finalize)
+        MPI_Finalize();
+    free(h);
+}
+#endif
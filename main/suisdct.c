@@ -42,68 +42,23 @@ NULL};
 /**************** end self doc ***********************************/
 
 
-segy tr;
+hTIO tio;
 
 int
 main(int argc, char **argv)
 {
-    float dt;
-    int nwin;
-    int verbose;
+    hOP op;
 
-    int nt;
-    int tracr=0;
-    
-    int ntrc;
-    int nf;
-    int j;
-    float** specbuff;
-    hSDCT dctHandle;
- 	
 /* Initialize */
 	initargs(argc, argv);
 	requestdoc(1);
+	tio = TIO_init(0);
 
-/* Get info from first trace */ 
-    if (!gettr(&tr))  err("can't get first trace");
-    nt = tr.ns;
-    if (!getparfloat("dt", &dt))	dt = ((double) tr.dt)/1000000.0;
-    if (!dt) err("dt field is zero and not getparred");
-    if (tr.trid != AMPLITUDE) err("expecting AMPLITUDE trace but got trcid=%d", tr.trid);
-    
-/* Get parameters */
-    if (!getparint("verbose", &verbose)) verbose=0;
-    if (!getparint("nwin", &nwin)) err("nwin must be specified");
-    if (nwin%2==0) {
-        nwin++;
-        if (verbose)
-            warn("adjusting nwin to be odd, was %d now %d",nwin-1, nwin);
-    }
-    
-/* Set up DCT parameters and workspaces */
-    nf = nwin;
-    dctHandle = SDCT_init( nwin, nt );
-    specbuff = ealloc2float(nt, nf );
-    ntrc = 0;
-    tracr = 0;
-/* Main processing loop */
-    do {
-        for (j=0; j<nt; j++)
-            specbuff[ntrc][j] = tr.data[j];
-        if (ntrc == nf-1) {
-            ISDCT( dctHandle, specbuff, tr.data );
-            tr.tracr = ++tracr;
-            tr.trid = TREAL;
-            tr.f1 = 0.0f;
-            tr.d2 = 0.0f;
-            puttr(&tr);
-            ntrc = 0;
-        } else
-            ntrc++;
-    } while (gettr(&tr));
-                
-    free2float( specbuff );
-    SDCT_free( dctHandle );
+    op = OP_initargs( "suisdct", NULL );
+    if (!OP_run( op, tio ))
+        err("can't get first trace");
+    OP_free( op );
 
+    TIO_free(tio);
     return (CWP_Exit());
 }
@@ -29,6 +29,13 @@ char *sdoc[] = {
 "This process inverts a time-frequency decomposition generated by the sliding ",
 "discrete fourier transform (SUSDFT).",
 "                                                                               ",
+"Spectra that SUSDFT split into time segments, with maxns= or for complex ",
+"output of long traces, are inverted a segment at a time and joined back into ",
+"whole traces. A segment is joined to the trace before it when its delrt is ",
+"where that trace ends and tracl, fldr, tracf, cdp and offset are the same, so ",
+"each trace is output when the next one starts or the input ends. Input traces ",
+"can differ in length. ",
+"                                                                               ",
 "## Examples ",
 "   suvibro | susdft nwin=31 | suisdft nwin=31 | suximage ",
 "                                                                               ",
@@ -36,75 +43,29 @@ NULL};
 
 /* Author: Wayne Mogg, Apr 2017
  *
- * Trace header fields accessed: ns,dt, trid, ntr
+ * Trace header fields accessed: ns,dt, trid, ntr, delrt, tracl, fldr, tracf, cdp, offset
  * Trace header fields modified: tracl, tracr, d1, f2, d2, trid, ntr
  */
 /**************** end self doc ***********************************/
 
 
-segy tr;
+hTIO tio;
 
 int
 main(int argc, char **argv)
 {
-    float dt;
-    int nwin;
-    int verbose;
+    hOP op;
 
-    int nt;
-    int tracr=0;
-    
-    int ntrc;
-    int nf;
-    int j;
-    complex** specbuff;
-    hSDFT dftHandle;
- 	
 /* Initialize */
 	initargs(argc, argv);
 	requestdoc(1);
+	tio = TIO_init(0);
 
-/* Get info from first trace */ 
-    if (!gettr(&tr))  err("can't get first trace");
-    nt = tr.ns/2;
-    if (!getparfloat("dt", &dt))	dt = ((double) tr.dt)/1000000.0;
-    if (!dt) err("dt field is zero and not getparred");
-    if (tr.trid != FUNPACKNYQ) err("expecting complex trace but got trcid=%d", tr.trid);
-    
-/* Get parameters */
-    if (!getparint("verbose", &verbose)) verbose=0;
-    if (!getparint("nwin", &nwin)) err("nwin must be specified");
-    if (nwin%2==0) {
-        nwin++;
-        if (verbose)
-            warn("adjusting nwin to be odd, was %d now %d",nwin-1, nwin);
-    }
-    
-/* Set up DCT parameters and workspaces */
-    nf = nwin/2+1;
-    dftHandle = SDFT_init( nwin, nt );
-    specbuff = ealloc2complex(nt, nf );
-    ntrc = 0;
-    tracr = 0;
-/* Main processing loop */
-    do {
-        for (j=0; j<nt; j++)
-            specbuff[ntrc][j] = cmplx(tr.data[2*j],tr.data[2*j+1]);
-        if (ntrc == nf-1) {
-            ISDFT( dftHandle, specbuff, tr.data );
-            tr.ns = nt;
-            tr.tracr = ++tracr;
-            tr.trid = TREAL;
-            tr.f1 = 0.0f;
-            tr.d2 = 0.0f;
-            puttr(&tr);
-            ntrc = 0;
-        } else
-            ntrc++;
-    } while (gettr(&tr));
-                
-    free2complex( specbuff );
-    SDFT_free( dftHandle );
+    op = OP_initargs( "suisdft", NULL );
+    if (!OP_run( op, tio ))
+        err("can't get first trace");
+    OP_free( op );
 
+    TIO_free(tio);
     return (CWP_Exit());
 }
@@ -17,97 +17,62 @@ char *sdoc[] = {
 "### Optional Parameters                                                        ",
 "| Parameter | Description                                     | Default       |",
 "|:---------:| ----------------------------------------------- |:-------------:|",
+"| ntr=      | number (odd) of traces in filter window         | 5             |",
+"| nsize=    | number (odd) of time samples in filter window   | 5             |",
+"| order=    | order of the fitted polynomial, 1 to 3          | 2             |",
+"| key1=     | header word identifying lines for 3D smoothing  |               |",
+"| key2=     | header word for trace position along each line  | tracf         |",
+"| nil=      | number (odd) of lines in 3D filter window       | 5             |",
+"| dkey2=    | increment of key2 between adjacent traces       | 1             |",
 "| mode=     | =0 output filtered trace, =1 output noise       | 0             |",
-"| verbose=  | =0 no advisory messages, =1 for messages        | 0             |",
+"| verbose=  | =0 no advisory messages, =1 for messages and    | 0             |",
+"|           |    filter throughput                            |               |",
+"                                                                               ",
+"## Notes                                                                       ",
+"The filter replaces each sample by the centre value of a least squares fit of ",
+"a 2D polynomial of total degree order over a window of ntr traces by nsize ",
+"time samples. The kernel is generated for the chosen window and order and is ",
+"applied as a small number of separable passes, a time pass along each trace ",
+"followed by a pass across the traces, so cost grows linearly with window size. ",
+"Traces and samples beyond the edges of the data take the nearest edge value. ",
+"                                                                               ",
+"For a symmetric window order=3 gives the same result as order=2. The defaults ",
+"reproduce the original fixed 5x5 quadratic filter.                            ",
+"                                                                               ",
+"## 3D Smoothing                                                                ",
+"Giving key1= smooths data sorted by key1 then key2, eg. inline then crossline, ",
+"with a 3D polynomial fit over nil lines by ntr traces by nsize samples in a ",
+"single streaming pass. Only the nil lines in the window are held in memory. ",
+"The window for each trace is centred on its own key2 value, stepping dkey2 ",
+"between traces, and positions with no trace take the nearest trace in the ",
+"line, so lines need not have the same number of traces. ",
+"   eg. sulpasmooth < data.su key1=fldr key2=tracf nil=5 ntr=5 nsize=9 ",
 "                                                                               ",
 NULL};
 
 /* Author: Wayne Mogg, May 2017
  *
- * Trace header fields accessed: ns, trid
+ * Trace header fields accessed: ns, trid, key1, key2
  */
 /**************** end self doc ***********************************/
 
-segy tr;
+hTIO tio;
 
 int
 main(int argc, char **argv)
 {
-    int nsize=5;
-    int ntr = nsize;
-    int mode;
-    int verbose;
+    hOP op;
 
-    int is;
-    int nsamples;
-    cwp_Bool seismic;
-    float** db;
-    hOTB otbHandle;
-	
 // Initialize
 	initargs(argc, argv);
 	requestdoc(1);
+	tio = TIO_init(0);
 
-/* Get info from first trace */ 
-    nsamples = 0;
-    while (gettr(&tr)) {
-        seismic = ISSEISMIC(tr.trid);
-        if (seismic) {
-            nsamples = tr.ns;
-            break;
-        } else
-            warn("skipping non-seismic trace with trid=%d", tr.trid);
-    }
-    if (nsamples==0) 
-        err("zero length traces not allowed.");
-    
-// Get parameters
-    if (!getparint("mode", &mode)) mode = 0;
-    if (!getparint("verbose", &verbose)) verbose=0;
-    
-// Set up trace buffer and work space
-    db = ealloc2float( nsize, ntr );
-    otbHandle = OTB_init( ntr, nsamples );
-/* Main processing loop */
-    do {
-        seismic = ISSEISMIC(tr.trid);
-        if (seismic) {
-            if (OTB_push( otbHandle, &tr )) {
-                for (is=0; is<nsamples; is++) {
-                    OTB_getSlab(otbHandle, is, nsize, db);
-                    float outval = (-13*(db[0][0]+db[4][0]+db[0][4]+db[4][4])+
-                                    2*(db[1][0]+db[3][0]+db[0][1]+db[4][1]+db[0][3]+db[4][3]+db[1][4]+db[3][4])+
-                                    7*(db[2][0]+db[0][2]+db[4][2]+db[2][4])+
-                                   17*(db[1][1]+db[3][1]+db[1][3]+db[3][3])+
-                                   22*(db[2][1]+db[2][3]+db[1][2]+db[3][2])+
-                                   27*db[2][2])/175;
-                    tr.data[is] = (mode==1)? db[nsize/2][nsize/2] - outval: outval;
-                }
-                OTB_copyCurrentHdr( otbHandle, &tr );
-                puttr(&tr);
-            }
-        } else 
-            if (verbose) warn("skipping non-seismic trace with trid=%d", tr.trid);
-    } while (gettr(&tr));
-
-/* Handle last traces in buffer */
-    while (OTB_push( otbHandle, 0 )) {
-        for (is=0; is<nsamples; is++) {
-            OTB_getSlab(otbHandle, is, nsize, db);
-            float outval = (-13*(db[0][0]+db[4][0]+db[0][4]+db[4][4])+
-            2*(db[1][0]+db[3][0]+db[0][1]+db[4][1]+db[0][3]+db[4][3]+db[1][4]+db[3][4])+
-            7*(db[2][0]+db[0][2]+db[4][2]+db[2][4])+
-            17*(db[1][1]+db[3][1]+db[1][3]+db[3][3])+
-            22*(db[2][1]+db[2][3]+db[1][2]+db[3][2])+
-            27*db[2][2])/175;
-            tr.data[is] = (mode==1)? db[nsize/2][nsize/2] - outval: outval;
-        }
-        OTB_copyCurrentHdr( otbHandle, &tr );
-        puttr(&tr);
-    };
-
-    free2float(db);
-    OTB_free( otbHandle );
+    op = OP_initargs( "sulpasmooth", NULL );
+    if (!OP_run( op, tio ))
+        err("no traces in input.");
+    OP_free( op );
 
+    TIO_free(tio);
     return EXIT_SUCCESS;
 }
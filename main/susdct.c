@@ -27,12 +27,24 @@ char *sdoc[] = {
 "|           | hann - Hann window                              |               |",
 "|           | hamming - Hamming window                        |               |",
 "|           | blackman - Blackman window                      |               |",
+"| format=   | float - output float samples                    | float         |",
+"|           | int16 - output 16 bit integer samples           |               |",
+"|           | int8 - output 8 bit integer samples             |               |",
+"| maxerr=   | largest absolute error allowed for int16, int8  | 0 (no limit)  |",
 "| verbose=  | 0 - no advisory messages, 1 - for messages      | 0             |",
 " ",
 "## Notes ",
 "This process calculates a time-frequency decomposition of seismic data using ",
 "the sliding discrete cosine transform. ",
 " ",
+"With format=int16 or format=int8 each output trace is stored with 16 or 8 bit ",
+"samples and its own scale, 2 or 4 times smaller than float, which suits large ",
+"volumes of spectra meant for display and attributes. The error is at most the ",
+"largest absolute value of the trace divided by 65534 or 254. With maxerr= a trace ",
+"that would have a larger error uses 16 bits, or float if that is not enough. The ",
+"output can be read by any SeismicUnixExtra program, which converts the samples back ",
+"to float, but not by other SU programs. ",
+" ",
 "## Examples ",
 "   suvibro | susdct | suximage ",
 " ",
@@ -46,84 +58,33 @@ NULL};
 /**************** end self doc ***********************************/
 
 
-segy tr;
+hTIO tio;
 
 int
 main(int argc, char **argv)
 {
-    float dt;
-    int nwin;
-    int verbose;
-    cwp_String window;
-    sux_Window iwind = None;
+    cwp_String format;
+    float maxerr;
+    hOP op;
 
-    int nt;
-    float df;
-    int tracr=0;
-    
-    int nf;
-    int i,j;
-    cwp_Bool seismic;
-    hSDCT dctHandle;
-    float** specbuff;
-	
 /* Initialize */
 	initargs(argc, argv);
 	requestdoc(1);
+	tio = TIO_init(0);
+
+/* Output format, the transform parameters are read by the operator */
+    if (!getparstring("format", &format)) format = "float";
+    if (!getparfloat("maxerr", &maxerr)) maxerr = 0.0;
+    if      (STREQ(format, "int16")) TIO_quantize(tio, 16, maxerr);
+    else if (STREQ(format, "int8")) TIO_quantize(tio, 8, maxerr);
+    else if (!STREQ(format, "float"))
+        err("unknown format=\"%s\", see self-doc", format);
 
-/* Get info from first trace */ 
-    if (!gettr(&tr))  err("can't get first trace");
-    nt = tr.ns;
-    if (!getparfloat("dt", &dt))	dt = ((double) tr.dt)/1000000.0;
-    if (!dt) err("dt field is zero and not getparred");
-    
-/* Get parameters */
-    if (!getparint("verbose", &verbose)) verbose=0;
-    if (!getparint("nwin", &nwin)) nwin = 31;
-    if (nwin%2==0) {
-        nwin++;
-        if (verbose)
-            warn("adjusting nwin to be odd, was %d now %d",nwin-1, nwin);
-    }
-    if (!getparstring("window", &window)) window = "none";
-    if      (STREQ(window, "hann")) iwind = Hann;
-    else if (STREQ(window, "hamming")) iwind = Hamming;
-    else if (STREQ(window, "blackman")) iwind = Blackman;
-    else if (!STREQ(window, "none")) 
-        err("unknown window=\"%s\", see self-doc", window);
-    
-    
-/* Set up DCT parameters and workspaces */
-    df = 1.0/(2.0*nwin*dt);
-    nf = nwin;
-    dctHandle = SDCT_init( nwin, nt );
-    specbuff = ealloc2float(nt, nf );
-    
-/* Main processing loop */
-    do {
-        seismic = ISSEISMIC(tr.trid);
-        if (!seismic) {
-            if (verbose)
-                warn("ignoring input trace=%d with non-seismic trcid=%d", tr.tracl, tr.trid);
-            continue;
-        }
-        SDCT( dctHandle, iwind, tr.data, specbuff );
-        tracr = 0;
-        for ( i=0; i<nf; i++ ) {
-            for (j=0; j<nt; j++)
-                tr.data[j] = specbuff[i][j];
-            tr.trid = AMPLITUDE;
-            tr.d1 = dt;
-            tr.tracr = ++tracr;
-            tr.gx = tr.tracr;
-            tr.f2 = 0.0;
-            tr.d2 = df;
-            puttr(&tr);
-        }
-    } while (gettr(&tr));
-                
-    SDCT_free(dctHandle);
-    free2float( specbuff );
+    op = OP_initargs( "susdct", NULL );
+    if (!OP_run( op, tio ))
+        err("can't get first trace");
+    OP_free( op );
 
+    TIO_free(tio);
     return (CWP_Exit());
 }
@@ -0,0 +1,79 @@
+/* Copyright (c) Wayne Mogg, 2017.*/
+/* All rights reserved.                       */
+
+#include "su.h"
+#include "segy.h"
+#include "header.h"
+#include "sux.h"
+
+/*********************** self documentation **********************/
+char *sdoc[] = {
+"# SUSDCT_DENOISE ",
+"Time-frequency denoise over a panel of seismic traces using the sliding discrete cosine transform ",
+" ",
+"## Usage ",
+"   susdct_denoise < stdin > stdout ",
+" ",
+"### Optional Parameters                                                        ",
+"| Parameter | Description                                     | Default       |",
+"|:---------:| ----------------------------------------------- |:-------------:|",
+"| ntr=      | number (odd) of traces in analysis panel        | 9             |",
+"| nwin=     | number (odd) of samples in SDCT window          | 31            |",
+"| window=   | none - no window applied to each data segment   | none          |",
+"|           | hann - Hann window                              |               |",
+"|           | hamming - Hamming window                        |               |",
+"|           | blackman - Blackman window                      |               |",
+"| reject=   | percentage of high trace amplitudes to reject   | 10            |",
+"| type=     | swmean - only replace rejected trace with mean of accepted  | swmean |",
+"|           | swmedian - only replace rejected trace with median of accepted |     |",
+"|           | median - output median of accepted traces       |                    |",
+"|           | mean - output mean of accepted traces           |                    |",
+"| mode=     | 0 - output filtered, 1 - output noise           | 0             |",
+"| verbose=  | 0 - no advisory messages, 1 - for messages      | 0             |",
+" ",
+"## Notes ",
+"This process implements the following algorithm: ",
+" ",
+"1. Time-Frequency transform of the trace using the sliding DCT ",
+"2. For each time and SDCT coefficient across the panel of traces ",
+"    - Sort by absolute value and discard the top reject% of values ",
+"    - For type=mean or median output the mean or median respectively of the kept traces. ",
+"    - For type=swmean or swmedian output the mean or median respectively of the kept traces "
+"      only if the current trace value was rejected, otherwise the original value is passed unchanged. ",
+"    - At least one value is always kept, so reject=100 keeps the smallest. ",
+"3. Inverse sliding DCT and output ",
+" ",
+"This is the real arithmetic counterpart of susdft_denoise. Only the even SDCT ",
+"coefficients contribute to the inverse transform so only those nwin/2+1 real ",
+"values are buffered and ranked at each time sample, half the storage of the ",
+"complex spectra used by susdft_denoise. ",
+" ",
+"mode=1 outputs the input trace minus the filtered trace. ",
+" ",
+NULL};
+
+/* Author: Wayne Mogg, May 2017
+ *
+ * Trace header fields accessed: ns, trid
+ */
+/**************** end self doc ***********************************/
+
+hTIO tio;
+
+int main(int argc, char **argv)
+{
+    hOP op;
+
+// Initialize
+	initargs(argc, argv);
+	requestdoc(1);
+	tio = TIO_init(0);
+
+    op = OP_initargs( "susdct_denoise", NULL );
+    if (!OP_run( op, tio ))
+        err("no traces in input.");
+    OP_free( op );
+
+    TIO_free(tio);
+    return EXIT_SUCCESS;
+}
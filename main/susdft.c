@@ -32,12 +32,33 @@ char *sdoc[] = {
 "|           | hann - Hann window                              |               |",
 "|           | hamming - Hamming window                        |               |",
 "|           | blackman - Blackman window                      |               |",
+"| maxns=    | largest number of time samples per output trace | ns            |",
+"| format=   | float - output float samples                    | float         |",
+"|           | int16 - output 16 bit integer samples           |               |",
+"|           | int8 - output 8 bit integer samples             |               |",
+"| maxerr=   | largest absolute error allowed for int16, int8  | 0 (no limit)  |",
 "| verbose=  | 0 - no advisory messages, 1 - for messages      | 0             |",
 "                                                                               ",
 "## Notes                                                                       ",
 "This process calculates a time-frequency decomposition of seismic data using ",
 "the sliding discrete fourier transform.                                        ",
 "                                                                               ",
+"The spectra of a trace are output as one trace per frequency. With maxns= these ",
+"are split into time segments of maxns samples, output one after the other with ",
+"delrt set to the start of each segment, so memory use is proportional to the ",
+"number of frequencies times maxns rather than times the trace length. Complex ",
+"output is split into segments of 16383 samples when 2*ns would not fit in a trace. ",
+"The last segment of a trace holds the samples left over and can be shorter. ",
+"SUISDFT joins the segments back into whole traces. ",
+" ",
+"With format=int16 or format=int8 each output trace is stored with 16 or 8 bit ",
+"samples and its own scale, 2 or 4 times smaller than float, which suits large ",
+"volumes of spectra meant for display and attributes. The error is at most the ",
+"largest absolute value of the trace divided by 65534 or 254. With maxerr= a trace ",
+"that would have a larger error uses 16 bits, or float if that is not enough. The ",
+"output can be read by any SeismicUnixExtra program, which converts the samples back ",
+"to float, but not by other SU programs. ",
+" ",
 "## Examples: ",
 "   suvibro | susdft nwin=51 mode=amp window=hann | suximage ",
 " ",
@@ -47,144 +68,38 @@ NULL};
 /* Author: Wayne Mogg, Apr 2017
  *
  * Trace header fields accessed: ns,dt, trid, ntr
- * Trace header fields modified: tracl, tracr, d1, f2, d2, trid, ntr
+ * Trace header fields modified: tracl, tracr, d1, f2, d2, trid, ntr, delrt
  */
 /**************** end self doc ***********************************/
 
 
-#define CPLX    1
-#define REAL    2
-#define IMAG    3
-#define AMP     4
-#define ARG     5
-
-segy tr;
+hTIO tio;
 
 int
 main(int argc, char **argv)
 {
-    float dt;
-    int nwin;
-    cwp_String mode;
-    int imode=CPLX;
-    int verbose;
-    cwp_String window;
-    sux_Window iwind = None;
-    
-    int nt;
-    float df;
-    int tracr=0;
-    float re, im;
-    
-    int nf;
-    int i,j;
-    cwp_Bool seismic;
-    hSDFT dftHandle;
-    complex** specbuff;
-	
+    cwp_String format;
+    float maxerr;
+    hOP op;
+
 /* Initialize */
 	initargs(argc, argv);
 	requestdoc(1);
+	tio = TIO_init(0);
 
-/* Get info from first trace */ 
-    if (!gettr(&tr))  err("can't get first trace");
-    nt = tr.ns;
-    if (!getparfloat("dt", &dt))	dt = ((double) tr.dt)/1000000.0;
-    if (!dt) err("dt field is zero and not getparred");
-    
-/* Get parameters */
-    if (!getparint("verbose", &verbose)) verbose=0;
-    if (!getparint("nwin", &nwin)) nwin = 31;
-    if (nwin%2==0) {
-        nwin++;
-        if (verbose)
-            warn("adjusting nwin to be odd, was %d now %d",nwin-1, nwin);
-    }
-    if (!getparstring("mode", &mode))	mode = "complex";
-    
-    if      (STREQ(mode, "phase")) imode = ARG;
-    else if (STREQ(mode, "real"))  imode = REAL;
-    else if (STREQ(mode, "imag"))  imode = IMAG;
-    else if (STREQ(mode, "amp"))  imode = AMP;
-    else if (!STREQ(mode, "complex"))
-        err("unknown mode=\"%s\", see self-doc", mode);
+/* Output format, the transform parameters are read by the operator */
+    if (!getparstring("format", &format)) format = "float";
+    if (!getparfloat("maxerr", &maxerr)) maxerr = 0.0;
+    if      (STREQ(format, "int16")) TIO_quantize(tio, 16, maxerr);
+    else if (STREQ(format, "int8")) TIO_quantize(tio, 8, maxerr);
+    else if (!STREQ(format, "float"))
+        err("unknown format=\"%s\", see self-doc", format);
 
-    if (!getparstring("window", &window)) window = "none";
-    if      (STREQ(window, "hann")) iwind = Hann;
-    else if (STREQ(window, "hamming")) iwind = Hamming;
-    else if (STREQ(window, "blackman")) iwind = Blackman;
-    else if (!STREQ(window, "none")) 
-        err("unknown window=\"%s\", see self-doc", window);
-    
-/* Set up DFT parameters and workspaces */
-    df = 1.0/(nwin*dt);
-    nf = nwin/2+1;
-    dftHandle = SDFT_init(nwin, nt);
-    specbuff = ealloc2complex(nt, nf );
-    
-/* Main processing loop */
-    do {
-        seismic = ISSEISMIC(tr.trid);
-        if (!seismic) {
-            if (verbose)
-                warn("ignoring input trace=%d with non-seismic trcid=%d", tr.tracl, tr.trid);
-            continue;
-        }
-        SDFT( dftHandle, iwind, tr.data, specbuff );
-        
-        tracr = 0;
-        for ( i=0; i<nf; i++ ) {
-            tr.ns = nt;
-            switch (imode) {
-                case CPLX:
-                    for (j=0; j<nt; j++) {
-                        tr.data[2*j] = specbuff[i][j].r;
-                        tr.data[2*j+1] = specbuff[i][j].i;
-                    }
-                    tr.trid = FUNPACKNYQ;
-                    tr.ns = 2 * nt;
-                    break;
-                case REAL:
-                    for (j=0; j<nt; j++) 
-                        tr.data[j] = specbuff[i][j].r;
-                    tr.trid = REALPART;
-                    break;
-                case IMAG:
-                    for (j=0; j<nt; j++)
-                        tr.data[j] = specbuff[i][j].i;
-                    tr.trid = IMAGPART;
-                    break;
-                case AMP:
-                    for (j=0; j<nt; j++) {
-                        re = specbuff[i][j].r;
-                        im = specbuff[i][j].i;
-                        tr.data[j] = (float) sqrt (re * re + im * im);
-                    }
-                    tr.trid = AMPLITUDE;
-                    break;
-                case ARG:
-                    for (j=0; j<nt; j++) {
-                        re = specbuff[i][j].r;
-                        im = specbuff[i][j].i;
-                        if (re*re+im*im)
-                            tr.data[j] = atan2(im,re);
-                        else
-                            tr.data[j] = 0.0;
-                    }
-                    tr.trid = PHASE;
-                    break;
-            }
-            tr.d1 = dt;
-            tr.tracr = ++tracr;
-            tr.gx = tr.tracr;
-            tr.f2 = 0.0;
-            tr.d2 = df;
-            puttr(&tr);
-        }
-    } while (gettr(&tr));
-                
-    SDFT_free(dftHandle);
-    free2complex( specbuff );
+    op = OP_initargs( "susdft", NULL );
+    if (!OP_run( op, tio ))
+        err("can't get first trace");
+    OP_free( op );
 
+    TIO_free(tio);
     return (CWP_Exit());
 }
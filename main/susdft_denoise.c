@@ -29,11 +29,21 @@ char *sdoc[] = {
 "|           | hamming - Hamming window                        |               |",
 "|           | blackman - Blackman window                      |               |",
 "| reject=   | percentage of high trace amplitudes to reject   | 10            |",
+"| freqs=    | array of frequencies (Hz) for reject= values    |               |",
 "| type=     | swmean - only replace rejected trace with mean of accepted  | swmean |",
 "|           | swmedian - only replace rejected trace with median of accepted |     |",
 "|           | median - output median of accepted traces       |                    |",
 "|           | mean - output mean of accepted traces           |                    |",
 "| mode=     | 0 - output filtered, 1 - output noise           | 0             |",
+"| prefix=   | output file name prefix for parameter sweeps    | susdft_denoise |",
+"| storage=  | float - buffer spectra as float complex         | float         |",
+"|           | int16 - buffer spectra as block scaled int16    |               |",
+"| ntile=    | number of time samples per processing tile      | 0             |",
+"|           | 0 - process whole traces                        |               |",
+"| key1=     | header word identifying lines for 3D processing |               |",
+"| key2=     | header word for trace position along each line  | tracf         |",
+"| nil=      | number (odd) of lines in 3D analysis panel      | 3             |",
+"| dkey2=    | increment of key2 between adjacent traces       | 1             |",
 "| verbose=  | 0 - no advisory messages, 1 - for messages      | 0             |",
 " ",
 "## Notes ",
@@ -45,223 +55,174 @@ char *sdoc[] = {
 "    - For type=mean or median output the mean or median respectively of the kept traces. ",
 "    - For type=swmean or swmedian output the mean or median respectively of the kept traces "
 "      only if the current trace value was rejected, otherwise the original value is passed unchanged. ",
+"    - At least one value is always kept, so reject=100 keeps the smallest. ",
 "3. Inverse sliding DFT and output ",
 " ",
+"For a fixed reject percentage omit freqs= and give a single reject= value. For ",
+"frequency dependent rejection give matching freqs= and reject= arrays, with ",
+"freqs= strictly increasing. Linear interpolation and constant extrapolation are ",
+"used to compute the reject percentage at each SDFT frequency. Frequencies where ",
+"reject is 0 skip the amplitude ranking and the spectrum is passed through unchanged. ",
+"   eg. freqs=0,6,10,45,50,55 reject=30,30,0,0,50,0 ",
+" ",
+"For type=swmean or swmedian time samples where the current trace value was kept ",
+"at every frequency are passed through from the input trace without an inverse ",
+"transform, so the cost of the inverse scales with the amount of noise found. ",
+" ",
+"storage=int16 halves the memory used by the panel of spectra, useful for large ",
+"ntr, nwin and trace lengths. The amplitudes are ranked in float but computed ",
+"from the 16 bit spectra, each with an error of up to about 1/46000 of the ",
+"largest value in its block of 64 samples, so traces with nearly equal ",
+"amplitudes can rank differently than with storage=float. Spectra that are passed ",
+"through are taken from the float input trace and carry no error. ",
+" ",
+"ntile= bounds the memory used by the panel of spectra for very long traces. Each ",
+"trace is processed in tiles of ntile samples and only the spectra for the current ",
+"tile are held in memory. The spectra of a tile carry on the SDFT from the tile ",
+"before, so the output is the same as without ntile=, with storage=int16 only ",
+"when ntile is a multiple of 64. The SDFT of every trace in the panel is ",
+"recomputed for each output trace though, about ntr times the transform work ",
+"of untiled processing, so use ntile= only when the panel of spectra would ",
+"not fit in memory. ",
+" ",
+"## 3D Processing ",
+"Giving key1= switches to 3D processing of data sorted by key1 then key2, eg. ",
+"inline then crossline. The analysis panel for each trace is then the traces in ",
+"the nil lines centred on the trace's line whose key2 is within ntr/2*dkey2 of ",
+"its own, up to nil*ntr traces. SDFT spectra are computed once per trace and ",
+"only nil lines are held in memory, so the data are processed in a single ",
+"streaming pass. Lines need not have the same number of traces. ",
+"   eg. susdft_denoise < data.su key1=fldr key2=tracf nil=5 ntr=5 ",
+" ",
+"Parameter sweeps, storage= and ntile= are not available for 3D processing. ",
+" ",
+"## Parameter Sweeps ",
+"Giving more than one type= or, without freqs=, more than one reject= value runs ",
+"a parameter sweep. The SDFT and one full amplitude sort per time and frequency ",
+"sample are shared by every combination of type and reject, and each result is ",
+"written to its own file named prefix_type_reject.su (prefix_type.su when freqs= ",
+"is given). Nothing is written to stdout. Each result is the same as from a ",
+"single run with that type and reject. ",
+"   eg. susdft_denoise < data.su reject=5,10,20 type=swmean,median prefix=test ",
+" ",
+"## MPI Processing ",
+"make mpi builds susdft_denoise_mpi, which runs under mpirun with each rank ",
+"denoising its own range of traces of a shared file. A rank receives the ntr/2 ",
+"traces either side of its range from its neighbours and the ranks write their ",
+"output to the file together. The result is the same as from susdft_denoise. ",
+"   eg. mpirun -np 16 susdft_denoise_mpi in=data.su out=result.su ntr=11 ",
+" ",
+"Traces must all be seismic and of the same length. 3D processing and parameter ",
+"sweeps are not available. ",
+" ",
+"## Changes ",
+"type=median and type=swmedian now output the median amplitude value of the ",
+"kept traces. Earlier versions output whichever kept value the partial sort ",
+"used to find the rejected values left in the middle position, which was not ",
+"always the median, so their output differs for these types. type=mean and ",
+"type=swmean are unchanged. ",
+" ",
 NULL};
 
 /* Author: Wayne Mogg, May 2017
  *
- * Trace header fields accessed: ns, trid
+ * Trace header fields accessed: ns, trid, dt, key1, key2
  */
 /**************** end self doc ***********************************/
 
-segy tr;
-typedef enum ProcType { SwMean, SwMedian, Median, Mean } proc_Type; 
+hTIO tio;
 
 int main(int argc, char **argv)
 {
-    float dt;
-    int nwin;
+    int nfrq, nrej, nset;
+    int ntype;
+    int ncomb;
+    hOP op;
+#ifdef SUX_MPI
+    cwp_String infile, outfile;
     int ntr;
-    cwp_String window;
-    sux_Window iwind = None;
-    float reject;
-    int nkeep;
-    cwp_String type;
-    proc_Type itype = SwMean;
-    int mode;
-    int verbose;
+#endif
 
-    int is, tcount, imed, ifreq,nfreq;
-    int nsamples;
-    cwp_Bool seismic;
-    complex* specbuf;
-    float*  ampbuf;
-    int*    idxbuf;
-    hCBSDFT cbsdftH;
-	
 // Initialize
 	initargs(argc, argv);
 	requestdoc(1);
-
-/* Get info from first trace */ 
-    nsamples = 0;
-    while (gettr(&tr)) {
-        seismic = ISSEISMIC(tr.trid);
-        if (seismic) {
-            nsamples = tr.ns;
-            break;
-        } else
-            warn("skipping non-seismic trace with trid=%d", tr.trid);
-    }
-    if (nsamples==0) 
-        err("zero length traces not allowed.");
-    
-// Get parameters
-    if (!getparint("verbose", &verbose)) verbose=0;
-    if (!getparfloat("dt", &dt))	dt = ((double) tr.dt)/1000000.0;
-    if (!dt) err("trace dt field is zero and not getparred");
-    if (!getparint("nwin", &nwin)) nwin = 31;
-    if (nwin%2==0) {
-        nwin++;
-        if (verbose)
-            warn("adjusting nwin to be odd, was %d now %d",nwin-1, nwin);
-    }
+#ifdef SUX_MPI
+    if (!getparstring("in", &infile) || !getparstring("out", &outfile))
+        err("in= and out= must be given for MPI processing.");
     if (!getparint("ntr", &ntr)) ntr = 9;
-    if (!ntr%2) {
-        ntr++;
-        if (verbose)
-            warn("adjusting ntr to be odd, was %d now %d",ntr-1, ntr);
-    }
-    if (!getparfloat("reject", &reject)) reject=10.0;
-    if (reject<=0 || reject>100) {
-        warn("reject out of range 0-100, reset to 10");
-        reject = 10;
-    }
-    if (!getparstring("type", &type)) type = "swmean";
-    if      (STREQ(type, "swmedian")) itype = SwMedian;
-    else if (STREQ(type, "median")) itype = Median;
-    else if (STREQ(type, "mean")) itype = Mean;
-    else if (!STREQ(type, "swmean")) 
-        err("unknown type\"%s\", see self-doc", type);
-    
-    if (!getparint("mode", &mode)) mode = 0;
+    tio = TIO_initMPI( infile, outfile, ntr/2 );
+#else
+	tio = TIO_init(0);
+#endif
 
-    if (!getparstring("window", &window)) window = "none";
-    if      (STREQ(window, "hann")) iwind = Hann;
-    else if (STREQ(window, "hamming")) iwind = Hamming;
-    else if (STREQ(window, "blackman")) iwind = Blackman;
-    else if (!STREQ(window, "none")) 
-        err("unknown window=\"%s\", see self-doc", window);
-    
-// Set up cyclic SDFT buffer and work space
-    specbuf = ealloc1complex( ntr );
-    ampbuf = ealloc1float( ntr );
-    idxbuf = ealloc1int( ntr );
-    cbsdftH = CBSDFT_init( ntr, nsamples, nwin, iwind );
-    nfreq = CBSDFT_nfreq(cbsdftH);
-/* Main processing loop */
-    do {
-        seismic = ISSEISMIC(tr.trid);
-        if (seismic) {
-            if (CBSDFT_push(cbsdftH, &tr)) {
-                tcount = CBSDFT_traces(cbsdftH);
-                nkeep = NINT((float) tcount * (100-reject)/100);
-                if (nkeep > tcount)
-                    nkeep = tcount;
-                imed = nkeep/2;
-                float inv_nkeep = 1.0/(float)nkeep;
-                complex outval = cmplx(0.0,0.0);
-                for (is=0; is<nsamples; is++) {
-                    for (ifreq=0; ifreq<nfreq; ifreq++) {
-                        int icur = CBSDFT_getSlice( cbsdftH, is, ifreq, specbuf );
-                        for (int i=0; i<tcount; i++) {
-                            idxbuf[i] = i;
-                            ampbuf[i] = rcabs(specbuf[i]);
-                        }
-                        qkifind( nkeep, tcount, ampbuf, idxbuf );
-                        switch(itype) {
-                            case (Mean):
-                                outval = cmplx(0.0,0.0);
-                                for (int i=0; i<nkeep; i++)
-                                    outval = cadd(outval, specbuf[idxbuf[i]]);
-                                outval = crmul( outval, inv_nkeep);
-                                break;
-                            case (Median):
-                                outval = specbuf[idxbuf[imed]];
-                                break;
-                            case (SwMedian):
-                                outval = specbuf[idxbuf[imed]];
-                                for (int i=0; i<nkeep; i++) {
-                                    if (idxbuf[i] == icur) {
-                                        outval = specbuf[icur];
-                                        break;
-                                    }
-                                }
-                                break;
-                            default:
-                                outval = cmplx(0.0,0.0);
-                                for (int i=0; i<nkeep; i++)
-                                    outval = cadd(outval, specbuf[idxbuf[i]]);
-                                outval = crmul( outval, inv_nkeep);
-                                for (int i=0; i<nkeep; i++) {
-                                    if (idxbuf[i] == icur) {
-                                        outval = specbuf[icur];
-                                        break;
-                                    }
-                                }
-                        };
-                        outval = (mode==1)? csub(specbuf[icur],outval): outval;
-                        CBSDFT_setResult( cbsdftH, is, ifreq, outval );
-                    }
-                }
-                CBSDFT_getResult( cbsdftH, &tr );
-                puttr(&tr);
+/* The operator outputs a parameter sweep as one trace per combination */
+    nfrq = countparval("freqs");
+    nrej = MAX(countparval("reject"), 1);
+    ntype = MAX(countparval("type"), 1);
+    nset = (nfrq>0)? 1 : nrej;
+    ncomb = nset*ntype;
+#ifdef SUX_MPI
+    if (countparval("key1") || ncomb>1)
+        err("3D processing and parameter sweeps are not available with MPI");
+    op = OP_initargs( "susdft_denoise", "in,out" );
+#else
+    op = OP_initargs( "susdft_denoise", "prefix" );
+#endif
+    if (ncomb>1) {
+        cwp_String prefix;
+        cwp_String* types = ealloc1( ntype, sizeof(cwp_String) );
+        float* reject = ealloc1float( nrej );
+        FILE** fps = ealloc1( ncomb, sizeof(FILE*) );
+        char fname[BUFSIZ];
+        int verbose;
+        segy* tr;
+        segy* out;
+        int ntr = 0;
+        int k = 0;
+
+/* Output file for each combination, named after the parameters */
+        if (!getparint("verbose", &verbose)) verbose = 0;
+        if (!getparstring("prefix", &prefix)) prefix = "susdft_denoise";
+        if (!getparstringarray("type", types)) types[0] = "swmean";
+        if (!getparfloat("reject", reject)) reject[0] = 10.0;
+        for (int iset=0; iset<nset; iset++) {
+            if (reject[iset]<0 || reject[iset]>100)
+                reject[iset] = 10;
+            for (int it=0; it<ntype; it++) {
+                if (nfrq>0)
+                    snprintf( fname, BUFSIZ, "%s_%s.su", prefix, types[it] );
+                else
+                    snprintf( fname, BUFSIZ, "%s_%s_%g.su", prefix, types[it], reject[iset] );
+                fps[iset*ntype+it] = efopen( fname, "w" );
+                if (verbose) warn("writing sweep output to %s", fname);
             }
-        } else 
-            if (verbose) warn("skipping non-seismic trace with trid=%d", tr.trid);
-    } while (gettr(&tr));
+        }
 
-/* Handle last traces in buffer */
-    while(CBSDFT_push(cbsdftH, 0)) {
-        tcount = CBSDFT_traces(cbsdftH);
-        nkeep = NINT((float) tcount * (100-reject)/100);
-        if (nkeep > tcount)
-            nkeep = tcount;
-        imed = nkeep/2;
-        float inv_nkeep = 1.0/(float)nkeep;
-        complex outval = cmplx(0.0,0.0);
-        for (is=0; is<nsamples; is++) {
-            for (ifreq=0; ifreq<nfreq; ifreq++) {
-                int icur = CBSDFT_getSlice( cbsdftH, is, ifreq, specbuf );
-                for (int i=0; i<tcount; i++) {
-                    idxbuf[i] = i;
-                    ampbuf[i] = rcabs(specbuf[i]);
-                }
-                qkifind( nkeep, tcount, ampbuf, idxbuf );
-                switch(itype) {
-                    case (Mean):
-                        outval = cmplx(0.0,0.0);
-                        for (int i=0; i<nkeep; i++)
-                            outval = cadd(outval, specbuf[idxbuf[i]]);
-                        outval = crmul( outval, inv_nkeep);
-                        break;
-                    case (Median):
-                        outval = specbuf[idxbuf[imed]];
-                        break;
-                    case (SwMedian):
-                        outval = specbuf[idxbuf[imed]];
-                        for (int i=0; i<nkeep; i++) {
-                            if (idxbuf[i] == icur) {
-                                outval = specbuf[icur];
-                                break;
-                            }
-                        }
-                        break;
-                    default:
-                        outval = cmplx(0.0,0.0);
-                        for (int i=0; i<nkeep; i++)
-                            outval = cadd(outval, specbuf[idxbuf[i]]);
-                        outval = crmul( outval, inv_nkeep);
-                        for (int i=0; i<nkeep; i++) {
-                            if (idxbuf[i] == icur) {
-                                outval = specbuf[icur];
-                                break;
-                            }
-                        }
-                }
-                outval = (mode==1)? csub(specbuf[icur],outval): outval;
-                CBSDFT_setResult( cbsdftH, is, ifreq, outval );
+        while ((tr = TIO_get(tio))) {
+            OP_push( op, tr );
+            ntr++;
+            while ((out = OP_pull( op ))) {
+                fputtr( fps[k], out );
+                k = (k+1)%ncomb;
             }
         }
-        CBSDFT_getResult( cbsdftH, &tr );
-        puttr(&tr);
-    };
+        OP_flush( op );
+        while ((out = OP_pull( op ))) {
+            fputtr( fps[k], out );
+            k = (k+1)%ncomb;
+        }
+        if (!ntr)
+            err("no traces in input.");
 
-    free1(specbuf);
-    free1float(ampbuf);
-    free1int(idxbuf);
-    CBSDFT_free( cbsdftH );
+        for (int i=0; i<ncomb; i++)
+            efclose( fps[i] );
+        free1( fps );
+        free1( types );
+        free1float( reject );
+    } else if (!OP_run( op, tio ))
+        err("no traces in input.");
+    OP_free( op );
 
+    TIO_free(tio);
     return EXIT_SUCCESS;
 }
@@ -23,6 +23,13 @@ char *sdoc[] = {
 "## Notes ",
 "This is primarily a demonstation and test platform for the ordered trace buffer implementation. ",
 " ",
+"## MPI Processing ",
+"make mpi builds sutrcmedian_mpi, which runs under mpirun with each rank filtering ",
+"its own range of traces of a shared file. The result is the same as from sutrcmedian. ",
+"   eg. mpirun -np 4 sutrcmedian_mpi in=data.su out=result.su ntr=7 ",
+" ",
+"Traces must all be seismic and of the same length. ",
+" ",
 NULL};
 
 /* Author: Wayne Mogg, May 2017
@@ -31,88 +38,38 @@ NULL};
  */
 /**************** end self doc ***********************************/
 
-segy tr;
+hTIO tio;
 
 int
 main(int argc, char **argv)
 {
+    hOP op;
+#ifdef SUX_MPI
+    cwp_String infile, outfile;
     int ntr;
-    int mode;
-    int verbose;
+#endif
 
-    int is, tcount, imed;
-    int nsamples;
-    cwp_Bool seismic;
-    float* databuf;
-    hOTB otbHandle;
-	
 // Initialize
 	initargs(argc, argv);
 	requestdoc(1);
-
-/* Get info from first trace */ 
-    nsamples = 0;
-    while (gettr(&tr)) {
-        seismic = ISSEISMIC(tr.trid);
-        if (seismic) {
-            nsamples = tr.ns;
-            break;
-        } else
-            warn("skipping non-seismic trace with trid=%d", tr.trid);
-    }
-    if (nsamples==0) 
-        err("zero length traces not allowed.");
-    
-// Get parameters
+#ifdef SUX_MPI
+    if (!getparstring("in", &infile) || !getparstring("out", &outfile))
+        err("in= and out= must be given for MPI processing.");
     if (!getparint("ntr", &ntr)) ntr = 5;
-    if (!ntr%2) {
-        ntr++;
-        if (verbose)
-            warn("adjusting ntr to be odd, was %d now %d",ntr-1, ntr);
-    }
-    if (!getparint("mode", &mode)) mode = 0;
-    if (!getparint("verbose", &verbose)) verbose=0;
-    
-// Set up trace buffer and work space
-    databuf = ealloc1float( ntr );
-    otbHandle = OTB_init( ntr, nsamples );
-/* Main processing loop */
-    do {
-        seismic = ISSEISMIC(tr.trid);
-        if (seismic) {
-            if (OTB_push( otbHandle, &tr )) {
-                tcount = OTB_traces(otbHandle);
-                imed = tcount/2;
-                for (is=0; is<nsamples; is++) {
-                    int icur = OTB_getSlice( otbHandle, is, databuf );
-                    float curval = databuf[icur];
-                    qkfind( imed, tcount, databuf );
-                    tr.data[is] = (mode==1)? curval - databuf[imed]: databuf[imed];
-                }
-                OTB_copyCurrentHdr( otbHandle, &tr );
-                puttr(&tr);
-            }
-        } else 
-            if (verbose) warn("skipping non-seismic trace with trid=%d", tr.trid);
-    } while (gettr(&tr));
-
-/* Handle last traces in buffer */
-    while (OTB_push( otbHandle, 0 )) {
-        tcount = OTB_traces(otbHandle);
-        imed = tcount/2;
-        float curval;
-        for (is=0; is<nsamples; is++) {
-            int icur = OTB_getSlice( otbHandle, is, databuf );
-            curval = databuf[icur];
-            qkfind( imed, tcount, databuf);
-            tr.data[is] = (mode==1)? curval - databuf[imed]: databuf[imed];
-        }
-        OTB_copyCurrentHdr( otbHandle, &tr );
-        puttr(&tr);
-    };
+    tio = TIO_initMPI( infile, outfile, ntr/2 );
+#else
+	tio = TIO_init(0);
+#endif
 
-    free1(databuf);
-    OTB_free( otbHandle );
+#ifdef SUX_MPI
+    op = OP_initargs( "sutrcmedian", "in,out" );
+#else
+    op = OP_initargs( "sutrcmedian", NULL );
+#endif
+    if (!OP_run( op, tio ))
+        err("no traces in input.");
+    OP_free( op );
 
+    TIO_free(tio);
     return EXIT_SUCCESS;
 }
@@ -6,6 +6,7 @@
 #include "su.h"
 #include "segy.h"
 #include "header.h"
+#include "sux.h"
 
 /****************************** self documentation ******************************/
 char *sdoc[] = {
@@ -30,6 +31,12 @@ char *sdoc[] = {
 "| pnoise=   | relative additive noise level                   | 0.001         |",
 "| mincorr=  | start of autocorrelation window in seconds      | tmin          |",
 "| maxcorr=  | end of autocorrelation window in seconds        | tmax          |",
+"| gates=    | array of design gate boundaries in seconds      |               |",
+"| fft=      | 0 - direct autocorrelation and filtering        | automatic     |",
+"|           | 1 - FFT autocorrelation and filtering           |               |",
+"| gkey=     | header word defining gathers for averaging      |               |",
+"| ntr=      | number (odd) of traces in rolling average       | 1             |",
+"| threads=  | number of worker threads                        | 1             |",
 "| verbose=  | 0 - no advisory messages, 1 - for messages      | 0             |",
 "                                                                               ",
 "Trace header fields accessed: ns, dt                                           ",
@@ -41,164 +48,64 @@ char *sdoc[] = {
 "- Linear interpolation and constant extrapolation used to compute lag from the ",
 "arrays.                                                                        ",
 "                                                                               ",
+"For long operators the autocorrelation and the application of the filter are  ",
+"done by FFT. Unless fft= is given the choice is made for each trace by        ",
+"comparing the cost of the direct sums, which grows with the operator length   ",
+"and lag, with the cost of the FFTs, which grows with the trace length. The    ",
+"FFT size and work space are set up once from the longest lag and reused for   ",
+"every trace.                                                                  ",
+"                                                                               ",
+"The Levinson recursions of batches of traces are solved together in lockstep ",
+"so they vectorise across traces, with any singular or degenerate system      ",
+"solved on its own by stoepf. The result is the same as solving each trace    ",
+"separately.                                                                   ",
+"                                                                               ",
+"gates=t0,t1,...,tn gives n design gates, gate k running from tk to tk+1, in  ",
+"place of the mincorr= and maxcorr= window. A filter is designed from the      ",
+"autocorrelation of each gate and the filters are applied in one pass, each    ",
+"filter being used alone up to the centre of its gate and blended linearly     ",
+"with the filter of the next gate between the two gate centres. With the FFT  ",
+"the transform of the trace is shared by the filters of all gates. gates= can  ",
+"not be combined with gkey= or ntr=.                                           ",
+"                                                                               ",
+"By default a filter is designed from the autocorrelation of each trace. With  ",
+"gkey= the autocorrelations, normalised by their zero lag value, are averaged  ",
+"over all traces with the same gkey value and the filter is designed once per  ",
+"gather and reused for every trace in it, only being redesigned if the lag     ",
+"changes. With ntr= the normalised autocorrelations are averaged over a rolling ",
+"window of ntr traces centred on each output trace. Averaging gives more stable ",
+"operators, traces in a gather must be adjacent. Near the first and last      ",
+"traces the rolling window is cut short, so every input trace is output even  ",
+"when ntr is larger than the number of traces.                                 ",
+"                                                                               ",
+"Each trace is filtered independently so with threads= greater than 1 the      ",
+"traces read fill a ring of trace slots, the worker threads each design        ",
+"and apply filters with their own work space, and the traces are written out   ",
+"in input order as they complete. The output is identical to threads=1.        ",
+"threads= is ignored when autocorrelations are averaged with gkey= or ntr=.    ",
+"                                                                               ",
 "This is a simplified version of supef                                          ",                                                                               
 "                                                                               ",
 NULL};
 /*********************** end self doc *******************************************/
 
-segy intrace, outtrace;
+hTIO tio;
 
 int
 main(int argc, char **argv)
 {
-    float dt;
-    int ns;
-    cwp_Bool seismic;
+    hOP op;
 
-    cwp_String key;
-    int nlag;
-    float* xlag=NULL;
-    float* lag=NULL;
-    int ilag;
-    float len;
-    int ilen, lenbytes;
-    float pnoise;
-    float mincorr;
-    float maxcorr;
-    int imincorr, imaxcorr, ncorr, lcorr;
-    int verbose;
-
-    cwp_String keyType;
-    int keyIndex;
-    Value keyVal;
-    float val;
-    
-    float* wiener=NULL;
-    float* spiker=NULL;
-    float* crosscorr=NULL;
-    float* autocorr=NULL;
-    
 /* Initialize */
     initargs(argc, argv);
     requestdoc(1);
+    tio = TIO_init(0);
 
-/* Get info from first trace */ 
-    if (!gettr(&intrace)) err("can't get first trace");
-    ns = intrace.ns;
-    if (!getparfloat("dt", &dt))	dt = ((double) intrace.dt)/1000000.0;
-    if (!dt) err("dt field is zero and not getparred");
-
-/* Get parameters */
-    if (!getparint("verbose", &verbose)) verbose=0;
-    if (!getparstring("key", &key)) key="cdp";
-    nlag = countparval("xlag");
-    if (nlag>0) {
-        if (countparval("lag")!=nlag)
-            err("a lag value must be given for each %s in xlag=", key);
-    }
-    else {
-        nlag = 1;
-    }
-    xlag = ealloc1float(nlag);
-    if (!getparfloat("xlag",xlag)) xlag[0] = intrace.cdp;
-    lag = ealloc1float(nlag);
-    if (!getparfloat("lag",lag)) lag[0] = dt;
-    
-    if (getparfloat("mincorr", &mincorr)) {
-        if (mincorr < 0.0) {
-            warn("mincorr=%g too small resetting to start of trace", mincorr);
-            imincorr=0;
-        } else
-            imincorr = NINT(mincorr/dt);
-    } else
-        imincorr = 0;
-    
-    if (getparfloat("maxcorr", &maxcorr)) {
-        imaxcorr = NINT(maxcorr/dt);
-        if (imaxcorr > ns) {
-            warn("maxcorr=%g too big resetting to end of trace", maxcorr);
-            imaxcorr = ns;
-        } else if (imaxcorr<imincorr) 
-            err("maxcorr: %g is less than mincorr: %g", maxcorr, mincorr);
-    } else
-        imaxcorr = ns;
-    
-    if (!getparfloat("pnoise", &pnoise)) pnoise = 0.001;
-    if (!getparfloat("len", &len)) len = (float) ns*dt/20;
-    ilen = NINT(len/dt);
-
-/* Get key type and index */
-    keyType = hdtype(key);
-    keyIndex = getindex(key);
-    
-    ncorr = imaxcorr - imincorr + 1;
-
-/* Compute byte sizes in wiener/spiker and autocorr */
-    lenbytes = FSIZE*ilen;
-
-/* Allocate memory */
-    wiener	 = ealloc1float(ilen);
-    spiker	 = ealloc1float(ilen);
-    autocorr = ealloc1float(ncorr);
-
-/* Main processing loop */
-    do {
-        seismic = ISSEISMIC(intrace.trid);
-        if (!seismic) {
-            if (verbose)
-                warn("ignoring input trace=%d with non-seismic trcid=%d", intrace.tracl, intrace.trid);
-            continue;
-        }
-        gethval(&intrace, keyIndex, &keyVal);
-        val = vtof(keyType, keyVal);
-        
-        float filtlag;
-        intlin(nlag, xlag, lag, lag[0], lag[nlag-1], 1, &val, &filtlag );
-        ilag = NINT(filtlag/dt);
-        lcorr = ilag + ilen + 1;
-        crosscorr = autocorr + ilag;
-        
-/* zero out filter vectors */
-        memset((void *) wiener, 0, lenbytes);
-        memset((void *) spiker, 0, lenbytes);
-        memset((void *) autocorr, 0, ncorr*FSIZE);
-
-/* Form autocorrelation vector */
-        xcor(ncorr, imincorr, intrace.data, ncorr, imincorr, intrace.data, lcorr, 0, autocorr);
-/* Leave trace alone if autocorr[0] vanishes */
-        if (autocorr[0] == 0.0) {
-            puttr(&intrace);
-            continue;
-        }
-
-/* Whiten */
-        autocorr[0] *= 1.0 + pnoise;
-
-/* Get inverse filter by Wiener-Levinson */
-        stoepf(ilen, autocorr, crosscorr, wiener, spiker);
-
-/* Convolve pefilter with trace - don't do zero multiplies */
-        for (int i = 0; i < ns; ++i) {
-            register int j;
-            register int n = MIN(i, ilag+ilen); 
-            register float sum = intrace.data[i];
-
-            for (j = ilag; j <= n; ++j)
-                sum -= wiener[j-ilag] * intrace.data[i-j];
-
-            outtrace.data[i] = sum;
-        }
-
-/* Output filtered trace */
-        memcpy( (void *) &outtrace, (const void *) &intrace, HDRBYTES);
-        puttr(&outtrace);
-    } while (gettr(&intrace));
-
-    free1float(wiener);
-    free1float(spiker);
-    free1float(autocorr);
-    free1float(xlag);
-    free1float(lag);
+    op = OP_initargs( "suvpef", NULL );
+    if (!OP_run( op, tio ))
+        err("can't get first trace");
+    OP_free( op );
 
+    TIO_free(tio);
     return(CWP_Exit());
 }
@@ -0,0 +1,330 @@
+/* Copyright (c) Wayne Mogg, 2017.*/
+/* All rights reserved.                       */
+
+#include <pthread.h>
+#include "su.h"
+#include "segy.h"
+#include "header.h"
+#include "sux.h"
+
+/*********************** self documentation **********************/
+char *sdoc[] = {
+"# SUXCHAIN ",
+"Run a chain of SeismicUnixExtra processes in one program ",
+" ",
+"## Usage ",
+"   suxchain \"stage\" [\"stage\" ...] [threads=] < stdin > stdout ",
+" ",
+"### Stages ",
+"Each stage is a quoted string with the name of a program followed by its parameters, eg: ",
+" ",
+"   suxchain \"suctrcmedian ntr=7 mode=1\" \"susdft nwin=31 mode=amp\" < in.su > out.su ",
+" ",
+"gives the same result as: ",
+" ",
+"   suctrcmedian ntr=7 mode=1 < in.su | susdft nwin=31 mode=amp > out.su ",
+" ",
+"| Stage        | Parameters                                  |",
+"|:------------:| ------------------------------------------- |",
+"| susdft       | nwin, mode, window, dt, maxns, format, maxerr, verbose |",
+"| suisdft      | nwin, dt, verbose                           |",
+"| susdct       | nwin, window, dt, format, maxerr, verbose   |",
+"| suisdct      | nwin, dt, verbose                           |",
+"| sutrcmedian  | ntr, mode, verbose                          |",
+"| suctrcmedian | ntr, mode, verbose                          |",
+"| susdft_denoise | ntr, nwin, window, dt, reject, freqs, type, mode, storage, ntile, key1, key2, nil, dkey2, verbose |",
+"| susdct_denoise | ntr, nwin, window, reject, type, mode, verbose |",
+"| sulpasmooth  | ntr, nsize, order, key1, key2, nil, dkey2, mode, verbose |",
+"| suvpef       | dt, key, xlag, lag, len, pnoise, mincorr, maxcorr, gates, fft, gkey, ntr, threads, verbose |",
+" ",
+"### Optional Parameters ",
+"| Parameter | Description                                     | Default       |",
+"|:---------:| ----------------------------------------------- |:-------------:|",
+"| threads=  | =0 run all stages on one thread                 | 0             |",
+"|           | =1 run each stage on its own thread             |               |",
+"| qsize=    | traces queued between stages when threads=1     | 16            |",
+"| verbose=  | =0 no advisory messages, =1 for messages        | 0             |",
+" ",
+"## Notes ",
+"Traces are passed between the stages by pointer instead of through a pipe, which saves ",
+"formatting and copying every trace twice for each stage. The parameters of a stage ",
+"have the same meaning and defaults as for the program, and a parameter the program ",
+"does not take is an error. format= and maxerr= set the format of the output so they ",
+"can only be given for the last stage. The median stages also filter the spectra from ",
+"susdft and susdct, so they can run between a transform and its inverse. A parameter ",
+"sweep of susdft_denoise writes files so it is not available as a stage, each stage ",
+"takes a single type= and, without freqs=, a single reject= value. ",
+" ",
+"With threads=1 the stages run concurrently, connected by queues of qsize traces, which ",
+"helps when the stages do similar amounts of work. The output is the same in both modes. ",
+" ",
+NULL};
+
+/* Author: Wayne Mogg, May 2017
+ *
+ * Trace header fields accessed: ns, trid and those of the stages
+ */
+/**************** end self doc ***********************************/
+
+/* Bounded queue of traces between two stages */
+typedef struct {
+    int nslots;
+    int head;
+    int count;
+    int done;
+    segy* slots;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} chain_Queue;
+
+typedef struct {
+    hOP op;
+    chain_Queue* in;
+    chain_Queue* out;
+} chain_Stage;
+
+hTIO tio;
+
+static hOP chain_parse( char* stage, int* nbits, float* maxerr );
+static void chain_serial( int nop, hOP* ops );
+static void chain_threaded( int nop, hOP* ops, int qsize );
+
+int
+main(int argc, char **argv)
+{
+    int threads;
+    int qsize;
+    int verbose;
+    int nop;
+    hOP* ops;
+    int nbits = 0;
+    int iquant = -1;
+    float maxerr = 0.0;
+
+// Initialize
+    initargs(argc, argv);
+    requestdoc(1);
+
+// Get parameters
+    if (!getparint("threads", &threads)) threads = 0;
+    if (!getparint("qsize", &qsize)) qsize = 16;
+    if (qsize < 1) qsize = 1;
+    if (!getparint("verbose", &verbose)) verbose = 0;
+
+/* Arguments whose first word is a name=value pair are parameters of suxchain */
+    nop = 0;
+    ops = ealloc1( argc, sizeof(hOP) );
+    for (int i=1; i<argc; i++) {
+        size_t len = strcspn( argv[i], " \t" );
+        if (memchr( argv[i], '=', len ))
+            continue;
+        int qbits;
+        float qerr;
+        ops[nop] = chain_parse( argv[i], &qbits, &qerr );
+        if (qbits) {
+            nbits = qbits;
+            maxerr = qerr;
+            iquant = nop;
+        }
+        if (verbose)
+            warn("stage %d: %s", nop+1, OP_name(ops[nop]));
+        nop++;
+    }
+    if (nop==0)
+        err("no stages given.");
+    if (iquant>=0 && iquant!=nop-1)
+        err("format= can only be given for the last stage.");
+
+    tio = TIO_init(0);
+    if (nbits)
+        TIO_quantize( tio, nbits, maxerr );
+    if (threads && nop>1)
+        chain_threaded( nop, ops, qsize );
+    else
+        chain_serial( nop, ops );
+
+    for (int i=0; i<nop; i++)
+        OP_free( ops[i] );
+    free1( ops );
+    TIO_free(tio);
+    return EXIT_SUCCESS;
+}
+
+/* Create the operator for a stage string: a program name followed by its
+   parameters separated by white space. The copy of the string is kept as
+   the parameters point into it. nbits is set to 16 or 8 for format=int16
+   or int8, which the output stream applies, and 0 otherwise */
+static hOP chain_parse( char* stage, int* nbits, float* maxerr )
+{
+    int npar = 0;
+    char* copy = ealloc1( strlen(stage)+1, 1 );
+    char** par = ealloc1( strlen(stage)/2+1, sizeof(char*) );
+    strcpy( copy, stage );
+    char* name = strtok( copy, " \t" );
+    char* tok;
+    while ((tok = strtok( NULL, " \t" ))) {
+        if (!strchr( tok, '=' ))
+            err("parameter \"%s\" of stage \"%s\" is not name=value", tok, name);
+        par[npar++] = tok;
+    }
+    hOP op = OP_init( name, npar, par );
+    if (!op)
+        err("unknown stage \"%s\"", name);
+    char* format;
+    *nbits = 0;
+    if (!OP_getfloat( npar, par, "maxerr", maxerr )) *maxerr = 0.0;
+    if (OP_getstring( npar, par, "format", &format )) {
+        if      (STREQ(format, "int16")) *nbits = 16;
+        else if (STREQ(format, "int8")) *nbits = 8;
+        else if (!STREQ(format, "float"))
+            err("%s: unknown format=\"%s\"", name, format);
+    }
+    free1( par );
+    return op;
+}
+
+/* Pass a trace to stage k and everything it outputs on down the chain */
+static void chain_run( int k, int nop, hOP* ops, const segy* tr )
+{
+    if (k==nop)
+        TIO_puttr( tio, tr );
+    else {
+        segy* out;
+        OP_push( ops[k], tr );
+        while ((out = OP_pull( ops[k] )))
+            chain_run( k+1, nop, ops, out );
+    }
+}
+
+static void chain_serial( int nop, hOP* ops )
+{
+    segy* tr;
+    segy* out;
+    while ((tr = TIO_get(tio)))
+        chain_run( 0, nop, ops, tr );
+/* Flush the stages in order so each sees all its input first */
+    for (int k=0; k<nop; k++) {
+        OP_flush( ops[k] );
+        while ((out = OP_pull( ops[k] )))
+            chain_run( k+1, nop, ops, out );
+    }
+}
+
+static void queue_init( chain_Queue* q, int nslots )
+{
+    q->nslots = nslots;
+    q->head = 0;
+    q->count = 0;
+    q->done = 0;
+    q->slots = ealloc1( nslots, sizeof(segy) );
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+}
+
+static void queue_free( chain_Queue* q )
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->changed);
+    free1( q->slots );
+}
+
+/* Copy a trace into the queue, waiting for a free slot */
+static void queue_put( chain_Queue* q, const segy* tr )
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->nslots)
+        pthread_cond_wait(&q->changed, &q->lock);
+    segy* slot = &q->slots[(q->head+q->count)%q->nslots];
+    pthread_mutex_unlock(&q->lock);
+    memcpy( (void*)slot, (void*)tr, HDRBYTES + tr->ns*FSIZE );
+    pthread_mutex_lock(&q->lock);
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Mark the end of the traces in the queue */
+static void queue_end( chain_Queue* q )
+{
+    pthread_mutex_lock(&q->lock);
+    q->done = 1;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Oldest trace in the queue, left in place until queue_pop, or NULL at the end */
+static segy* queue_front( chain_Queue* q )
+{
+    segy* tr = 0;
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->done)
+        pthread_cond_wait(&q->changed, &q->lock);
+    if (q->count)
+        tr = &q->slots[q->head];
+    pthread_mutex_unlock(&q->lock);
+    return tr;
+}
+
+static void queue_pop( chain_Queue* q )
+{
+    pthread_mutex_lock(&q->lock);
+    q->head = (q->head+1)%q->nslots;
+    q->count--;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void stage_output( chain_Stage* s )
+{
+    segy* out;
+    while ((out = OP_pull( s->op ))) {
+        if (s->out)
+            queue_put( s->out, out );
+        else
+            TIO_puttr( tio, out );
+    }
+}
+
+/* The first stage reads the input and the last writes the output */
+static void* stage_worker( void* arg )
+{
+    chain_Stage* s = (chain_Stage*) arg;
+    segy* tr;
+    while ((tr = (s->in)? queue_front( s->in ) : TIO_get(tio))) {
+        OP_push( s->op, tr );
+        if (s->in)
+            queue_pop( s->in );
+        stage_output( s );
+    }
+    OP_flush( s->op );
+    stage_output( s );
+    if (s->out)
+        queue_end( s->out );
+    return NULL;
+}
+
+static void chain_threaded( int nop, hOP* ops, int qsize )
+{
+    chain_Stage* stages = ealloc1( nop, sizeof(chain_Stage) );
+    chain_Queue* queues = ealloc1( nop-1, sizeof(chain_Queue) );
+    pthread_t* threads = ealloc1( nop, sizeof(pthread_t) );
+
+    for (int k=0; k<nop-1; k++)
+        queue_init( &queues[k], qsize );
+    for (int k=0; k<nop; k++) {
+        stages[k].op = ops[k];
+        stages[k].in = (k>0)? &queues[k-1] : 0;
+        stages[k].out = (k<nop-1)? &queues[k] : 0;
+    }
+    for (int k=0; k<nop; k++)
+        if (pthread_create(&threads[k], NULL, stage_worker, &stages[k]))
+            err("unable to start thread for stage %d", k+1);
+    for (int k=0; k<nop; k++)
+        pthread_join(threads[k], NULL);
+
+    for (int k=0; k<nop-1; k++)
+        queue_free( &queues[k] );
+    free1( threads );
+    free1( queues );
+    free1( stages );
+}
@@ -0,0 +1,325 @@
+/* Copyright (c) Wayne Mogg, 2017.*/
+/* All rights reserved.                       */
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "su.h"
+#include "segy.h"
+#include "header.h"
+#include "sux.h"
+
+/*********************** self documentation **********************/
+char *sdoc[] = {
+"# SUXPAR ",
+"Run a rolling panel filter on a seismic file in parallel shards ",
+" ",
+"## Usage ",
+"   suxpar \"program [parameters]\" out= [nproc=] [halo=] < infile ",
+" ",
+"eg: ",
+" ",
+"   suxpar \"susdft_denoise ntr=11 reject=20\" out=result.su nproc=8 < data.su ",
+" ",
+"gives the same output file, byte for byte, as: ",
+" ",
+"   susdft_denoise ntr=11 reject=20 < data.su > result.su ",
+" ",
+"### Required Parameters ",
+"| Parameter | Description                                     | Default       |",
+"|:---------:| ----------------------------------------------- |:-------------:|",
+"| out=      | name of the output file                         |               |",
+" ",
+"### Optional Parameters ",
+"| Parameter | Description                                     | Default       |",
+"|:---------:| ----------------------------------------------- |:-------------:|",
+"| nproc=    | number of shards processed in parallel          | cpus online   |",
+"| halo=     | number of traces added to each side of a shard  | ntr/2         |",
+"| verbose=  | =0 no advisory messages, =1 for messages        | 0             |",
+" ",
+"## Notes ",
+"The input must be a regular SU file, not a pipe, SEG-Y or compressed. It is split into ",
+"nproc contiguous ranges of traces and each range is extended by halo traces on both ",
+"sides so the traces in the range see the same neighbours as in a single run. A copy of ",
+"the program is started for each shard and the traces it outputs for the range, without ",
+"the halo, are written at their place in the preallocated output file. ",
+" ",
+"The program must output one trace of the same size for each input trace and use at most ",
+"ntr/2 traces on either side of each output trace. This holds for the 2D modes of ",
+"sutrcmedian, suctrcmedian, sulpasmooth, susdft_denoise and susdct_denoise, for which ",
+"the halo is worked out from the ntr= of the program. For other programs halo= must be ",
+"given. The 3D modes, with key1=, and compress=1 are not supported. ",
+" ",
+NULL};
+
+/* Author: Wayne Mogg, May 2017
+ *
+ * Trace header fields accessed: ns
+ */
+/**************** end self doc ***********************************/
+
+/* Default ntr of the programs suxpar knows how to shard */
+static const struct {
+    const char* name;
+    int ntr;
+} par_table[] = {
+    { "sutrcmedian", 5 },
+    { "suctrcmedian", 5 },
+    { "sulpasmooth", 5 },
+    { "susdft_denoise", 9 },
+    { "susdct_denoise", 9 },
+    { 0, 0 }
+};
+
+typedef struct {
+    int fd;
+    const char* data;
+    size_t nbytes;
+} par_Feed;
+
+static char** par_parse( char* stage, int* nargs );
+static const char* par_index( size_t* size, int* ntraces, long** offset );
+static void par_shard( const char* data, char** args, int first, int last, int lo, int hi, long* offset, int outfd );
+
+int
+main(int argc, char **argv)
+{
+    cwp_String outfile;
+    int nproc;
+    int halo;
+    int verbose;
+    int ntr;
+    char* key1;
+    int compress;
+    int nargs = 0;
+    char** args = 0;
+
+// Initialize
+    initargs(argc, argv);
+    requestdoc(1);
+
+// Get parameters
+    if (!getparstring("out", &outfile))
+        err("out= must be given.");
+    if (!getparint("nproc", &nproc)) nproc = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nproc < 1) nproc = 1;
+    if (!getparint("verbose", &verbose)) verbose = 0;
+
+/* The argument whose first word is not a name=value pair is the program */
+    for (int i=1; i<argc; i++) {
+        size_t len = strcspn( argv[i], " \t" );
+        if (memchr( argv[i], '=', len ))
+            continue;
+        if (args)
+            err("only one program can be given.");
+        args = par_parse( argv[i], &nargs );
+    }
+    if (!args)
+        err("no program given.");
+    if (OP_getstring( nargs-1, args+1, "key1", &key1 ))
+        err("%s: 3D processing with key1= is not supported.", args[0]);
+    if (OP_getint( nargs-1, args+1, "compress", &compress ) && compress)
+        err("%s: compressed output is not supported.", args[0]);
+    if (!getparint("halo", &halo)) {
+        int known = 0;
+        for (int i=0; par_table[i].name; i++)
+            if (STREQ(args[0], par_table[i].name)) {
+                ntr = par_table[i].ntr;
+                known = 1;
+            }
+        if (!known)
+            err("halo= must be given for %s.", args[0]);
+        OP_getint( nargs-1, args+1, "ntr", &ntr );
+        halo = (ntr|1)/2;
+    }
+
+/* Byte offset of each trace in the input and output files */
+    size_t size;
+    int ntraces;
+    long* offset;
+    const char* data = par_index( &size, &ntraces, &offset );
+    if (ntraces == 0)
+        err("no traces in input.");
+    if (nproc > ntraces) nproc = ntraces;
+
+    int outfd = open( outfile, O_RDWR|O_CREAT|O_TRUNC, 0666 );
+    if (outfd < 0)
+        err("cannot open output file %s.", outfile);
+    if (ftruncate( outfd, offset[ntraces] ))
+        err("cannot allocate %ld bytes for output file %s.", offset[ntraces], outfile);
+
+    pid_t* pids = ealloc1( nproc, sizeof(pid_t) );
+    for (int ip=0; ip<nproc; ip++) {
+        int lo = (int) (((long) ip*ntraces)/nproc);
+        int hi = (int) (((long) (ip+1)*ntraces)/nproc);
+        int first = MAX(lo-halo, 0);
+        int last = MIN(hi+halo, ntraces);
+        if (verbose)
+            warn("shard %d: traces %d to %d with halo %d to %d", ip+1, lo+1, hi, first+1, last);
+        pids[ip] = fork();
+        if (pids[ip] < 0)
+            err("cannot start process for shard %d.", ip+1);
+        if (pids[ip] == 0) {
+            par_shard( data, args, first, last, lo, hi, offset, outfd );
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    int failed = 0;
+    for (int ip=0; ip<nproc; ip++) {
+        int status;
+        if (waitpid( pids[ip], &status, 0 ) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+            failed++;
+    }
+    if (close( outfd ))
+        err("error closing output file %s.", outfile);
+    if (failed)
+        err("%d of %d shards failed, %s is incomplete.", failed, nproc, outfile);
+
+    free1( pids );
+    free1( offset );
+    munmap( (void*) data, size );
+    return EXIT_SUCCESS;
+}
+
+/* Split a program string into a NULL terminated argument list */
+static char** par_parse( char* stage, int* nargs )
+{
+    char* copy = ealloc1( strlen(stage)+1, 1 );
+    char** args = ealloc1( strlen(stage)/2+2, sizeof(char*) );
+    char* tok;
+    strcpy( copy, stage );
+    *nargs = 0;
+    for (tok = strtok( copy, " \t" ); tok; tok = strtok( NULL, " \t" ))
+        args[(*nargs)++] = tok;
+    args[*nargs] = 0;
+    return args;
+}
+
+/* Memory map standard input and index its traces. This is done without TIO
+   so the process has a single thread when the shards are forked. Returns
+   the start of the mapping, offset[ntraces] is the size of the traces */
+static const char* par_index( size_t* size, int* ntraces, long** offset )
+{
+    struct stat st;
+#ifdef SUXDR
+    err("input must be a regular file of uncompressed SU traces.");
+#endif
+    if (fstat( fileno(stdin), &st ) || !S_ISREG(st.st_mode))
+        err("input must be a regular file of uncompressed SU traces.");
+    *size = st.st_size;
+    *ntraces = 0;
+    *offset = ealloc1( 1, sizeof(long) );
+    (*offset)[0] = 0;
+    if (*size == 0)
+        return 0;
+    const char* data = mmap( 0, *size, PROT_READ, MAP_PRIVATE, fileno(stdin), 0 );
+    if (data == MAP_FAILED)
+        err("cannot map the input file.");
+    hSGY sgy = SGY_init( data, *size );
+    if (sgy || (*size >= 8 && (!memcmp( data, "SUXFPZ1", 8 ) || !memcmp( data, "SUXQNT1", 8 ))))
+        err("input must be a regular file of uncompressed SU traces.");
+
+    size_t off = 0;
+    int maxtr = 0;
+    while (off + HDRBYTES <= *size) {
+        size_t nbytes = HDRBYTES + ((const segy*) (data + off))->ns*FSIZE;
+        if (off + nbytes > *size)
+            break;
+        if (*ntraces+1 >= maxtr) {
+            maxtr = (maxtr)? 2*maxtr : 1024;
+            *offset = erealloc1( *offset, maxtr, sizeof(long) );
+        }
+        (*offset)[(*ntraces)++] = off;
+        off += nbytes;
+        (*offset)[*ntraces] = off;
+    }
+    if (off != *size)
+        warn("ignoring %zu bytes at the end of the input", *size-off);
+    return data;
+}
+
+/* Write the input of a shard to the program on its own thread so reading
+   the program output can't deadlock against it */
+static void* par_feed( void* arg )
+{
+    par_Feed* f = (par_Feed*) arg;
+    size_t nput = 0;
+    while (nput < f->nbytes) {
+        ssize_t n = write( f->fd, f->data + nput, f->nbytes - nput );
+        if (n <= 0)
+            break;
+        nput += n;
+    }
+    close( f->fd );
+    return NULL;
+}
+
+/* Read exactly nbytes from a file descriptor, returns the number read */
+static size_t par_read( int fd, char* buf, size_t nbytes )
+{
+    size_t nget = 0;
+    while (nget < nbytes) {
+        ssize_t n = read( fd, buf + nget, nbytes - nget );
+        if (n <= 0)
+            break;
+        nget += n;
+    }
+    return nget;
+}
+
+/* Run the program on input traces first to last-1 and write its output for
+   traces lo to hi-1 to the output file. Runs in a child process. */
+static void par_shard( const char* data, char** args, int first, int last, int lo, int hi, long* offset, int outfd )
+{
+    int pin[2], pout[2];
+    if (pipe(pin) || pipe(pout))
+        err("cannot create pipes for %s.", args[0]);
+    pid_t pid = fork();
+    if (pid < 0)
+        err("cannot start %s.", args[0]);
+    if (pid == 0) {
+        dup2( pin[0], 0 );
+        dup2( pout[1], 1 );
+        close( pin[0] ); close( pin[1] );
+        close( pout[0] ); close( pout[1] );
+        close( outfd );
+        execvp( args[0], args );
+        warn("cannot run %s.", args[0]);
+        _exit(127);
+    }
+    close( pin[0] );
+    close( pout[1] );
+
+    pthread_t feeder;
+    par_Feed feed;
+    feed.fd = pin[1];
+    feed.data = data + offset[first];
+    feed.nbytes = offset[last] - offset[first];
+    if (pthread_create(&feeder, NULL, par_feed, &feed))
+        err("unable to start thread for %s.", args[0]);
+
+    segy tr;
+    int itr = first;
+    while (par_read( pout[0], (char*) &tr, HDRBYTES ) == HDRBYTES) {
+        size_t nbytes = tr.ns*FSIZE;
+        if (itr == last || (long) (HDRBYTES + nbytes) != offset[itr+1] - offset[itr])
+            err("%s does not output one trace of the same size for each input trace.", args[0]);
+        if (par_read( pout[0], (char*) tr.data, nbytes ) != nbytes)
+            err("%s output ends in a partial trace.", args[0]);
+        if (itr >= lo && itr < hi)
+            if (pwrite( outfd, &tr, HDRBYTES + nbytes, offset[itr] ) != (ssize_t) (HDRBYTES + nbytes))
+                err("error writing trace %d.", itr+1);
+        itr++;
+    }
+    close( pout[0] );
+    pthread_join(feeder, NULL);
+
+    int status;
+    if (waitpid( pid, &status, 0 ) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+        err("%s failed on traces %d to %d.", args[0], first+1, last);
+    if (itr != last)
+        err("%s output %d traces for %d input traces.", args[0], itr-first, last-first);
+}